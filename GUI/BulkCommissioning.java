@@ -0,0 +1,214 @@
+import java.io.BufferedReader;
+import java.io.FileReader;
+import java.io.IOException;
+import java.util.ArrayList;
+import java.util.HashSet;
+import java.util.Iterator;
+import java.util.LinkedHashMap;
+import java.util.LinkedList;
+import java.util.List;
+import java.util.Map;
+import java.util.Set;
+
+/**
+ * Sets up every node of a building plan in one pass, without pushing the
+ * user button of each node.
+ *
+ * The plan has a line per node in the format of SetupSensorGUI, which is
+ * "a.b:x.y:exit:n1:n2:..." (Rime ID, coordinates, 1 for an exit node and the
+ * Rime IDs of the neighbors). Empty lines and lines starting with # are
+ * skipped. Every node must have its Rime ID already, and may have at most
+ * MAX_NEIGHBORS neighbors.
+ *
+ * The sink sends every node its setup packet by mesh, and the node answers
+ * with an acknowledgement. A few nodes are set up at a time, and nodes that do
+ * not answer are tried again a couple of times.
+ */
+public class BulkCommissioning {
+
+	/* nodes being set up at a time */
+	public static final int WINDOW = 4;
+	/* ms to wait for a node to answer */
+	public static final long ACK_TIMEOUT = 15000;
+	public static final int MAX_ATTEMPTS = 3;
+	/* ms between lines to the sink, which has a small serial buffer */
+	public static final long LINE_GAP = 50;
+	/* neighbors that fit in a setup packet sent by mesh, see
+	 * SETUP_MAX_NEIGHBORS in main_reg_sensor.c */
+	public static final int MAX_NEIGHBORS = 6;
+
+	private static final String LINE_FORMAT =
+		"\\d+\\.\\d+:\\d+\\.\\d+:[01](:\\d+\\.\\d+)+";
+
+	/**
+	 * A node that has been sent its setup packet
+	 */
+	private static class Pending {
+		String line;
+		int attempts;
+		long deadline;
+	}
+
+	private SerialCommunication serialCom;
+	private List<String> plan;
+	private List<String> failed;
+
+	/**
+	 * Constructor
+	 * @param serialCom Connection to the sink, opened for "bulkSetup"
+	 * @param plan Lines of the building plan
+	 */
+	public BulkCommissioning(SerialCommunication serialCom, List<String> plan) {
+		this.serialCom = serialCom;
+		this.plan = plan;
+		this.failed = new ArrayList<String>();
+	}
+
+	/**
+	 * Reads a building plan
+	 * @param fileName Plan file
+	 * @return lines of the plan
+	 * @throws IOException if the file can not be read or a line is malformed
+	 */
+	public static List<String> readPlan(String fileName) throws IOException {
+		List<String> plan = new ArrayList<String>();
+		Set<String> rimeIDs = new HashSet<String>();
+		BufferedReader in = new BufferedReader(new FileReader(fileName));
+		try {
+			String line;
+			int number = 0;
+			while((line = in.readLine()) != null){
+				number++;
+				line = line.trim();
+				if(line.length() == 0 || line.startsWith("#")){
+					continue;
+				}
+				if(!line.matches(LINE_FORMAT)){
+					throw new IOException(fileName + ":" + number +
+							": not a.b:x.y:exit:n1:n2:... '" + line + "'");
+				}
+				int neighbors = line.split(":").length - 3;
+				if(neighbors > MAX_NEIGHBORS){
+					throw new IOException(fileName + ":" + number + ": " +
+							neighbors + " neighbors, at most " + MAX_NEIGHBORS +
+							" fit in a setup packet");
+				}
+				if(!rimeIDs.add(rimeID(line))){
+					throw new IOException(fileName + ":" + number +
+							": " + rimeID(line) + " is in the plan already");
+				}
+				plan.add(line);
+			}
+		} finally {
+			in.close();
+		}
+		return plan;
+	}
+
+	/**
+	 * Rime ID of a plan line, as the decoder reports it
+	 * @param line Plan line
+	 * @return rimeID "a.b"
+	 */
+	public static String rimeID(String line) {
+		String id = line.substring(0, line.indexOf(':'));
+		int dot = id.indexOf('.');
+		return Integer.parseInt(id.substring(0, dot)) + "." +
+				Integer.parseInt(id.substring(dot+1));
+	}
+
+	/**
+	 * Sets up all nodes of the plan
+	 * @return number of nodes that answered
+	 */
+	public int run() throws InterruptedException {
+		LinkedList<String> todo = new LinkedList<String>(plan);
+		Map<String, Pending> pending = new LinkedHashMap<String, Pending>();
+		int done = 0;
+
+		serialCom.writeSerialData("sink");
+		while(!todo.isEmpty() || !pending.isEmpty()){
+			while(pending.size() < WINDOW && !todo.isEmpty()){
+				Pending p = new Pending();
+				p.line = todo.removeFirst();
+				send(p);
+				pending.put(rimeID(p.line), p);
+			}
+
+			long wait = Long.MAX_VALUE;
+			for(Pending p : pending.values()){
+				wait = Math.min(wait, p.deadline - System.currentTimeMillis());
+			}
+			String ack = serialCom.pollSetupAck(Math.max(wait, 1));
+			if(ack != null && pending.remove(ack) != null){
+				done++;
+				System.out.println("@COMMISSIONED:" + ack + ":" + done + "/" +
+									plan.size());
+			}
+
+			long now = System.currentTimeMillis();
+			Iterator<Map.Entry<String, Pending>> it =
+				pending.entrySet().iterator();
+			while(it.hasNext()){
+				Map.Entry<String, Pending> e = it.next();
+				Pending p = e.getValue();
+				if(p.deadline > now){
+					continue;
+				}
+				if(p.attempts < MAX_ATTEMPTS){
+					send(p);
+				}
+				else{
+					System.out.println("@COMMISSION_FAILED:" + e.getKey());
+					failed.add(e.getKey());
+					it.remove();
+				}
+			}
+		}
+		return done;
+	}
+
+	/**
+	 * Getter of the nodes that did not answer
+	 * @return Rime IDs
+	 */
+	public List<String> getFailed() {
+		return failed;
+	}
+
+	private void send(Pending p) throws InterruptedException {
+		Thread.sleep(LINE_GAP);
+		p.attempts++;
+		p.deadline = System.currentTimeMillis() + ACK_TIMEOUT;
+		serialCom.writeSerialData("provision_setup_packet:" + p.line);
+	}
+
+	/**
+	 * @param args plan file and, optionally, the COM port of the sink
+	 */
+	public static void main(String[] args) throws Exception {
+		if(args.length < 1){
+			System.err.println("usage: java BulkCommissioning plan [/dev/ttyUSB0]");
+			System.exit(1);
+		}
+		List<String> plan = readPlan(args[0]);
+		String comPort = args.length > 1 ? args[1] : "/dev/ttyUSB0";
+
+		SerialCommunication serialCom =
+			new SerialCommunication(comPort, "bulkSetup");
+		BulkCommissioning bc = new BulkCommissioning(serialCom, plan);
+		long start = System.currentTimeMillis();
+		int done = bc.run();
+
+		System.out.println("Commissioned " + done + " of " + plan.size() +
+				" nodes in " + (System.currentTimeMillis() - start) / 1000 + " s");
+		if(!bc.getFailed().isEmpty()){
+			System.out.println("No answer from: " + bc.getFailed());
+		}
+
+		// start the network, like SetupSensorGUI does
+		serialCom.writeSerialData("send_init_packet");
+		System.out.println("send_init_packet");
+		System.exit(bc.getFailed().isEmpty() ? 0 : 2);
+	}
+}
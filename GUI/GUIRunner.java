@@ -1,3 +1,4 @@
+import javax.swing.SwingUtilities;
 
 /**
  * GUIRunner is a driver class of SensorNetworkGUI.
@@ -11,7 +12,7 @@ public class GUIRunner extends Thread {
 	private static SerialCommunication serialCom;
 	
 	/**
-	 * Run method is executed when GUIRunner thread is started
+	 * Run method creates the user interface, on the Swing thread
 	 */
 	@Override
 	public void run() {
@@ -34,19 +35,7 @@ public class GUIRunner extends Thread {
 	 * @param args
 	 */
 	public static void main(String[] args) {
-		// Start user interface
-		GUIRunner guiRunner = new GUIRunner();
-		guiRunner.start();
-		
-		// Continuously check if there is new data to plot on the user interface
-		while(true){
-			SensorNetworkGUI snGUI = guiRunner.getGui();
-			
-			if(snGUI!=null && snGUI.checkNewData()==true){
-				snGUI.terminate();				
-				guiRunner = new GUIRunner();
-				guiRunner.start();	
-			}
-		}
+		// Start user interface, it takes new data from the network itself
+		SwingUtilities.invokeLater(new GUIRunner());
 	}
 }
@@ -0,0 +1,129 @@
+import java.awt.Color;
+import java.awt.Dimension;
+import java.awt.FontMetrics;
+import java.awt.Graphics;
+import java.awt.Rectangle;
+import java.util.LinkedHashMap;
+import java.util.Map;
+
+import javax.swing.JPanel;
+
+/**
+ * Map of the sensor network, painted in one component.
+ * Keeps the last known state of every node by Rime ID. Changes are collected
+ * with updateNode(), and commit() repaints the area of the nodes that changed
+ * at once. The nodes are not changed, so they may be shared with a NodeStore.
+ * Only to be used from the Swing thread.
+ */
+public class NetworkMap extends JPanel {
+
+	private static final long serialVersionUID = -2480914657329153606L;
+
+	public static final Color FIRE_COLOR = new Color(255,0,0);
+	public static final Color NODE_COLOR = new Color(0,0,255);
+	public static final Color EXIT_COLOR = new Color(0,255,0);
+
+	/* where node (0,0) is drawn and how far apart nodes are */
+	private static final int LEFT = 240;
+	private static final int TOP = 130;
+	private static final int X_STEP = 60;
+	private static final int Y_STEP = 35;
+	private static final int NODE_WIDTH = 50;
+	private static final int NODE_HEIGHT = 25;
+
+	private Map<String, SensorNode> nodes;
+	private Rectangle dirty;
+	private Dimension size;
+
+	/**
+	 * Constructor
+	 */
+	public NetworkMap() {
+		super(null);
+		nodes = new LinkedHashMap<String, SensorNode>();
+		size = new Dimension(LEFT, TOP);
+		setBackground(Color.WHITE);
+	}
+
+	/**
+	 * Adds a node or changes its state
+	 * @param node Reported state of the node
+	 * @return boolean true if the map changed, otherwise false
+	 */
+	public boolean updateNode(SensorNode node) {
+		SensorNode old = nodes.get(node.getRimeID());
+		if(old != null && node.equals(old)){
+			return false;
+		}
+		if(old != null){
+			markDirty(old);
+		}
+		nodes.put(node.getRimeID(), node);
+		markDirty(node);
+		return true;
+	}
+
+	/**
+	 * Repaints the nodes changed since the last commit
+	 */
+	public void commit() {
+		if(dirty == null){
+			return;
+		}
+		if(dirty.x+dirty.width > size.width || dirty.y+dirty.height > size.height){
+			size = new Dimension(Math.max(size.width, dirty.x+dirty.width),
+								Math.max(size.height, dirty.y+dirty.height));
+			revalidate();
+		}
+		repaint(dirty);
+		dirty = null;
+	}
+
+	@Override
+	public Dimension getPreferredSize() {
+		return size;
+	}
+
+	@Override
+	protected void paintComponent(Graphics g) {
+		super.paintComponent(g);
+		Rectangle clip = g.getClipBounds();
+		FontMetrics fm = g.getFontMetrics();
+		for(SensorNode node : nodes.values()){
+			Rectangle r = bounds(node);
+			if(clip != null && !clip.intersects(r)){
+				continue;
+			}
+			if(node.isOnFire()){
+				g.setColor(FIRE_COLOR);
+			}
+			else if(node.isExit()){
+				g.setColor(EXIT_COLOR);
+			}
+			else{
+				g.setColor(NODE_COLOR);
+			}
+			g.fillRect(r.x, r.y, r.width, r.height);
+			g.setColor(Color.BLACK);
+			g.drawString(node.getRimeID(),
+					r.x + (r.width - fm.stringWidth(node.getRimeID())) / 2,
+					r.y + (r.height + fm.getAscent() - fm.getDescent()) / 2);
+		}
+	}
+
+	private void markDirty(SensorNode node) {
+		Rectangle r = bounds(node);
+		if(dirty == null){
+			dirty = r;
+		}
+		else{
+			dirty.add(r);
+		}
+	}
+
+	private static Rectangle bounds(SensorNode node) {
+		return new Rectangle(X_STEP*node.getxCoordinate()+LEFT,
+							Y_STEP*node.getyCoordinate()+TOP,
+							NODE_WIDTH, NODE_HEIGHT);
+	}
+}
@@ -0,0 +1,144 @@
+import java.util.HashMap;
+import java.util.Map;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.ConcurrentLinkedQueue;
+
+/**
+ * State of the sensor network by Rime ID, as reported by the sink.
+ * Written by the serial reader thread only; any other thread may read the
+ * nodes and poll the events without locking.
+ * Stored nodes are never changed, a change puts a new SensorNode.
+ */
+public class NodeStore {
+
+	/**
+	 * A change of the state of one node
+	 */
+	public static class Event {
+		public static final int REPORT = 0;
+		public static final int FIRE = 1;
+		public static final int ANTI_FIRE = 2;
+
+		private final int type;
+		private final String rimeID;
+		private final SensorNode node;
+
+		private Event(int type, String rimeID, SensorNode node) {
+			this.type = type;
+			this.rimeID = rimeID;
+			this.node = node;
+		}
+
+		/**
+		 * Getter of event type
+		 * @return type REPORT, FIRE or ANTI_FIRE
+		 */
+		public int getType() {
+			return type;
+		}
+
+		/**
+		 * Getter of Rime ID
+		 * @return rimeID
+		 */
+		public String getRimeID() {
+			return rimeID;
+		}
+
+		/**
+		 * Getter of the new node state
+		 * @return node or null if the node has not reported yet
+		 */
+		public SensorNode getNode() {
+			return node;
+		}
+	}
+
+	private ConcurrentHashMap<String, SensorNode> nodes;
+	private ConcurrentLinkedQueue<Event> events;
+
+	/* fire status of nodes that have not reported yet, reader thread only */
+	private Map<String, Boolean> pendingFire;
+
+	/**
+	 * Constructor
+	 */
+	public NodeStore() {
+		nodes = new ConcurrentHashMap<String, SensorNode>();
+		events = new ConcurrentLinkedQueue<Event>();
+		pendingFire = new HashMap<String, Boolean>();
+	}
+
+	/**
+	 * Stores a node report
+	 * @param node Reported state of the node
+	 * @return boolean true if the state of the node changed, otherwise false
+	 */
+	public boolean report(SensorNode node) {
+		String rimeID = node.getRimeID();
+		SensorNode old = nodes.get(rimeID);
+		if(old == null){
+			Boolean fire = pendingFire.remove(rimeID);
+			if(fire != null){
+				node = node.withFire(fire);
+			}
+		}
+		if(old != null && node.equals(old)){
+			return false;
+		}
+		nodes.put(rimeID, node);
+		events.add(new Event(Event.REPORT, rimeID, node));
+		return true;
+	}
+
+	/**
+	 * Stores a fire announcement
+	 * @param rimeID Rime ID of the node
+	 * @param isOnFire false when the fire is over
+	 * @return boolean true if the fire status changed, otherwise false
+	 */
+	public boolean setOnFire(String rimeID, boolean isOnFire) {
+		SensorNode node = nodes.get(rimeID);
+		if(node == null){
+			Boolean old = pendingFire.put(rimeID, isOnFire);
+			if(old != null && old == isOnFire){
+				return false;
+			}
+		}
+		else if(node.isOnFire() == isOnFire){
+			return false;
+		}
+		else{
+			node = node.withFire(isOnFire);
+			nodes.put(rimeID, node);
+		}
+		events.add(new Event(isOnFire ? Event.FIRE : Event.ANTI_FIRE, rimeID,
+								node));
+		return true;
+	}
+
+	/**
+	 * Getter of a node
+	 * @param rimeID Rime ID of the node
+	 * @return SensorNode or null if the node has not reported yet
+	 */
+	public SensorNode getNode(String rimeID) {
+		return nodes.get(rimeID);
+	}
+
+	/**
+	 * Number of nodes that have reported
+	 * @return size
+	 */
+	public int size() {
+		return nodes.size();
+	}
+
+	/**
+	 * Takes the oldest change
+	 * @return Event or null if there is none
+	 */
+	public Event poll() {
+		return events.poll();
+	}
+}
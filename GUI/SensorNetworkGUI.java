@@ -2,33 +2,34 @@ import java.awt.Color;
 import java.awt.GridLayout;
 import java.awt.event.ActionEvent;
 import java.awt.event.ActionListener;
-import java.util.Vector;
 
 import javax.swing.JButton;
 import javax.swing.JFrame;
 import javax.swing.JLabel;
 import javax.swing.JPanel;
+import javax.swing.JScrollPane;
 import javax.swing.SwingUtilities;
+import javax.swing.Timer;
 
 public class SensorNetworkGUI extends JFrame {
 
 	private static final long serialVersionUID = 6364550794187721205L;
-	private JPanel cornerPanel;
-	private Vector<JPanel> nodes;
-	private SerialCommunication serialCom;
 	
-	private Vector<SensorNode> nodeVector;
-	private Vector<SensorNode> oldNodeVector;
+	/* how often new data is taken from the network, in ms */
+	private static final int REFRESH_PERIOD = 100;
 	
-	private Vector<String> fireVector;
-	private Vector<String> oldFireVector;
+	private JPanel cornerPanel;
+	private NetworkMap map;
+	private SerialCommunication serialCom;
 	
 	private JFrame mainFrame;
 	private JButton resetButton;
 	private ResetButtonListener resetbuttonListener;
+	private Timer refreshTimer;
 	
 	/**
 	 * Constructor
+	 * Must be called from the Swing thread
 	 */
 	public SensorNetworkGUI(SerialCommunication serialCom){
 		this.serialCom = serialCom;
@@ -39,6 +40,7 @@ public class SensorNetworkGUI extends JFrame {
 	 * Destructor
 	 */
 	public void terminate(){
+		refreshTimer.stop();
 		mainFrame.dispose();
 	}
 	
@@ -49,21 +51,25 @@ public class SensorNetworkGUI extends JFrame {
 		GridLayout gridLayout = new GridLayout(4,2,5,5);
 		cornerPanel = new JPanel(gridLayout);
 		
-		nodes = new Vector<JPanel>();
-		nodeVector = new Vector<SensorNode>();
-		oldNodeVector = new Vector<SensorNode>();
-		fireVector = new Vector<String>();
-		oldFireVector = new Vector<String>();
+		map = new NetworkMap();
 		
 		mainFrame = new JFrame();
 		mainFrame.setDefaultCloseOperation(EXIT_ON_CLOSE);
 		mainFrame.setSize(800, 700);
 		
 		initCornerPanel();
-		mainFrame.add(cornerPanel);
+		map.add(cornerPanel);
+		mainFrame.add(new JScrollPane(map));
 		
 		checkNewData();
-		updateWindow();
+		mainFrame.setVisible(true);
+		
+		refreshTimer = new Timer(REFRESH_PERIOD, new ActionListener() {
+			public void actionPerformed(ActionEvent e) {
+				checkNewData();
+			}
+		});
+		refreshTimer.start();
 	}
 	
 	/**
@@ -71,19 +77,19 @@ public class SensorNetworkGUI extends JFrame {
 	 */
 	private void initCornerPanel(){
 		JPanel redPanel = new JPanel();
-		redPanel.setBackground(new Color(255,0,0));
+		redPanel.setBackground(NetworkMap.FIRE_COLOR);
 		JLabel redLabel = new JLabel("Node on fire");
 		cornerPanel.add(redPanel);
 		cornerPanel.add(redLabel);
 		
 		JPanel bluePanel = new JPanel();
-		bluePanel.setBackground(new Color(0,0,255));
+		bluePanel.setBackground(NetworkMap.NODE_COLOR);
 		JLabel blueLabel = new JLabel("No fire, not exit");
 		cornerPanel.add(bluePanel);
 		cornerPanel.add(blueLabel);
 		
 		JPanel greenPanel = new JPanel();
-		greenPanel.setBackground(new Color(0,255,0));
+		greenPanel.setBackground(NetworkMap.EXIT_COLOR);
 		JLabel greenLabel = new JLabel("Exit node");
 		cornerPanel.add(greenPanel);
 		cornerPanel.add(greenLabel);
@@ -98,98 +104,25 @@ public class SensorNetworkGUI extends JFrame {
 	}
 	
 	/**
-	 * Check if there is any new data from the network
-	 * @return boolean true if there is new data, otherwise false
+	 * Applies the changes that came from the network since the last check
+	 * to the map, which is repainted once for all of them
+	 * @return boolean true if the map changed, otherwise false
 	 */
-	@SuppressWarnings("unchecked")
 	public boolean checkNewData(){
-		Vector<String> nodeData = serialCom.getData();
-		fireVector = serialCom.getFireData();
+		NodeStore store = serialCom.getStore();
+		NodeStore.Event event;
 		boolean newData = false;
-		if(nodeData.size()>0){		
-			for(int i=0; i<nodeData.size(); i++){
-				if(nodeVector.size()<=i){
-					nodeVector.addElement(SensorNode.parseSensorNode(nodeData.get(i)));
-				}
-				else{
-					nodeVector.setElementAt(SensorNode.parseSensorNode(nodeData.get(i)),i);
-				}				
-			}						
-			if(!nodeVector.equals(oldNodeVector)){
-				oldNodeVector = (Vector<SensorNode>) nodeVector.clone();
-				newData = true;
-			}
-		}
-		if(!fireVector.equals(oldFireVector)){
-			oldFireVector = (Vector<String>) fireVector.clone();
-			
-			for(int x=0; x<fireVector.size(); x++){
-				String temp = fireVector.get(x);
-				boolean fireOccurence = !temp.startsWith("clean:");
-				temp = temp.substring(temp.indexOf(':')+1);
-				for(int q=0; q<nodeVector.size(); q++){
-					if(nodeVector.get(q).getRimeID().equals(temp)){								
-						if(fireOccurence){
-							SensorNode sn = nodeVector.get(q);
-							sn.setOnFire(true);
-							nodeVector.setElementAt(sn, q);
-							serialCom.changeFireStatus(q,"1");
-						}
-						else{System.out.println("Node is found");
-							SensorNode sn = nodeVector.get(q);
-							sn.setOnFire(true);
-							nodeVector.setElementAt(sn, q);
-							serialCom.changeFireStatus(q,"0");
-							serialCom.cleanFire(x);
-						}
-						oldNodeVector = (Vector<SensorNode>) nodeVector.clone();				
-						newData = true;
-					}
-				}
+		
+		while((event = store.poll()) != null){
+			// nodes that have not reported yet are not on the map
+			if(event.getNode() != null){
+				newData |= map.updateNode(event.getNode());
 			}
 		}
+		
+		map.commit();
 		return newData;
 	}
-	
-	/**
-	 * Updates window so that new data will be visible on screen
-	 */
-	public void updateWindow(){		
-		for(int i=0; i<nodeVector.size(); i++){
-			JPanel jPanel = new JPanel();
-			JLabel rimeID = new JLabel(nodeVector.get(i).getRimeID());
-			int x = nodeVector.get(i).getxCoordinate();
-			int y = nodeVector.get(i).getyCoordinate();
-			
-			jPanel.setBounds(60*x+240, 35*y+130, 50, 25);			
-			jPanel.add(rimeID);
-			
-			if(nodeVector.get(i).isOnFire()){
-				jPanel.setBackground(new Color(255,0,0));
-			}
-			else if(nodeVector.get(i).isExit()){
-				jPanel.setBackground(new Color(0,255,0));
-			}
-			else{
-				jPanel.setBackground(new Color(0,0,255));
-			}
-			
-			mainFrame.add(jPanel);
-			
-			if(nodes.size()<=i){
-				nodes.addElement(jPanel);
-			}
-			else{
-				nodes.setElementAt(jPanel, i);
-			}
-			
-			mainFrame.validate();
-			mainFrame.repaint();
-		}
-		mainFrame.add(new JPanel());
-		mainFrame.validate();		
-		mainFrame.setVisible(true);
-	}
 
 	/**
 	 * UNUSED!!!
@@ -31,6 +31,9 @@ public class SensorNode {
 	 */
 	@Override
 	public boolean equals(Object obj) {
+		if(!(obj instanceof SensorNode)){
+			return false;
+		}
 		SensorNode arg = (SensorNode) obj;
 		if( this.rimeID.equals(arg.rimeID) &&
 			this.xCoordinate == arg.xCoordinate &&
@@ -45,6 +48,19 @@ public class SensorNode {
 		}
 	}
 
+	/**
+	 * Hash code of the content compared by equals
+	 * @return hash
+	 */
+	@Override
+	public int hashCode() {
+		int hash = rimeID.hashCode();
+		hash = 31*hash + xCoordinate;
+		hash = 31*hash + yCoordinate;
+		hash = 31*hash + (isOnFire ? 1 : 0);
+		return 31*hash + (isExit ? 1 : 0);
+	}
+
 	/**
 	 * Getter of Rime ID
 	 * @return rimeID
@@ -85,6 +101,15 @@ public class SensorNode {
 		this.isOnFire = isOnFire;
 	}
 
+	/**
+	 * Copy of this sensor node with another fire status
+	 * @param isOnFire Is this sensor node on fire?
+	 * @return SensorNode
+	 */
+	public SensorNode withFire(boolean isOnFire) {
+		return new SensorNode(rimeID, xCoordinate, yCoordinate, isOnFire, isExit);
+	}
+
 	/**
 	 * Getter of exit status
 	 * @return isExit true if exit node, otherwise false
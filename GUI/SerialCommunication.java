@@ -6,27 +6,30 @@
  * Examples that are located under "contiki-2.4/examples" are also examined.
  */
 
-import java.io.BufferedReader;
-import java.io.IOException;
-import java.io.InputStreamReader;
 import java.io.OutputStreamWriter;
 import java.io.PrintWriter;
-import java.util.Vector;
+import java.util.concurrent.BlockingQueue;
+import java.util.concurrent.LinkedBlockingQueue;
+import java.util.concurrent.TimeUnit;
 
 /*
  * Interfaces to/from tmote sensor:
  * write "extract_report_packet" to serialdump
- * get "a.b:x.y:fire:exit" from serialdump
+ * get telemetry frames from serialdump, see TelemetryDecoder
+ * keep the state of the nodes in a NodeStore
+ *
+ * serialdump is read by a SerialReader, the thread of the purpose takes
+ * what it read.
  */
 public class SerialCommunication {
 	
 	public static final String SERIALDUMP_LINUX = "../tools/sky/serialdump-linux";
 	private Process serialDumpProcess;
 	private PrintWriter serialOutput;
-	private BufferedReader input;
-	private Vector<String> data;
-	private Vector<String> fireData;
-	private boolean continueSetup;
+	private SerialReader reader;
+	private Thread readInput;
+	private NodeStore store;
+	private BlockingQueue<String> setupAcks;
 	private Tellstick ts;	
 
 	/**
@@ -41,20 +44,18 @@ public class SerialCommunication {
 	    /* Connect to COM using external serialdump application */
 	    String fullCommand;
 	    fullCommand = SERIALDUMP_LINUX + " " + "-b115200" + " " + comPort;
-	    data = new Vector<String>();
-	    fireData = new Vector<String>();
-	    continueSetup = true;
+	    store = new NodeStore();
+	    setupAcks = new LinkedBlockingQueue<String>();
 	 
 	    try {
 		    String[] cmd = fullCommand.split(" ");
 		    serialDumpProcess = Runtime.getRuntime().exec(cmd);
-		    input = new BufferedReader(new InputStreamReader(
-		    							serialDumpProcess.getInputStream()));
+		    reader = new SerialReader(serialDumpProcess.getInputStream());
 		    serialOutput = new PrintWriter(new OutputStreamWriter(
 		    							serialDumpProcess.getOutputStream()));
 	
 		    /* Start thread listening on stdout */
-		    Thread readInput = new Thread(new Runnable() {
+		    readInput = new Thread(new Runnable() {
 			    public void run() {
 				    if(purpose.equals("plotMap")){
 				    	System.out.println("Plotting map");
@@ -62,13 +63,16 @@ public class SerialCommunication {
 				    }
 				    else if(purpose.equals("setUpSensor")){
 				    	System.out.println("Setting up sensor");
-				    	while(continueSetup){
-				    		
-				    	}
+				    	setUpSensor();
+				    }
+				    else if(purpose.equals("bulkSetup")){
+				    	System.out.println("Commissioning sensors");
+				    	bulkSetup();
 				    }
 			    }
 		    });	
 		 
+		    reader.start();
 		    readInput.start();
 	 
 	    } catch (Exception e) {
@@ -81,10 +85,12 @@ public class SerialCommunication {
 	
 	/**
 	 * Setter for boolean value of Setup functionality
-	 * Used to start/stop setup cycle
+	 * Used to stop setup cycle, which waits for serial data until then
 	 */
 	public void continueSetup(boolean flag){
-		continueSetup = flag;
+		if(!flag){
+			readInput.interrupt();
+		}
 	}
 	
 	/**
@@ -97,109 +103,142 @@ public class SerialCommunication {
 	}
 	
 	/**
-	 * Get stored data
-	 * Data is retrieved from the network
-	 * @return data
+	 * Getter of the node store
+	 * The state of the network is retrieved from it
+	 * @return store
 	 */
-	public Vector<String> getData(){
-		return data;
+	public NodeStore getStore(){
+		return store;
 	}
-	
+
 	/**
-	 * Get stored fire data
-	 * fireData is retrieved from the network
-	 * @return fireData
+	 * Waits for the next acknowledgement of a provisioned setup packet
+	 * @param timeout ms to wait at most
+	 * @return Rime ID of the node, or null if none came in time
 	 */
-	public Vector<String> getFireData(){
-		return fireData;
+	public String pollSetupAck(long timeout) throws InterruptedException {
+		return setupAcks.poll(timeout, TimeUnit.MILLISECONDS);
 	}
-	
+
 	/**
-	 * Clears fire announcement
-	 * This function is used to clear fires that happen after GUI is started.
+	 * Called while a sensor node is set up
+	 * Prints the output of the sensor node until the setup is stopped
 	 */
-	public void cleanFire(int index){
-		if(fireData.get(index).startsWith("clean:")){
-			String temp = fireData.get(index);
-			temp = temp.substring(temp.indexOf(':')+1);
-			fireData.removeElementAt(index);
-			for(int i=index-1; i>=0; i--){				
-				if(fireData.get(i).equals(temp)){
-					fireData.removeElementAt(i);
-				}
+	public void setUpSensor(){
+		TelemetryDecoder decoder = new TelemetryDecoder(
+				new TelemetryDecoder.Listener() {
+			public void nodeReport(String rimeID, int x, int y,
+									boolean isOnFire, boolean isExit) {
 			}
-		}
+
+			public void emergency(String rimeID, boolean isEmergency) {
+			}
+
+			public void setupAck(String rimeID) {
+			}
+
+			public void textLine(String line) {
+				System.out.println(line);
+			}
+		});
+		feed(decoder);
 	}
-	
+
 	/**
-	 * Changes status of fire on a specific node
-	 * It is required to clean fire from a node that is detected at the beginning of the GUI
+	 * Called while many sensor nodes are set up, see BulkCommissioning
+	 * Hands the acknowledgements of the nodes to pollSetupAck()
 	 */
-	public void changeFireStatus(int index, String val){
-		String string = data.get(index);
-		//a.b:x.y:fire:exit
-		int i = string.lastIndexOf(':');
-		String element = string.substring(0, i-1) + val + string.substring(i);
-		
-		data.setElementAt(element, index);
+	public void bulkSetup(){
+		TelemetryDecoder decoder = new TelemetryDecoder(
+				new TelemetryDecoder.Listener() {
+			public void nodeReport(String rimeID, int x, int y,
+									boolean isOnFire, boolean isExit) {
+			}
+
+			public void emergency(String rimeID, boolean isEmergency) {
+			}
+
+			public void setupAck(String rimeID) {
+				setupAcks.add(rimeID);
+			}
+
+			public void textLine(String line) {
+				// debug output of the sensor node
+			}
+		});
+		feed(decoder);
 	}
 
 	/**
 	 * Called when network is going to be plotted on the map
 	 */
 	public void plotMap(){
-		int id = ts.tdGetDeviceId(0);
+		final int id = ts.tdGetDeviceId(0);
         int supportedMethods = Tellstick.TELLSTICK_TURNON | Tellstick.TELLSTICK_TURNOFF | Tellstick.TELLSTICK_LEARN;
-        int methods = ts.tdMethods( id, supportedMethods );
-		String line;
+        final int methods = ts.tdMethods( id, supportedMethods );
+		TelemetryDecoder decoder = new TelemetryDecoder(
+				new TelemetryDecoder.Listener() {
+			public void nodeReport(String rimeID, int x, int y,
+									boolean isOnFire, boolean isExit) {
+				SensorNode node = new SensorNode(rimeID, x, y, isOnFire, isExit);
+				if(store.report(node)){
+					System.out.println("@NODE_REPORT_PACKET:" + node);
+				}
+			}
+
+			public void emergency(String rimeID, boolean isEmergency) {
+				if(isEmergency){
+					if(store.setOnFire(rimeID, true)){
+						System.out.println("@EMERGENCY_PACKET:" + rimeID);
+					}
+					// tellstick
+					if ( (methods & Tellstick.TELLSTICK_TURNON) != 0 ) {
+						System.out.println( "The device supports tdTurnOn()");
+						ts.tdTurnOn( id );
+					}
+					// end of tellstick
+				}
+				else{
+					if(store.setOnFire(rimeID, false)){
+						System.out.println("@ANTI_EMERGENCY_PACKET:" + rimeID);
+					}
+					if ( (methods & Tellstick.TELLSTICK_TURNOFF) != 0 ) {
+						System.out.println( "The device supports tdTurnOff()");
+						ts.tdTurnOff(id);
+					}
+				}
+			}
+
+			public void setupAck(String rimeID) {
+			}
+
+			public void textLine(String line) {
+				// debug output of the sensor node
+			}
+		});
 		// send command to sensor node
     	writeSerialData("sink");
     	writeSerialData("extract_report_packet");
     	
-	    while(true) { // continuously read from the sensor node
-	    	try {
-				line = input.readLine();
-				if(line != null){ 
-		    		if(line.startsWith("@NODE_REPORT_PACKET:")){ // a.b:x.y:fire:exit
-		    			int beginIndex = line.indexOf(':');
-		    			line = line.substring(beginIndex+1);
-		    			if(!data.contains(line)){
-		    				data.addElement(line);
-		    				System.out.println("@NODE_REPORT_PACKET:" + line);
-		    			}
-		    		}
-		    		else if(line.startsWith("@EMERGENCY_PACKET:")){ // rimeID
-		    			int beginIndex = line.indexOf(':');
-		    			line = line.substring(beginIndex+1);
-		    			if(!fireData.contains(line)){
-		    				fireData.addElement(line);
-		    				System.out.println("@EMERGENCY_PACKET:" + line);
-		    			}
-						// tellstick                                              
-						if ( (methods & Tellstick.TELLSTICK_TURNON) != 0 ) {
-							System.out.println( "The device supports tdTurnOn()");
-							ts.tdTurnOn( id );                                            
-						 }                                           
-						 // end of tellstick
-		    		}
-		    		else if(line.startsWith("@ANTI_EMERGENCY_PACKET:")){ // rimeID
-		    			int beginIndex = line.indexOf(':');
-		    			line = line.substring(beginIndex+1);
-		    			String cleanLine = "clean:"+line;
-		    			if(!fireData.contains(cleanLine)){
-		    				fireData.addElement(cleanLine);
-		    				System.out.println("@ANTI_EMERGENCY_PACKET:" + line);
-		    			}
-						if ( (methods & Tellstick.TELLSTICK_TURNOFF) != 0 ) {
-							System.out.println( "The device supports tdTurnOff()");
-							ts.tdTurnOff(id);
-						}
-		    		}
-		    	}
-			} catch (IOException e) {
-				System.err.println("Cannot read from sensor node");
-				ts.tdClose();
+	    feed(decoder); // continuously read from the sensor node
+	    ts.tdClose();
+	}
+
+	/**
+	 * Feeds what the reader reads to decoder, until the serial line is
+	 * closed or this thread is interrupted
+	 */
+	private void feed(TelemetryDecoder decoder){
+		try {
+			byte[] chunk;
+			while((chunk = reader.take()) != null){
+				for(int i=0; i<chunk.length; i++){
+					decoder.feed(chunk[i] & 0xFF);
+				}
 			}
-	    }
+			System.err.println("Sensor node closed the connection");
+		} catch (InterruptedException e) {
+			// stopped
+		}
 	}
 }
@@ -0,0 +1,72 @@
+import java.io.IOException;
+import java.io.InputStream;
+import java.util.Arrays;
+import java.util.concurrent.ArrayBlockingQueue;
+import java.util.concurrent.BlockingQueue;
+
+/**
+ * Reads the serial line in its own thread and hands what it read to one
+ * consumer through a bounded queue. Both sides block instead of polling:
+ * the reader in read() until bytes arrive, or in put() while the consumer is
+ * behind, and the consumer in take() until there is something to read.
+ */
+public class SerialReader extends Thread {
+
+	/* chunks the consumer may be behind */
+	public static final int QUEUE_SIZE = 64;
+	private static final int CHUNK_SIZE = 256;
+
+	/* put after the last chunk */
+	private static final byte[] END = new byte[0];
+
+	private InputStream input;
+	private BlockingQueue<byte[]> queue;
+
+	/**
+	 * Constructor
+	 * @param input Serial line, read from start() on
+	 */
+	public SerialReader(InputStream input) {
+		super("SerialReader");
+		this.input = input;
+		this.queue = new ArrayBlockingQueue<byte[]>(QUEUE_SIZE);
+		setDaemon(true);
+	}
+
+	/**
+	 * Run method is executed when SerialReader thread is started
+	 */
+	@Override
+	public void run() {
+		byte[] buf = new byte[CHUNK_SIZE];
+		try {
+			try {
+				int n;
+				while((n = input.read(buf)) >= 0){
+					if(n > 0){
+						queue.put(Arrays.copyOf(buf, n));
+					}
+				}
+			} catch (IOException e) {
+				System.err.println("Cannot read from sensor node");
+			}
+			queue.put(END);
+		} catch (InterruptedException e) {
+			// stopped
+		}
+	}
+
+	/**
+	 * Waits for the next bytes read from the serial line
+	 * @return bytes or null when the serial line is closed
+	 * @throws InterruptedException when the consumer thread is interrupted
+	 */
+	public byte[] take() throws InterruptedException {
+		byte[] chunk = queue.take();
+		if(chunk == END){
+			queue.put(END);
+			return null;
+		}
+		return chunk;
+	}
+}
@@ -0,0 +1,182 @@
+/*
+ * Decodes the telemetry frames of the sink node (src/base/telemetry.h).
+ * Frames share the serial line with the text the node prints, so the bytes
+ * that are not part of a frame are handed on as text lines.
+ *
+ * frame: 0xA5, length, records (length bytes), crc16 high, crc16 low
+ */
+public class TelemetryDecoder {
+
+	public static final int SYNC = 0xA5;
+
+	public static final int NODE_REPORT = 1;
+	public static final int EMERGENCY = 2;
+	public static final int ANTI_EMERGENCY = 3;
+	public static final int SETUP_ACK = 4;
+
+	private static final int BURNING = 0x01;
+	private static final int EXIT_NODE = 0x02;
+
+	private static final int TEXT = 0;
+	private static final int LENGTH = 1;
+	private static final int PAYLOAD = 2;
+	private static final int CRC_HIGH = 3;
+	private static final int CRC_LOW = 4;
+
+	/**
+	 * Receives the decoded records
+	 */
+	public interface Listener {
+		/**
+		 * @param rimeID Rime ID of the reporting node, "a.b"
+		 * @param x Virtual x coordinate
+		 * @param y Virtual y coordinate
+		 * @param isOnFire Is the node on fire?
+		 * @param isExit Is the node placed on exit?
+		 */
+		void nodeReport(String rimeID, int x, int y, boolean isOnFire,
+									boolean isExit);
+
+		/**
+		 * @param rimeID Rime ID of the node, "a.b"
+		 * @param isEmergency false when the emergency is over
+		 */
+		void emergency(String rimeID, boolean isEmergency);
+
+		/**
+		 * @param rimeID Rime ID of a node that took its setup packet
+		 */
+		void setupAck(String rimeID);
+
+		/**
+		 * @param line A line of text outside of the frames
+		 */
+		void textLine(String line);
+	}
+
+	private Listener listener;
+	private int state;
+	private StringBuilder text;
+	private byte[] payload;
+	private int length;
+	private int received;
+	private int crc;
+	private int badFrames;
+
+	/**
+	 * Constructor
+	 * @param listener Gets the records of every good frame
+	 */
+	public TelemetryDecoder(Listener listener) {
+		this.listener = listener;
+		this.state = TEXT;
+		this.text = new StringBuilder();
+		this.payload = new byte[255];
+	}
+
+	/**
+	 * Number of frames dropped because of a bad CRC
+	 * @return badFrames
+	 */
+	public int getBadFrames() {
+		return badFrames;
+	}
+
+	/**
+	 * Feeds the next byte read from the serial line
+	 * @param b 0 to 255
+	 */
+	public void feed(int b) {
+		switch(state) {
+		case TEXT:
+			if(b == SYNC) {
+				state = LENGTH;
+			}
+			else if(b == '\n') {
+				listener.textLine(text.toString());
+				text.setLength(0);
+			}
+			else if(b != '\r') {
+				text.append((char) b);
+			}
+			break;
+		case LENGTH:
+			length = b;
+			received = 0;
+			crc = crc16Add(b, 0);
+			state = length == 0 ? CRC_HIGH : PAYLOAD;
+			break;
+		case PAYLOAD:
+			payload[received++] = (byte) b;
+			crc = crc16Add(b, crc);
+			if(received == length) {
+				state = CRC_HIGH;
+			}
+			break;
+		case CRC_HIGH:
+			crc ^= b << 8;
+			state = CRC_LOW;
+			break;
+		case CRC_LOW:
+			crc ^= b;
+			state = TEXT;
+			if(crc == 0) {
+				decodeRecords();
+			}
+			else {
+				badFrames++;
+			}
+			break;
+		}
+	}
+
+	/**
+	 * Calls the listener for every record of a good frame.
+	 * Stops at a record type it does not know.
+	 */
+	private void decodeRecords() {
+		int i = 0;
+		while(i < length) {
+			int type = payload[i] & 0xFF;
+			if(type == NODE_REPORT && i+8 <= length) {
+				int flags = payload[i+7] & 0xFF;
+				listener.nodeReport(rimeID(i+1), u16(i+3), u16(i+5),
+						(flags & BURNING) != 0, (flags & EXIT_NODE) != 0);
+				i += 8;
+			}
+			else if((type == EMERGENCY || type == ANTI_EMERGENCY) &&
+					i+3 <= length) {
+				listener.emergency(rimeID(i+1), type == EMERGENCY);
+				i += 3;
+			}
+			else if(type == SETUP_ACK && i+3 <= length) {
+				listener.setupAck(rimeID(i+1));
+				i += 3;
+			}
+			else {
+				System.err.println("Unknown telemetry record " + type);
+				return;
+			}
+		}
+	}
+
+	private String rimeID(int i) {
+		return (payload[i] & 0xFF) + "." + (payload[i+1] & 0xFF);
+	}
+
+	private int u16(int i) {
+		return (payload[i] & 0xFF) << 8 | (payload[i+1] & 0xFF);
+	}
+
+	/**
+	 * crc16_add() of Contiki (core/lib/crc16.c)
+	 */
+	public static int crc16Add(int b, int acc) {
+		acc ^= b & 0xFF;
+		acc = ((acc >> 8) | (acc << 8)) & 0xFFFF;
+		acc ^= ((acc & 0xFF00) << 4) & 0xFFFF;
+		acc ^= (acc >> 8) >> 4;
+		acc ^= (acc & 0xFF00) >> 5;
+		return acc;
+	}
+}
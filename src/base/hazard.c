@@ -0,0 +1,80 @@
+#include "base/hazard.h"
+
+#include "string.h"
+
+#define EWMA(avg, sample, shift) ((avg) += ((sample) - (avg)) >> (shift))
+
+void hazard_init(struct hazard *h) {
+	memset(h, 0, sizeof(struct hazard));
+}
+
+void hazard_add(struct hazard *h, enum hazard_sensor s, int16_t value) {
+	struct hazard_filter *f = &h->filters[s];
+	int32_t sample = (int32_t)value << HAZARD_FRAC;
+
+	if (!f->has_sample) {
+		f->fast = sample;
+		f->slow = sample;
+		f->has_sample = 1;
+	} else {
+		EWMA(f->fast, sample, HAZARD_FAST_SHIFT);
+		EWMA(f->slow, sample, HAZARD_SLOW_SHIFT);
+	}
+}
+
+/* SHT11 temperature in tenths of a degree C, from its 14 bit reading at 3 V */
+static int16_t sht11_to_temp(uint16_t raw) {
+	return (int16_t)(((int32_t)(raw & 0x3FFF) - 3960)/10);
+}
+
+/* SHT11 relative humidity in tenths of a percent, from its 12 bit reading */
+static int16_t sht11_to_humidity(uint16_t raw) {
+	int32_t h = raw & 0x0FFF;
+	return (int16_t)(-40 + 405*h/1000 - 28*h*h/1000000);
+}
+
+int hazard_add_reading(struct hazard *h, const struct sampler_reading *r) {
+	if (r->value == SAMPLER_FAILED) {
+		return 0;
+	}
+
+	switch (r->source) {
+		case SAMPLER_LIGHT:
+			hazard_add(h, HAZARD_LIGHT, r->value);
+			break;
+		case SAMPLER_TEMP:
+			hazard_add(h, HAZARD_TEMP, sht11_to_temp(r->value));
+			break;
+		case SAMPLER_HUMIDITY:
+			hazard_add(h, HAZARD_HUMIDITY, sht11_to_humidity(r->value));
+			break;
+		default:
+			return 0;
+	}
+	return 1;
+}
+
+/* Weighs how far x is past threshold, 0 if it is not. */
+static int32_t past(int32_t x, int32_t threshold, int32_t weight) {
+	return x > threshold ? (x - threshold)*weight : 0;
+}
+
+uint16_t hazard_metric(const struct hazard *h) {
+	int32_t metric = 0;
+
+	if (h->filters[HAZARD_LIGHT].has_sample) {
+		metric += past(hazard_level(h, HAZARD_LIGHT), 0, HAZARD_LIGHT_WEIGHT);
+	}
+	if (h->filters[HAZARD_TEMP].has_sample) {
+		metric += past(hazard_level(h, HAZARD_TEMP), HAZARD_TEMP_BASE,
+				HAZARD_TEMP_WEIGHT);
+		metric += past(hazard_rise(h, HAZARD_TEMP), HAZARD_TEMP_RISE,
+				HAZARD_TEMP_RISE_WEIGHT);
+	}
+	if (h->filters[HAZARD_HUMIDITY].has_sample) {
+		metric += past(-hazard_rise(h, HAZARD_HUMIDITY), HAZARD_HUMIDITY_FALL,
+				HAZARD_HUMIDITY_FALL_WEIGHT);
+	}
+
+	return metric < HAZARD_METRIC_MAX ? (uint16_t)metric : HAZARD_METRIC_MAX;
+}
@@ -0,0 +1,83 @@
+/* Fuses light, temperature and humidity samples into one hazard metric, in
+ * fixed point. Every sensor is smoothed by a fast and a slow EWMA: the fast
+ * one is its level and the gap between the two how quickly it rises. A lone
+ * spike only moves the fast average by a quarter of its size, so it takes
+ * readings that stay up, or keep rising, to raise the metric. */
+#ifndef _HAZARD_H_
+#define _HAZARD_H_
+
+#include "stdint.h"
+
+#include "base/sampler.h"
+
+#define HAZARD_FRAC 4 /* fraction bits of the averages */
+#define HAZARD_FAST_SHIFT 2 /* the fast average weighs a new sample 1/4 */
+#define HAZARD_SLOW_SHIFT 4 /* and the slow one 1/16 */
+
+/* For a steady ramp of r per sample the fast average ends up (2^4-2^2)*r =
+ * 12*r above the slow one, which is what the rise thresholds are in. */
+
+/* Light in raw ADC counts adds its level. */
+#define HAZARD_LIGHT_WEIGHT 1
+
+/* Temperature in tenths of a degree C adds 3 per tenth above 45 C, and 10
+ * per unit of rise past 40, about 4 C a minute at a sample per 5 s. */
+#define HAZARD_TEMP_BASE 450
+#define HAZARD_TEMP_WEIGHT 3
+#define HAZARD_TEMP_RISE 40
+#define HAZARD_TEMP_RISE_WEIGHT 10
+
+/* Relative humidity in tenths of a percent adds 2 per unit of fall past 20,
+ * about 2 % a minute, as air dries out when it heats up. */
+#define HAZARD_HUMIDITY_FALL 20
+#define HAZARD_HUMIDITY_FALL_WEIGHT 2
+
+#define HAZARD_METRIC_MAX 0x7FFF
+
+enum hazard_sensor {
+	HAZARD_LIGHT, HAZARD_TEMP, HAZARD_HUMIDITY, HAZARD_SENSORS
+};
+
+struct hazard_filter {
+	int32_t fast; /* with HAZARD_FRAC fraction bits */
+	int32_t slow;
+	uint8_t has_sample;
+};
+
+struct hazard {
+	struct hazard_filter filters[HAZARD_SENSORS];
+};
+
+void hazard_init(struct hazard *h);
+
+/* The first sample of a sensor sets both its averages, so it does not count
+ * as a rise. */
+void hazard_add(struct hazard *h, enum hazard_sensor s, int16_t value);
+
+/* Folds in a reading of the sampler, in the units above. Returns 0 if the
+ * sample failed, which is dropped. */
+int hazard_add_reading(struct hazard *h, const struct sampler_reading *r);
+
+/* The weighted levels and rises of the sensors that have been sampled,
+ * between 0 and HAZARD_METRIC_MAX. */
+uint16_t hazard_metric(const struct hazard *h);
+
+static
+int16_t hazard_level(const struct hazard *h, enum hazard_sensor s);
+
+/* Positive when the sensor is rising, negative when falling. */
+static
+int16_t hazard_rise(const struct hazard *h, enum hazard_sensor s);
+
+/************************* Inline Definitions **************************/
+
+static inline
+int16_t hazard_level(const struct hazard *h, enum hazard_sensor s) {
+	return (int16_t)(h->filters[s].fast >> HAZARD_FRAC);
+}
+
+static inline
+int16_t hazard_rise(const struct hazard *h, enum hazard_sensor s) {
+	return (int16_t)((h->filters[s].fast - h->filters[s].slow) >> HAZARD_FRAC);
+}
+#endif
@@ -1,80 +1,118 @@
 #include "base/queue_buffer.h"
 
-
-#include "emergency_net/neighbor_node.h"
-
 #include "base/log.h"
 
 #define ITEM(qb, item_nr) ((struct queue_buffer_s*) \
 		(((char*)(qb)->buffer_begin) + \
 		 (item_nr)*((qb)->buffer_size+QUEUE_BUFFER_S_HDR_SIZE)))
 
-static void add_tail(struct queue_buffer_s **head, struct queue_buffer_s *b){
+#define ITEM_FROM_DATA(ptr) ((struct queue_buffer_s*) \
+		(((char*)(ptr)) - offsetof(struct queue_buffer_s, data)))
+
+static void add_tail(struct queue_buffer *qb, struct queue_buffer_s *b) {
 	b->next = NULL;
+	b->prev = qb->used_tail;
+
+	if (qb->used_tail != NULL) {
+		qb->used_tail->next = b;
+	} else {
+		qb->used_head = b;
+	}
+	qb->used_tail = b;
+}
 
-	if (*head != NULL) {
-		struct queue_buffer_s *iter = *head;
-		while (iter->next != NULL)
-			iter = iter->next;
-		iter->next = b;
+static void add_head(struct queue_buffer *qb, struct queue_buffer_s *b) {
+	b->next = qb->used_head;
+	b->prev = NULL;
+
+	if (qb->used_head != NULL) {
+		qb->used_head->prev = b;
 	} else {
-		*head = b;
+		qb->used_tail = b;
 	}
+	qb->used_head = b;
 }
 
-inline
-static void add_head(struct queue_buffer_s **head, struct queue_buffer_s *new_head) {
-	new_head->next = *head;
-	*head = new_head;
+static void unlink_used(struct queue_buffer *qb, struct queue_buffer_s *b) {
+	if (b->prev != NULL) {
+		b->prev->next = b->next;
+	} else {
+		qb->used_head = b->next;
+	}
+
+	if (b->next != NULL) {
+		b->next->prev = b->prev;
+	} else {
+		qb->used_tail = b->prev;
+	}
+}
+
+static inline
+void add_unused(struct queue_buffer *qb, struct queue_buffer_s *b) {
+	b->next = qb->unused_head;
+	qb->unused_head = b;
+}
+
+static inline
+struct queue_buffer_s* take_unused(struct queue_buffer *qb) {
+	struct queue_buffer_s *buf = qb->unused_head;
+	if (buf != NULL) {
+		qb->unused_head = buf->next;
+	}
+	return buf;
+}
+
+static inline
+void release(struct queue_buffer *qb, struct queue_buffer_s *b) {
+	unlink_used(qb, b);
+	add_unused(qb, b);
+	--qb->queue_size;
 }
 
 static struct queue_buffer_s* allocate_buffer_space_back(struct queue_buffer *qb) {
-	if (qb->unused_head != NULL) {
-		struct queue_buffer_s *buf = qb->unused_head;
-		qb->unused_head = qb->unused_head->next;
-		add_tail(&qb->used_head, buf);
-		return buf;
+	struct queue_buffer_s *buf = take_unused(qb);
+	if (buf != NULL) {
+		add_tail(qb, buf);
+		++qb->queue_size;
 	}
 
-	return NULL;
+	return buf;
 }
 
 static struct queue_buffer_s* allocate_buffer_space_front(struct queue_buffer *qb) {
-	if (qb->unused_head != NULL) {
-		struct queue_buffer_s *buf = qb->unused_head;
-		qb->unused_head = qb->unused_head->next;
-		add_head(&qb->used_head, buf);
-		return buf;
+	struct queue_buffer_s *buf = take_unused(qb);
+	if (buf != NULL) {
+		add_head(qb, buf);
+		++qb->queue_size;
 	}
 
-	return NULL;
+	return buf;
 }
 
 
-void queue_buffer_init(struct queue_buffer *qb, uint8_t buffer_size, uint8_t
+void queue_buffer_init(struct queue_buffer *qb, uint16_t buffer_size, uint8_t
 		num_items, void *buffer_begin) {
 
 	int i;
-	struct queue_buffer_s *b;
 
 	qb->queue_size = 0;
 	qb->queue_max_size = num_items;
 	qb->buffer_size = buffer_size;
 	qb->buffer_begin = buffer_begin;
 
+	/* unused list in buffer order */
 	qb->unused_head = NULL;
-	for(i = 0; i < qb->queue_max_size; ++i) {
-		b = ITEM(qb, i);
-		add_tail(&qb->unused_head, b);
+	for(i = qb->queue_max_size-1; i >= 0; --i) {
+		add_unused(qb, ITEM(qb, i));
 	}
 	qb->used_head = NULL;
+	qb->used_tail = NULL;
 	qb->iterator = NULL;
 }
 
 void* queue_buffer_alloc_back(struct queue_buffer* qb) {
 	struct queue_buffer_s *b = allocate_buffer_space_back(qb);
 	if (b != NULL) {
-		++qb->queue_size;
 		return b->data;
 	}
 
@@ -84,7 +122,6 @@ void* queue_buffer_alloc_back(struct queue_buffer* qb) {
 void* queue_buffer_alloc_front(struct queue_buffer* qb) {
 	struct queue_buffer_s *b = allocate_buffer_space_front(qb);
 	if (b != NULL) {
-		++qb->queue_size;
 		return b->data;
 	}
 
@@ -94,13 +131,9 @@ void* queue_buffer_alloc_front(struct queue_buffer* qb) {
 void* queue_buffer_push_front(struct queue_buffer *qb, const void *item) {
 
 	struct queue_buffer_s *b = allocate_buffer_space_front(qb);
-	//LOG("push front: %x\n", b);
-	//TRACE("metric: %u\n", ((struct neighbor_node*)item)->bp.metric);
 	if (b != NULL) {
-		++qb->queue_size;
 		memcpy(b->data, item, qb->buffer_size);
 		ASSERT(memcmp(item, b->data, qb->buffer_size) == 0);
-		//TRACE("metric: %u\n", ((struct neighbor_node*)b->data)->bp.metric);
 		return b->data;
 	}
 
@@ -111,7 +144,6 @@ void* queue_buffer_push_back(struct queue_buffer* qb, const void *item) {
 
 	struct queue_buffer_s *b = allocate_buffer_space_back(qb);
 	if (b != NULL) {
-		++qb->queue_size;
 		memcpy(b->data, item, qb->buffer_size);
 		return b->data;
 	}
@@ -127,56 +159,47 @@ void queue_buffer_pop_front(struct queue_buffer* qb, void* item_out) {
 		memcpy(item_out, i->data, qb->buffer_size);
 	}
 
-	qb->used_head = i->next;
-	add_head(&qb->unused_head, i);
-	--qb->queue_size;
+	release(qb, i);
 }
 
 void queue_buffer_pop_back(struct queue_buffer* qb, void* item_out) {
-	struct queue_buffer_s *i = qb->used_head;
-	struct queue_buffer_s *prev = NULL;
-
+	struct queue_buffer_s *i = qb->used_tail;
 	ASSERT(i != NULL);
 
-	while (i->next != NULL) {
-		prev = i;
-		i = i->next;
-	}
-
 	if (item_out != NULL) {
 		memcpy(item_out, i->data, qb->buffer_size);
 	}
 
-	add_head(&qb->unused_head, i);
-	if (prev != NULL) {
-		prev->next = NULL;
-	} else {
-		qb->used_head = NULL;
+	release(qb, i);
+}
+
+void* queue_buffer_front(struct queue_buffer* qb) {
+	if (qb->used_head != NULL) {
+		return qb->used_head->data;
 	}
-	--qb->queue_size;
+
+	return NULL;
 }
 
+void* queue_buffer_back(struct queue_buffer* qb) {
+	if (qb->used_tail != NULL) {
+		return qb->used_tail->data;
+	}
+
+	return NULL;
+}
 
 void queue_buffer_free(struct queue_buffer* qb, void* item) {
-	struct queue_buffer_s *prev = NULL;
-	struct queue_buffer_s *i = qb->used_head;
-	
-	for(; i != NULL; i = i->next) {
-		if ( i->data == item ){
-			if (prev == NULL) {
-				qb->used_head = qb->used_head->next;
-			} else {
-				prev->next = i->next;
-			}
-			add_head(&qb->unused_head, i);
-			--qb->queue_size;
-			return;
-		} 
-		prev = i;
-	}
+	struct queue_buffer_s *i = ITEM_FROM_DATA(item);
 
-	/* should never happen */
-	ASSERT(0);
+	/* item has to be one of our slots */
+	ASSERT((char*)i >= (char*)qb->buffer_begin && (char*)i <
+			(char*)ITEM(qb, qb->queue_max_size));
+	ASSERT(((char*)i - (char*)qb->buffer_begin) %
+			(qb->buffer_size+QUEUE_BUFFER_S_HDR_SIZE) == 0);
+	ASSERT(qb->queue_size > 0);
+
+	release(qb, i);
 }
 
 void* queue_buffer_find(struct queue_buffer* qb, const void *item, 
@@ -195,16 +218,11 @@ void* queue_buffer_find(struct queue_buffer* qb, const void *item,
 void queue_buffer_clear(struct queue_buffer *qb) {
 	qb->queue_size = 0;
 	if (qb->used_head != NULL) {
-		struct queue_buffer_s *s = qb->unused_head;
-		if(s != NULL) {
-			for (; s->next != NULL; s = s->next);
-
-			s->next = qb->used_head;
-		} else {
-			qb->unused_head = qb->used_head;
-		}
+		qb->used_tail->next = qb->unused_head;
+		qb->unused_head = qb->used_head;
 
 		qb->used_head = NULL;
+		qb->used_tail = NULL;
 	}
 	qb->iterator = NULL;
 }
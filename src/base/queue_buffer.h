@@ -15,29 +15,31 @@
 #define QUEUE_BUFFER_INIT_WITH_STRUCT(s, name, buffersize, num_items) \
 	queue_buffer_init(&(s)->name, buffersize, num_items, (s)->name##_buffer)
 
+/* The used list is doubly linked and has a tail pointer so that every
+ * operation except find is constant time. The unused list only uses next. */
 struct queue_buffer_s {
 	struct queue_buffer_s *next;
+	struct queue_buffer_s *prev;
 	uint8_t data[1];
 };
 
 struct queue_buffer {
 	uint8_t queue_size;
 	uint8_t queue_max_size;
-	uint8_t buffer_size;
+	uint16_t buffer_size; /* 16 bit: buffered_packet outgrows 255 on hosts */
 	void *buffer_begin;
 	struct queue_buffer_s *unused_head;
 	struct queue_buffer_s *used_head;
+	struct queue_buffer_s *used_tail;
 	struct queue_buffer_s *iterator;
 };
 
-void queue_buffer_init(struct queue_buffer *qb, uint8_t buffer_size, uint8_t
+void queue_buffer_init(struct queue_buffer *qb, uint16_t buffer_size, uint8_t
 		num_items, void *buffer_begin);
 
-/** (alloc_front is faster) */
 void* queue_buffer_alloc_front(struct queue_buffer *qb);
 void* queue_buffer_alloc_back(struct queue_buffer *qb);
 
-/** (push_front is faster) */
 void* queue_buffer_push_front(struct queue_buffer *qb, const void *item);
 void* queue_buffer_push_back(struct queue_buffer *qb, const void *item);
 
@@ -47,8 +49,6 @@ void* queue_buffer_push_back(struct queue_buffer *qb, const void *item);
  *
  * Dont call these functions unless you have something to pop (e.g. dont call
  * if queue buffer is empty). Null pointer dereference will burn your ass then.
- *
- * (pop_front is faster)
  */
 void queue_buffer_pop_front(struct queue_buffer* qb, void *item_out);
 void queue_buffer_pop_back(struct queue_buffer* qb, void *item_out);
@@ -80,6 +80,7 @@ int queue_buffer_max_size(const struct queue_buffer *qb);
 static
 void queue_buffer_copy(struct queue_buffer *to, const struct queue_buffer *from);
 
+/* item must be a pointer returned by alloc/push/find/iteration of qb. */
 void queue_buffer_free(struct queue_buffer *qb, void* item);
 
 void queue_buffer_clear(struct queue_buffer *qb);
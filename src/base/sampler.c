@@ -0,0 +1,69 @@
+#include "base/sampler.h"
+
+#include "base/log.h"
+
+PROCESS(sampler_process, "Sampler");
+
+process_event_t sampler_event;
+
+static struct process *requester; /* NULL when idle */
+static enum sampler_source source;
+static volatile uint8_t is_started;
+static volatile uint8_t is_done;
+static volatile uint16_t value;
+static struct sampler_reading reading;
+
+void sampler_init(void) {
+	sampler_event = process_alloc_event();
+	requester = NULL;
+	sampler_arch_init();
+	process_start(&sampler_process, NULL);
+}
+
+int sampler_start(enum sampler_source s) {
+	ASSERT(s < SAMPLER_SOURCES);
+	if (requester != NULL) {
+		return 0;
+	}
+
+	requester = PROCESS_CURRENT();
+	source = s;
+	is_started = 0;
+	is_done = 0;
+	/* started from our own process, so the caller never waits on a sensor */
+	process_poll(&sampler_process);
+	return 1;
+}
+
+int sampler_busy(void) {
+	return requester != NULL;
+}
+
+void sampler_done(uint16_t v) {
+	value = v;
+	is_done = 1;
+	process_poll(&sampler_process);
+}
+
+PROCESS_THREAD(sampler_process, ev, data) {
+	PROCESS_BEGIN();
+
+	while(1) {
+		PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+
+		if (requester != NULL && !is_started) {
+			is_started = 1;
+			sampler_arch_start(source);
+		}
+
+		if (requester != NULL && is_done) {
+			struct process *p = requester;
+			reading.source = source;
+			reading.value = value;
+			requester = NULL;
+			process_post(p, sampler_event, &reading);
+		}
+	}
+
+	PROCESS_END();
+}
@@ -0,0 +1,42 @@
+/* Samples sensors without waiting on them: sampler_start() only asks for a
+ * sample and returns, and the reading is posted to the asking process as a
+ * sampler_event once the conversion is done. Only one sample is taken at a
+ * time. The platform part is in sampler_sky.c on the mote and in
+ * sim/sampler_mock.c on the host. */
+#ifndef _SAMPLER_H_
+#define _SAMPLER_H_
+
+#include "contiki.h"
+
+enum sampler_source {
+	SAMPLER_LIGHT, /* photosynthetic light, raw ADC counts */
+	SAMPLER_TEMP, /* raw SHT11 temperature */
+	SAMPLER_HUMIDITY, /* raw SHT11 relative humidity */
+	SAMPLER_SOURCES
+};
+
+/* the value of a sample the sensor failed to take */
+#define SAMPLER_FAILED 0xFFFF
+
+struct sampler_reading {
+	enum sampler_source source;
+	uint16_t value; /* or SAMPLER_FAILED */
+};
+
+/* data points to a struct sampler_reading, valid until the next one */
+extern process_event_t sampler_event;
+
+void sampler_init(void);
+
+/* Returns 0 if a sample is being taken already. */
+int sampler_start(enum sampler_source source);
+
+int sampler_busy(void);
+
+/* Platform part. sampler_arch_start() starts a conversion and calls
+ * sampler_done() with the result, which may be from an interrupt. */
+void sampler_arch_init(void);
+void sampler_arch_start(enum sampler_source source);
+void sampler_done(uint16_t value);
+
+#endif
@@ -0,0 +1,235 @@
+/* Tmote Sky part of the sampler. Light is one ADC12 conversion of the
+ * photodiode on P6.4, read in the conversion done interrupt. The ADC is
+ * configured here, so it must not be shared with the Contiki sensor drivers
+ * that use it (light, battery, acc).
+ *
+ * Temperature and humidity are measured by the SHT11, which takes up to a few
+ * hundred ms and pulls its DATA line (P1.5) low when done. Its Contiki driver
+ * spins on the line for that long, so the measurement is run here instead:
+ * the command is sent, and the line is checked once a clock tick until it
+ * goes low. The port 1 interrupt belongs to the CC2420 driver, so the line is
+ * polled rather than interrupt driven. The driver is only used to power the
+ * SHT11 up. */
+#include <io.h>
+#include <signal.h>
+
+#include "sys/energest.h"
+#include "net/rime/ctimer.h"
+#include "dev/sht11-sensor.h"
+#include "sht11-arch.h"
+
+#include "base/sampler.h"
+
+#define LIGHT_PIN 0x10 /* P6.4 */
+
+#define SDA_0() (SHT11_PxDIR |= BV(SHT11_ARCH_SDA)) /* output 0 */
+#define SDA_1() (SHT11_PxDIR &= ~BV(SHT11_ARCH_SDA)) /* input, pulled up */
+#define SDA_IS_1 (SHT11_PxIN & BV(SHT11_ARCH_SDA))
+#define SCL_0() (SHT11_PxOUT &= ~BV(SHT11_ARCH_SCL))
+#define SCL_1() (SHT11_PxOUT |= BV(SHT11_ARCH_SCL))
+#define delay_400ns() _NOP()
+
+#define MEASURE_TEMP 0x03
+#define MEASURE_HUMI 0x05
+
+/* a 14 bit temperature takes 320 ms at most */
+#define SHT11_TIMEOUT (CLOCK_SECOND/2)
+
+static struct ctimer sht11_timer;
+static uint8_t sht11_cmd;
+static clock_time_t sht11_started;
+
+void sampler_arch_init(void) {
+	SENSORS_ACTIVATE(sht11_sensor);
+}
+
+static void
+start_light_conversion(void) {
+	P6SEL |= LIGHT_PIN;
+	/* single conversion of one channel, 64 ADC clocks of sampling */
+	ADC12CTL0 = SHT0_4 | ADC12ON;
+	ADC12CTL1 = SHP | CONSEQ_0 | CSTARTADD_0;
+	ADC12MCTL0 = INCH_4 | SREF_0 | EOS;
+	ADC12IE = 0x01;
+	ADC12CTL0 |= ENC | ADC12SC;
+}
+
+/* The SHT11 bus, as in core/dev/sht11.c, each call takes a few us. */
+static void
+sht11_start(void) {
+	SDA_1(); SCL_0();
+	delay_400ns();
+	SCL_1();
+	delay_400ns();
+	SDA_0();
+	delay_400ns();
+	SCL_0();
+	delay_400ns();
+	SCL_1();
+	delay_400ns();
+	SDA_1();
+	delay_400ns();
+	SCL_0();
+}
+
+static void
+sht11_reset(void) {
+	uint8_t i;
+	SDA_1();
+	SCL_0();
+	for (i = 0; i < 9; ++i) {
+		SCL_1();
+		delay_400ns();
+		SCL_0();
+	}
+	sht11_start();
+}
+
+/* Returns 1 if the SHT11 acked. */
+static int
+sht11_write(uint8_t c) {
+	uint8_t i;
+	int ack;
+
+	for (i = 0; i < 8; ++i, c <<= 1) {
+		if (c & 0x80) {
+			SDA_1();
+		} else {
+			SDA_0();
+		}
+		SCL_1();
+		delay_400ns();
+		SCL_0();
+	}
+
+	SDA_1();
+	SCL_1();
+	delay_400ns();
+	ack = !SDA_IS_1;
+	SCL_0();
+	return ack;
+}
+
+static uint8_t
+sht11_read(int send_ack) {
+	uint8_t i;
+	uint8_t c = 0;
+
+	SDA_1();
+	for (i = 0; i < 8; ++i) {
+		c <<= 1;
+		SCL_1();
+		delay_400ns();
+		if (SDA_IS_1) {
+			c |= 0x01;
+		}
+		SCL_0();
+	}
+
+	if (send_ack) {
+		SDA_0();
+	}
+	SCL_1();
+	delay_400ns();
+	SCL_0();
+	SDA_1();
+	return c;
+}
+
+/* CRC-8 x^8+x^5+x^4+1 of the SHT11, which sends it bit reversed */
+static uint8_t
+sht11_crc8_add(uint8_t acc, uint8_t byte) {
+	uint8_t i;
+	acc ^= byte;
+	for (i = 0; i < 8; ++i) {
+		acc = acc & 0x80 ? (acc << 1) ^ 0x31 : acc << 1;
+	}
+	return acc;
+}
+
+static uint8_t
+rev8bits(uint8_t v) {
+	uint8_t r = 0;
+	uint8_t i;
+	for (i = 0; i < 8; ++i, v >>= 1) {
+		r = r << 1 | (v & 0x01);
+	}
+	return r;
+}
+
+static void
+sht11_fail(void) {
+	sht11_reset();
+	sampler_done(SAMPLER_FAILED);
+}
+
+/* Reads the measurement once the SHT11 has pulled DATA low. */
+static void
+sht11_poll(void *ptr) {
+	uint8_t t0, t1, crc;
+
+	if (SDA_IS_1) {
+		if ((clock_time_t)(clock_time() - sht11_started) > SHT11_TIMEOUT) {
+			sht11_fail();
+		} else {
+			ctimer_reset(&sht11_timer);
+		}
+		return;
+	}
+
+	t0 = sht11_read(1);
+	t1 = sht11_read(1);
+	crc = sht11_read(0);
+	if (sht11_crc8_add(sht11_crc8_add(sht11_crc8_add(0, sht11_cmd), t0), t1)
+			!= rev8bits(crc)) {
+		sht11_fail();
+		return;
+	}
+	sampler_done((uint16_t)t0 << 8 | t1);
+}
+
+static void
+start_sht11_measurement(uint8_t cmd) {
+	sht11_cmd = cmd;
+	sht11_start();
+	if (!sht11_write(cmd)) {
+		sht11_fail();
+		return;
+	}
+	sht11_started = clock_time();
+	ctimer_set(&sht11_timer, 1, sht11_poll, NULL);
+}
+
+void sampler_arch_start(enum sampler_source source) {
+	switch (source) {
+		case SAMPLER_LIGHT:
+			start_light_conversion();
+			break;
+		case SAMPLER_TEMP:
+			start_sht11_measurement(MEASURE_TEMP);
+			break;
+		case SAMPLER_HUMIDITY:
+			start_sht11_measurement(MEASURE_HUMI);
+			break;
+		default:
+			break;
+	}
+}
+
+interrupt(ADC12_VECTOR)
+adc12_interrupt(void)
+{
+	uint16_t v;
+	ENERGEST_ON(ENERGEST_TYPE_IRQ);
+
+	v = ADC12MEM0; /* clears the interrupt flag */
+	ADC12IE = 0;
+	ADC12CTL0 &= ~ENC;
+	ADC12CTL0 = 0;
+	P6SEL &= ~LIGHT_PIN;
+
+	sampler_done(v);
+	LPM4_EXIT;
+
+	ENERGEST_OFF(ENERGEST_TYPE_IRQ);
+}
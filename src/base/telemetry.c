@@ -0,0 +1,89 @@
+#include "base/telemetry.h"
+
+#include "net/rime/ctimer.h"
+#include "lib/crc16.h"
+
+#include "string.h"
+
+#include "base/log.h"
+
+static void add_record(const uint8_t *record, uint8_t len);
+static void flush_timeout(void *ptr);
+
+static void (*write_frame)(const uint8_t *frame, uint8_t len);
+static uint8_t frame[TELEMETRY_FRAME_SIZE];
+static uint8_t payload_len;
+static struct ctimer flush_timer;
+
+void telemetry_init(void (*write)(const uint8_t *frame, uint8_t len)) {
+	write_frame = write;
+	payload_len = 0;
+	ctimer_stop(&flush_timer);
+}
+
+void telemetry_node_report(const rimeaddr_t *addr, uint16_t x, uint16_t y,
+		uint8_t is_burning, uint8_t is_exit_node) {
+	uint8_t r[8];
+	r[0] = TELEMETRY_NODE_REPORT;
+	r[1] = addr->u8[0];
+	r[2] = addr->u8[1];
+	r[3] = x >> 8;
+	r[4] = x;
+	r[5] = y >> 8;
+	r[6] = y;
+	r[7] = (is_burning ? TELEMETRY_BURNING : 0) |
+		(is_exit_node ? TELEMETRY_EXIT_NODE : 0);
+	add_record(r, sizeof(r));
+}
+
+void telemetry_emergency(const rimeaddr_t *addr, uint8_t is_emergency) {
+	uint8_t r[3];
+	r[0] = is_emergency ? TELEMETRY_EMERGENCY : TELEMETRY_ANTI_EMERGENCY;
+	r[1] = addr->u8[0];
+	r[2] = addr->u8[1];
+	add_record(r, sizeof(r));
+}
+
+void telemetry_setup_ack(const rimeaddr_t *addr) {
+	uint8_t r[3];
+	r[0] = TELEMETRY_SETUP_ACK;
+	r[1] = addr->u8[0];
+	r[2] = addr->u8[1];
+	add_record(r, sizeof(r));
+}
+
+void telemetry_flush(void) {
+	uint16_t crc;
+	ctimer_stop(&flush_timer);
+	if (payload_len == 0) {
+		return;
+	}
+
+	frame[0] = TELEMETRY_SYNC;
+	frame[1] = payload_len;
+	crc = crc16_data(frame+1, 1+payload_len, 0);
+	frame[2+payload_len] = crc >> 8;
+	frame[2+payload_len+1] = crc;
+	if (write_frame != NULL) {
+		write_frame(frame, 2+payload_len+2);
+	}
+	payload_len = 0;
+}
+
+/*** Inline Definitions ***/
+
+static void add_record(const uint8_t *record, uint8_t len) {
+	ASSERT(len <= TELEMETRY_MAX_PAYLOAD);
+	if (payload_len+len > TELEMETRY_MAX_PAYLOAD) {
+		telemetry_flush();
+	}
+	if (payload_len == 0) {
+		ctimer_set(&flush_timer, TELEMETRY_FLUSH_DELAY, flush_timeout, NULL);
+	}
+	memcpy(frame+2+payload_len, record, len);
+	payload_len += len;
+}
+
+static void flush_timeout(void *ptr) {
+	telemetry_flush();
+}
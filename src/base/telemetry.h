@@ -0,0 +1,61 @@
+/* Sink to GUI telemetry. Reports are packed as records into frames which are
+ * written to the serial line a batch at a time, instead of one text line per
+ * report:
+ *
+ *   TELEMETRY_SYNC, length, records (length bytes), crc16 high, crc16 low
+ *
+ * The crc16 is the Contiki one (lib/crc16.h) over the length and the
+ * records. All numbers are big endian. The sync byte is not ASCII, so frames
+ * can share the serial line with the LOG text. A record is a type byte
+ * followed by:
+ *
+ *   TELEMETRY_NODE_REPORT     addr(2) x(2) y(2) flags(1)
+ *   TELEMETRY_EMERGENCY       addr(2)
+ *   TELEMETRY_ANTI_EMERGENCY  addr(2)
+ *   TELEMETRY_SETUP_ACK       addr(2)
+ *
+ * GUI/TelemetryDecoder.java reads them. */
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include "contiki.h"
+#include "net/rime/rimeaddr.h"
+
+#define TELEMETRY_SYNC 0xA5
+
+/* bytes of records per frame, at most */
+#ifndef TELEMETRY_MAX_PAYLOAD
+#define TELEMETRY_MAX_PAYLOAD 64
+#endif
+#define TELEMETRY_FRAME_SIZE (2+TELEMETRY_MAX_PAYLOAD+2)
+
+/* a frame is written this long after its first record at the latest */
+#ifndef TELEMETRY_FLUSH_DELAY
+#define TELEMETRY_FLUSH_DELAY (CLOCK_SECOND/8)
+#endif
+
+enum telemetry_type {
+	TELEMETRY_NODE_REPORT = 1,
+	TELEMETRY_EMERGENCY = 2,
+	TELEMETRY_ANTI_EMERGENCY = 3,
+	TELEMETRY_SETUP_ACK = 4
+};
+
+#define TELEMETRY_BURNING 0x01
+#define TELEMETRY_EXIT_NODE 0x02
+
+/* write gets whole frames. */
+void telemetry_init(void (*write)(const uint8_t *frame, uint8_t len));
+
+void telemetry_node_report(const rimeaddr_t *addr, uint16_t x, uint16_t y,
+		uint8_t is_burning, uint8_t is_exit_node);
+
+void telemetry_emergency(const rimeaddr_t *addr, uint8_t is_emergency);
+
+/* addr has taken the setup packet of bulk commissioning. */
+void telemetry_setup_ack(const rimeaddr_t *addr);
+
+/* Writes the records added so far, if any. */
+void telemetry_flush(void);
+
+#endif
@@ -0,0 +1,61 @@
+#include "base/trace.h"
+
+#include "contiki.h"
+
+#include "stdio.h"
+
+#define MASK (TRACE_BUFFER_SIZE-1)
+
+static struct trace_event ring[TRACE_BUFFER_SIZE];
+static uint8_t head; /* oldest */
+static uint8_t size;
+static uint8_t lost;
+
+void trace_event(uint8_t id, uint8_t a, uint16_t b, uint16_t c) {
+	struct trace_event *e;
+	if (size == TRACE_BUFFER_SIZE) {
+		if (lost < 0xFF) {
+			++lost;
+		}
+		return;
+	}
+
+	e = &ring[(head+size) & MASK];
+	e->id = id;
+	e->a = a;
+	e->time = (uint16_t)clock_time();
+	e->b = b;
+	e->c = c;
+	++size;
+}
+
+int trace_read(struct trace_event *e) {
+	if (size > 0) {
+		*e = ring[head];
+		head = (head+1) & MASK;
+		--size;
+		return 1;
+	}
+
+	/* once the events from before the loss are out */
+	if (lost > 0) {
+		e->id = TRACE_LOST;
+		e->a = lost;
+		e->time = (uint16_t)clock_time();
+		e->b = 0;
+		e->c = 0;
+		lost = 0;
+		return 1;
+	}
+
+	return 0;
+}
+
+void trace_drain(uint8_t max) {
+	struct trace_event e;
+	char line[TRACE_LINE_SIZE];
+	for (; max > 0 && trace_read(&e); --max) {
+		trace_format(&e, line);
+		puts(line);
+	}
+}
@@ -0,0 +1,61 @@
+/* Binary event tracer. TRACE_EVENT() stores an event id, the time and three
+ * small arguments in a ring buffer in RAM, which takes a few instructions
+ * where a printf would block on the UART for milliseconds. trace_drain()
+ * prints buffered events later as short hex lines, which
+ * src/sim/trace_decode turns back into text with the formats of
+ * trace_events.h.
+ *
+ * Events are recorded with TEAMLK_TRACE defined, else TRACE_EVENT() is
+ * empty. Not to be used from interrupts. */
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include "stdint.h"
+
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE 32 /* events, a power of two */
+#endif
+
+/* "#T" and 16 hex digits */
+#define TRACE_LINE_SIZE (2+2*8+1)
+
+/* a rimeaddr_t as a trace argument */
+#define TRACE_ADDR(addr) ((uint16_t)((addr)->u8[0] << 8 | (addr)->u8[1]))
+
+enum trace_id {
+#define TRACE_EV(id, format) id,
+#include "base/trace_events.h"
+#undef TRACE_EV
+	TRACE_EVENTS
+};
+
+struct trace_event {
+	uint8_t id;
+	uint8_t a;
+	uint16_t time; /* clock_time(), wraps */
+	uint16_t b;
+	uint16_t c;
+};
+
+#ifdef TEAMLK_TRACE
+#define TRACE_EVENT(id, a, b, c) trace_event((id), (a), (b), (c))
+#else
+#define TRACE_EVENT(id, a, b, c)
+#endif
+
+/* Events that do not fit are counted and reported by a TRACE_LOST event. */
+void trace_event(uint8_t id, uint8_t a, uint16_t b, uint16_t c);
+
+/* Takes the oldest event. Returns 0 if there is none. */
+int trace_read(struct trace_event *e);
+
+/* Prints up to max events. */
+void trace_drain(uint8_t max);
+
+/* e as a line, without the line end, into line of TRACE_LINE_SIZE. */
+void trace_format(const struct trace_event *e, char *line);
+
+/* Returns 0 if line is not a trace line. */
+int trace_parse(const char *line, struct trace_event *e);
+
+#endif
@@ -0,0 +1,15 @@
+/* The trace events, as TRACE_EV(id, format). The format is given a, the high
+ * and low byte of b, and c, in that order, and may use only the first few.
+ * Ids are numbered in order, so new events go last. */
+TRACE_EV(TRACE_LOST, "trace: %u events lost")
+TRACE_EV(TRACE_EC_SEND, "ec send: type %u, o: %u.%u, seqno: %u")
+TRACE_EV(TRACE_EC_BUSY, "ec busy: type %u")
+TRACE_EV(TRACE_EC_GIVE_UP, "ec give up: type %u, o: %u.%u, seqno: %u")
+TRACE_EV(TRACE_EC_DROP, "ec drop, queue full: type %u")
+TRACE_EV(TRACE_EC_RECV, "ec recv: flags %02x, o: %u.%u, seqno: %u")
+TRACE_EV(TRACE_EC_DUPE, "ec dupe: flags %02x, o: %u.%u, seqno: %u")
+TRACE_EV(TRACE_EC_OVERFLOW, "ec overflow: flags %02x, o: %u.%u, seqno: %u")
+TRACE_EV(TRACE_EC_ACK, "ec ack: type %u, s: %u.%u, seqno: %u")
+TRACE_EV(TRACE_EC_FORWARD, "ec forward: type %u, o: %u.%u, seqno: %u")
+TRACE_EV(TRACE_EC_TRICKLE_SUPPRESS, "ec trickle suppressed: heard %u")
+TRACE_EV(TRACE_BEST_NEIGHBOR, "best neighbor: points to us %u, %u.%u, metric %u")
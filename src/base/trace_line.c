@@ -0,0 +1,65 @@
+/* The line format of trace events, shared by the mote and the host decoder:
+ * "#T" and the id, a, time, b and c as big endian hex. */
+#include "base/trace.h"
+
+static const char hex[] = "0123456789abcdef";
+
+static char* put_byte(char *p, uint8_t v) {
+	*p++ = hex[v >> 4];
+	*p++ = hex[v & 0x0F];
+	return p;
+}
+
+static int get_nibble(char ch) {
+	if (ch >= '0' && ch <= '9') {
+		return ch - '0';
+	}
+	if (ch >= 'a' && ch <= 'f') {
+		return ch - 'a' + 10;
+	}
+	return -1;
+}
+
+/* Returns -1 if line does not start with two hex digits. */
+static int get_byte(const char *line) {
+	int hi = get_nibble(line[0]);
+	int lo = hi < 0 ? -1 : get_nibble(line[1]);
+	return lo < 0 ? -1 : hi << 4 | lo;
+}
+
+void trace_format(const struct trace_event *e, char *line) {
+	char *p = line;
+	*p++ = '#';
+	*p++ = 'T';
+	p = put_byte(p, e->id);
+	p = put_byte(p, e->a);
+	p = put_byte(p, e->time >> 8);
+	p = put_byte(p, e->time & 0xFF);
+	p = put_byte(p, e->b >> 8);
+	p = put_byte(p, e->b & 0xFF);
+	p = put_byte(p, e->c >> 8);
+	p = put_byte(p, e->c & 0xFF);
+	*p = '\0';
+}
+
+int trace_parse(const char *line, struct trace_event *e) {
+	int v[8];
+	int i;
+
+	if (line[0] != '#' || line[1] != 'T') {
+		return 0;
+	}
+	for (i = 0; i < 8; ++i) {
+		v[i] = get_byte(line+2+2*i);
+		if (v[i] < 0) {
+			return 0;
+		}
+	}
+
+	e->id = v[0];
+	e->a = v[1];
+	e->time = v[2] << 8 | v[3];
+	e->b = v[4] << 8 | v[5];
+	e->c = v[6] << 8 | v[7];
+	return 1;
+}
@@ -0,0 +1,43 @@
+/* Test harness of the *_unittest.c files. UNITTEST(name, fn) makes fn a test
+ * which runs on the mote every time anything is typed on the serial line, or
+ * once on the host, where the tests are built with UNITTEST_HOST defined:
+ *
+ * make -C src/sim check
+ *
+ * Tests check with ASSERT, and print "TEST OK" when fn returns. */
+#ifndef _UNITTEST_H_
+#define _UNITTEST_H_
+
+#include "contiki.h"
+
+#ifndef UNITTEST_HOST
+#include "dev/serial-line.h"
+#endif
+
+#include "base/log.h"
+
+#ifdef UNITTEST_HOST
+#define UNITTEST(name, fn) \
+	int main(void) { \
+		fn(); \
+		LOG("TEST OK\n"); \
+		return 0; \
+	}
+#else
+#define UNITTEST(name, fn) \
+	PROCESS(test_process, name); \
+	AUTOSTART_PROCESSES(&test_process); \
+	PROCESS_THREAD(test_process, ev, data) { \
+		PROCESS_BEGIN(); \
+		while(1) { \
+			PROCESS_WAIT_EVENT(); \
+			if (ev == serial_line_event_message && data != NULL) { \
+				fn(); \
+				LOG("TEST OK\n"); \
+			} \
+		} \
+		PROCESS_END(); \
+	}
+#endif
+
+#endif
@@ -1,6 +1,13 @@
 #ifndef _UTIL_H_
 #define _UTIL_H_
 
+/* a is at or before b on a clock of unsigned type t that wraps around, if
+ * they are less than half the range apart. Every step is cast back to t, as
+ * a type narrower than int, like the 16 bit clock_time_t of the sky, is
+ * promoted to int and ~0 would be -1. */
+#define TIME_REACHED(t, a, b) \
+	((t)((b)-(a)) < (t)((t)~(t)0 >> 1))
+
 static inline
 void uint16_to_uint8(const uint16_t in, uint8_t out[2]) {
 	out[0] = (uint8_t)((in&0xFF00)>>8);
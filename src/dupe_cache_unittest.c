@@ -0,0 +1,63 @@
+#include "base/unittest.h"
+
+#include "emergency_net/dupe_cache.h"
+
+static void test_dupe_cache(void) {
+	struct dupe_cache dc;
+	rimeaddr_t a = {{1, 2}};
+	rimeaddr_t b = {{2, 1}};
+	int i;
+
+	dupe_cache_init(&dc);
+	ASSERT(!dupe_cache_has(&dc, &a, 0));
+
+	dupe_cache_add(&dc, &a, 5);
+	ASSERT(dupe_cache_has(&dc, &a, 5));
+	ASSERT(!dupe_cache_has(&dc, &a, 4));
+	ASSERT(!dupe_cache_has(&dc, &a, 6));
+	ASSERT(!dupe_cache_has(&dc, &b, 5));
+
+	/* out of order inside the window */
+	dupe_cache_add(&dc, &a, 8);
+	dupe_cache_add(&dc, &a, 6);
+	ASSERT(dupe_cache_has(&dc, &a, 5));
+	ASSERT(dupe_cache_has(&dc, &a, 6));
+	ASSERT(!dupe_cache_has(&dc, &a, 7));
+	ASSERT(dupe_cache_has(&dc, &a, 8));
+
+	/* seqno wrap */
+	dupe_cache_add(&dc, &b, 254);
+	dupe_cache_add(&dc, &b, 255);
+	dupe_cache_add(&dc, &b, 1);
+	ASSERT(dupe_cache_has(&dc, &b, 254));
+	ASSERT(dupe_cache_has(&dc, &b, 255));
+	ASSERT(!dupe_cache_has(&dc, &b, 0));
+	ASSERT(dupe_cache_has(&dc, &b, 1));
+
+	/* window slides past old seqnos */
+	dupe_cache_add(&dc, &a, 8+DUPE_CACHE_WINDOW);
+	ASSERT(!dupe_cache_has(&dc, &a, 8));
+	ASSERT(dupe_cache_has(&dc, &a, 8+DUPE_CACHE_WINDOW));
+
+	/* far behind the window means the originator restarted */
+	dupe_cache_add(&dc, &a, 0);
+	ASSERT(dupe_cache_has(&dc, &a, 0));
+	ASSERT(!dupe_cache_has(&dc, &a, 8+DUPE_CACHE_WINDOW));
+
+	/* a full probe sequence evicts the least recently added originator */
+	dupe_cache_clear(&dc);
+	for (i = 0; i < DUPE_CACHE_PROBES+1; ++i) {
+		rimeaddr_t o;
+		o.u8[0] = 0;
+		o.u8[1] = (uint8_t)(i*DUPE_CACHE_SIZE);
+		dupe_cache_add(&dc, &o, 1);
+	}
+	for (i = 0; i < DUPE_CACHE_PROBES+1; ++i) {
+		rimeaddr_t o;
+		o.u8[0] = 0;
+		o.u8[1] = (uint8_t)(i*DUPE_CACHE_SIZE);
+		ASSERT(dupe_cache_has(&dc, &o, 1) == (i != 0));
+	}
+}
+
+UNITTEST("testdupecache", test_dupe_cache)
@@ -3,6 +3,8 @@
 
 #include "base/util.h"
 
+#include "string.h"
+
 struct coordinate coordinate_node;
 const struct coordinate coordinate_null = {{0,0}, {0,0}};
 
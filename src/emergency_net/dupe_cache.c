@@ -0,0 +1,94 @@
+#include "emergency_net/dupe_cache.h"
+
+#include "string.h"
+
+#include "base/log.h"
+
+#define SLOT(originator, i) \
+	((((originator)->u8[0]*7 ^ (originator)->u8[1]) + (i)) & \
+	 (DUPE_CACHE_SIZE-1))
+
+static struct dupe_cache_entry* find(const struct dupe_cache *dc,
+		const rimeaddr_t *originator) {
+	uint8_t i;
+	for (i = 0; i < DUPE_CACHE_PROBES; ++i) {
+		const struct dupe_cache_entry *e = &dc->entries[SLOT(originator, i)];
+		if (e->mask != 0 && rimeaddr_cmp(&e->originator, originator)) {
+			return (struct dupe_cache_entry*)e;
+		}
+	}
+
+	return NULL;
+}
+
+/* Returns an unused probed entry, or else the one least recently added to. */
+static struct dupe_cache_entry* claim(struct dupe_cache *dc,
+		const rimeaddr_t *originator) {
+	struct dupe_cache_entry *oldest = NULL;
+	uint8_t i;
+	for (i = 0; i < DUPE_CACHE_PROBES; ++i) {
+		struct dupe_cache_entry *e = &dc->entries[SLOT(originator, i)];
+		if (e->mask == 0) {
+			return e;
+		}
+		if (oldest == NULL || (uint8_t)(dc->clock - e->stamp) >
+				(uint8_t)(dc->clock - oldest->stamp)) {
+			oldest = e;
+		}
+	}
+
+	LOG("Dupe cache evicting %d.%d\n", oldest->originator.u8[0],
+			oldest->originator.u8[1]);
+	return oldest;
+}
+
+void dupe_cache_init(struct dupe_cache *dc) {
+	dupe_cache_clear(dc);
+}
+
+int dupe_cache_has(const struct dupe_cache *dc, const rimeaddr_t *originator,
+		uint8_t seqno) {
+	const struct dupe_cache_entry *e = find(dc, originator);
+	uint8_t behind;
+	if (e == NULL) {
+		return 0;
+	}
+
+	/* A seqno newer than top wraps around to a large distance. */
+	behind = (uint8_t)(e->top - seqno);
+	return behind < DUPE_CACHE_WINDOW && (e->mask & ((uint32_t)1 << behind));
+}
+
+void dupe_cache_add(struct dupe_cache *dc, const rimeaddr_t *originator,
+		uint8_t seqno) {
+	struct dupe_cache_entry *e = find(dc, originator);
+	uint8_t ahead;
+
+	if (e == NULL) {
+		e = claim(dc, originator);
+		rimeaddr_copy(&e->originator, originator);
+		e->top = seqno;
+		e->mask = 0;
+	}
+	e->stamp = ++dc->clock;
+
+	ahead = (uint8_t)(seqno - e->top);
+	if (ahead < 128) {
+		/* newer than (or equal to) top, slide the window */
+		e->mask = ahead < DUPE_CACHE_WINDOW ? e->mask << ahead : 0;
+		e->mask |= 1;
+		e->top = seqno;
+	} else {
+		uint8_t behind = (uint8_t)(e->top - seqno);
+		if (behind < DUPE_CACHE_WINDOW) {
+			e->mask |= (uint32_t)1 << behind;
+		} else {
+			e->top = seqno;
+			e->mask = 1;
+		}
+	}
+}
+
+void dupe_cache_clear(struct dupe_cache *dc) {
+	memset(dc, 0, sizeof(struct dupe_cache));
+}
@@ -0,0 +1,41 @@
+/* Remembers which (originator, seqno) pairs have been seen, for dropping
+ * duplicate packets. Every originator gets one entry holding its highest
+ * seqno and a bitmap of the DUPE_CACHE_WINDOW seqnos up to and including it.
+ * Entries live in a small open addressed hash table, so both lookup and
+ * insert touch at most DUPE_CACHE_PROBES entries. */
+#ifndef _DUPE_CACHE_H_
+#define _DUPE_CACHE_H_
+
+#include "net/rime/rimeaddr.h"
+
+#define DUPE_CACHE_SIZE 16 /* must be a power of two */
+#define DUPE_CACHE_PROBES 4
+#define DUPE_CACHE_WINDOW 32
+
+struct dupe_cache_entry {
+	rimeaddr_t originator;
+	uint8_t top; /* highest seqno seen */
+	uint8_t stamp; /* when last added to, for eviction */
+	uint32_t mask; /* bit i set if seqno top-i has been seen, 0 if unused */
+};
+
+struct dupe_cache {
+	struct dupe_cache_entry entries[DUPE_CACHE_SIZE];
+	uint8_t clock;
+};
+
+void dupe_cache_init(struct dupe_cache *dc);
+
+/* Returns non zero if seqno from originator has been added before. */
+int dupe_cache_has(const struct dupe_cache *dc, const rimeaddr_t *originator,
+		uint8_t seqno);
+
+/* A seqno more than DUPE_CACHE_WINDOW behind the newest seen is taken as the
+ * originator having restarted, and starts its window over. When all probed
+ * entries are in use, the least recently added to is evicted. */
+void dupe_cache_add(struct dupe_cache *dc, const rimeaddr_t *originator,
+		uint8_t seqno);
+
+void dupe_cache_clear(struct dupe_cache *dc);
+
+#endif
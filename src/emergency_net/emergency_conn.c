@@ -7,6 +7,8 @@
 #include "emergency_net/packet.h"
 #include "emergency_net/timesynch_gluer.h"
 
+#include "base/trace.h"
+#include "base/util.h"
 #include "base/log.h"
 
 #include <stddef.h> /* For offsetof */
@@ -19,423 +21,781 @@
 
 #define MESH_TRANSMIT (CLOCK_SECOND+random_rand()%(5*CLOCK_SECOND))
 
+/* until the ACK round trip to a neighbor is known */
 #define RETRANSMIT_NEIGHBOR_DATA (6*CLOCK_SECOND)
 #define RETRANSMIT_MULTICAST_UNICAST_DATA (6*CLOCK_SECOND)
 //#define RETRANSMIT_MESH_DATA (*CLOCK_SECOND)
 
+#define RTO_MIN (CLOCK_SECOND/2)
+#define RTO_MAX (8*CLOCK_SECOND)
+
+#define SEND_GAP (CLOCK_SECOND/64)
+
+#define TRICKLE_IMIN (CLOCK_SECOND/4)
+#define TRICKLE_IMAX (4*CLOCK_SECOND)
+
 #define TIMESYNCH_LEADER_UPDATE (30*CLOCK_SECOND)
 #define TIMESYNCH_LEADER_TIMEOUT (60*CLOCK_SECOND)
 
-enum {
-	MSG_TYPE_NEIGHBOR_ACK = PACKET_BUFFER_TYPE_ZERO,
-	MSG_TYPE_NEIGHBOR_DATA = PACKET_BUFFER_TYPE_ZERO+1,
-	MSG_TYPE_BROADCAST_DATA = PACKET_BUFFER_TYPE_ZERO+2,
-	MSG_TYPE_MULTICAST_UNICAST_ACK = PACKET_BUFFER_TYPE_ZERO+3,
-	MSG_TYPE_MULTICAST_UNICAST_DATA = PACKET_BUFFER_TYPE_ZERO+4,
-	MSG_TYPE_TIMESYNCH_DATA = PACKET_BUFFER_TYPE_ZERO+5,
-	MSG_TYPE_MESH_DATA = PACKET_BUFFER_TYPE_ZERO+6
+
+/* Every type in the sending queue is sent by one scheduler timer, so that our
+ * own types never contend for the radio. A type is ready when its packet's
+ * ready_at has been reached, unless it is blocked waiting on an event (a mesh
+ * callback or the trickle timer). Among ready types, ACKs and timesynch go
+ * first in type order, the data types are then picked by smooth weighted
+ * round robin. Weight 0 marks a strict priority type. */
+static const uint8_t sched_weight[PACKET_BUFFER_MAX_TYPES] = {
+	0, /* MSG_TYPE_NEIGHBOR_ACK */
+	2, /* MSG_TYPE_NEIGHBOR_DATA */
+	1, /* MSG_TYPE_BROADCAST_DATA */
+	0, /* MSG_TYPE_MULTICAST_UNICAST_ACK */
+	2, /* MSG_TYPE_MULTICAST_UNICAST_DATA */
+	0, /* MSG_TYPE_TIMESYNCH_DATA */
+	1, /* MSG_TYPE_MESH_DATA */
+	4 /* MSG_TYPE_TRICKLE_DATA */
 };
 
-static void
-print_packet_data(const uint8_t *hdr, int len)
-{
-  int i;
+#define CLOCK_REACHED(a, b) TIME_REACHED(clock_time_t, (a), (b))
+
+#define TRACE_PACKET(id, a, p) \
+	TRACE_EVENT((id), (a), TRACE_ADDR(&(p)->hdr.originator), (p)->hdr.seqno)
 
-  for(i = 0; i < len; ++i) {
-    LOG(" (0x%0x), ", hdr[i]);
-  }
+static void sched_update(struct ec *c);
 
-  LOG("\n");
+/* Makes type ready after delay. */
+static void sched_set(struct ec *c, uint8_t type, clock_time_t delay) {
+	c->sched.ready_at[type] = clock_time()+delay;
+	c->sched.blocked &= ~(1 << type);
 }
 
+static void sched_block(struct ec *c, uint8_t type) {
+	c->sched.blocked |= 1 << type;
+}
 
-static void send_neighbor_data(void *cptr) {
-	struct ec *c = (struct ec*)cptr;
-	struct buffered_packet *bp =
-		packet_buffer_get_first_packet_from_type(&c->sq,
-				MSG_TYPE_NEIGHBOR_DATA);
-	if (bp != NULL) {
-		const struct packet *p = (struct packet*)
-			packet_buffer_get_packet(bp);
-
-		while (packet_buffer_times_sent(bp) >= MAX_TIMES_SENT_MESH) {
-			rimeaddr_t *neighbor = packet_buffer_unacked_neighbors_begin(bp);
-			LOG("Packet has been sent too many times without ACKs, neighbor "
-					"presumed dead. Dropping packet from further sending.\n");
-			/* TODO: implement warn. */
-			LOG("Unanswered neighbors: ");
-			for(;neighbor != NULL; neighbor = packet_buffer_unacked_neighbors_next(bp)) {
-				LOG("%d.%d, ", neighbor->u8[0], neighbor->u8[1]);
-			}
-			LOG("\n");
+static void sched_busy(struct ec *c, uint8_t type, clock_time_t delay) {
+	TRACE_EVENT(TRACE_EC_BUSY, type, 0, 0);
+	++c->stats.classes[type].busy;
+	sched_set(c, type, delay);
+}
 
-			packet_buffer_free(&c->sq, bp);
-			bp = packet_buffer_get_first_packet_from_type(&c->sq,
-				MSG_TYPE_NEIGHBOR_DATA);
-			if (bp == NULL) {
-				return;
-			}
+/* Called after a packet of type has been buffered. A type that was empty
+ * becomes ready after delay, otherwise the new packet waits its turn. */
+static void sched_count_depth(struct ec *c, uint8_t type) {
+	uint8_t depth = packet_buffer_num_packets_of_type(&c->sq, type);
+	if (depth > c->stats.classes[type].max_depth) {
+		c->stats.classes[type].max_depth = depth;
+	}
+}
+
+static void sched_queued(struct ec *c, uint8_t type, clock_time_t delay) {
+	sched_count_depth(c, type);
+	if (packet_buffer_num_packets_of_type(&c->sq, type) == 1 && !(c->sched.blocked & (1 << type))) {
+		sched_set(c, type, delay);
+	}
+	sched_update(c);
+}
+
+/* Counts a packet of type that could not be buffered. */
+static int is_buffered(struct ec *c, uint8_t type,
+		const struct buffered_packet *bp) {
+	if (bp == NULL) {
+		TRACE_EVENT(TRACE_EC_DROP, type, 0, 0);
+		++c->stats.classes[type].drops;
+	}
+	return bp != NULL;
+}
+
+static int sched_is_ready(const struct ec *c, uint8_t type, clock_time_t now) {
+	return packet_buffer_num_packets_of_type(&c->sq, type) > 0 &&
+		!(c->sched.blocked & (1 << type)) &&
+		CLOCK_REACHED(c->sched.ready_at[type], now);
+}
+
+static int8_t sched_pick(struct ec *c, clock_time_t now) {
+	int8_t best = -1;
+	uint8_t total = 0;
+	uint8_t type;
+
+	for (type = 0; type < PACKET_BUFFER_MAX_TYPES; ++type) {
+		if (sched_weight[type] == 0 && sched_is_ready(c, type, now)) {
+			return type;
 		}
+	}
 
-		LOG("[NEIGHBOR DATA SEND]: ");
-		DEBUG_PACKET(p);
-		LOG("Packet data: ");
-		print_packet_data(p->data, packet_buffer_data_len(bp));
-
-		packetbuf_clear();
-
-		if(IS_PACKET_FLAG_SET(p, BROADCAST)){
-			if (packet_buffer_times_sent(bp) > 0) {
-				/* If the packet has been sent more than once, transform it into a
-				 * either a multicast or unicast packet. This to enable a more
-				 * efficient broadcasting to target the neighbors which have not
-				 * acked the packet. This protects against if a neighbor's ACK has
-				 * been lost. By specifying this by target multicasting we can let
-				 * the neighbors know that they should resend the ACKs. If we just
-				 * broadcasted we would not show whose ACK went missing. And
-				 * sending multiple unicasts to the ones whose ACKs are missing is
-				 * less efficient. */
-				uint8_t nsize = packet_buffer_num_unacked_neighbors(bp);
-				ASSERT(nsize != 0);
-
-				if (nsize > 1) {
-					/* make multicast */
-					struct multicast_packet *mp = (struct multicast_packet*)
-						packetbuf_dataptr();
-					rimeaddr_t *addr = (rimeaddr_t*)mp->data;
-					const rimeaddr_t *i = packet_buffer_unacked_neighbors_begin(bp);
-
-					packetbuf_set_datalen(MULTICAST_PACKET_HDR_SIZE+
-							nsize*sizeof(rimeaddr_t)+
-							packet_buffer_data_len(bp));
-
-					init_multicast_packet(mp, 0, p->hdr.hops,
-							&p->hdr.originator, &p->hdr.sender, p->hdr.seqno,
-							nsize);
-
-					for(; i != NULL; i = packet_buffer_unacked_neighbors_next(bp)) {
-						rimeaddr_copy(addr++, i);
-					}
-					memcpy(addr, p->data, packet_buffer_data_len(bp));
-				} else {
-					/* make unicast */
-					struct unicast_packet *up = (struct unicast_packet*)
-						packetbuf_dataptr();
-					const rimeaddr_t *addr = packet_buffer_unacked_neighbors_begin(bp);
-					ASSERT(addr != NULL);
-
-					packetbuf_set_datalen(UNICAST_PACKET_HDR_SIZE+
-							packet_buffer_data_len(bp));
-
-					init_unicast_packet(up, 0, p->hdr.hops, &p->hdr.originator,
-							&p->hdr.sender, p->hdr.seqno, addr);
-					memcpy(up->data, p->data, packet_buffer_data_len(bp));
-				}
-			} else {
-				/* make broadcast */
-				uint8_t len = BROADCAST_PACKET_HDR_SIZE+
-					packet_buffer_data_len(bp);
-				struct broadcast_packet *broadpacket = (struct broadcast_packet*)
-					packetbuf_dataptr();
-				packetbuf_set_datalen(len);
-				memcpy(broadpacket, p, len);
+	for (type = 0; type < PACKET_BUFFER_MAX_TYPES; ++type) {
+		if (sched_weight[type] != 0 && sched_is_ready(c, type, now)) {
+			c->sched.credit[type] += sched_weight[type];
+			total += sched_weight[type];
+			if (best < 0 || c->sched.credit[type] > c->sched.credit[best]) {
+				best = type;
 			}
-		} else {
-			ASSERT(0);
 		}
+	}
+	if (best >= 0) {
+		c->sched.credit[best] -= total;
+	}
 
-		if (abc_send(&c->neighbor_conn) == 0) {
-			LOG("ERROR: DATA packet collision.\n");
-			/* fast retransmit */
-			ctimer_set(&c->neighbor_data_timer,
-					FAST_TRANSMIT, send_neighbor_data, c);
-		} else {
-			packet_buffer_increment_times_sent(bp);
-			ctimer_set(&c->neighbor_data_timer,
-					RETRANSMIT_NEIGHBOR_DATA, send_neighbor_data, c);
-		}
+	return best;
+}
 
+/* Appends the acks of the first packet of ack_type to the data packet in
+ * packetbuf and returns that packet, to be freed once the data packet is on
+ * air. */
+static struct buffered_packet* piggyback_acks(struct ec *c, uint8_t ack_type) {
+	struct buffered_packet *bp =
+		packet_buffer_get_first_packet_from_type(&c->sq, ack_type);
+	uint16_t len = packetbuf_datalen();
+	uint8_t *buf = (uint8_t*)packetbuf_dataptr();
+
+	if (bp == NULL ||
+			len+packet_buffer_data_len(bp)+1 > PACKETBUF_SIZE) {
+		return NULL;
 	}
+
+	memcpy(buf+len, packet_buffer_get_packet(bp)->data,
+			packet_buffer_data_len(bp));
+	len += packet_buffer_data_len(bp);
+	buf[len++] = packet_buffer_data_len(bp)/ACK_ENTRY_SIZE;
+	packetbuf_set_datalen(len);
+	((struct packet*)buf)->hdr.flags |= ACKS;
+	return bp;
 }
 
-static void send_neighbor_ack(void* cptr) {
-	struct ec *c = (struct ec*)cptr;
-	struct buffered_packet *bp =
-		packet_buffer_get_first_packet_from_type(&c->sq,
-				MSG_TYPE_NEIGHBOR_ACK);
+static void piggybacked_acks_sent(struct ec *c, uint8_t ack_type,
+		struct buffered_packet *bp) {
 	if (bp != NULL) {
-		const struct unicast_packet *p = (struct unicast_packet*)
-			packet_buffer_get_packet(bp);
-		LOG("[NEIGHBOR ACK SEND]: ");
-		DEBUG_UNICAST_PACKET(p);
-		packetbuf_clear();
-		packetbuf_set_datalen(UNICAST_PACKET_HDR_SIZE);
-		memcpy(packetbuf_dataptr(), p, UNICAST_PACKET_HDR_SIZE);
-
-		if (abc_send(&c->neighbor_conn) == 0) {
-			LOG("ERROR: ACK packet collision.\n");
-			ctimer_set(&c->neighbor_ack_timer,
-					FAST_TRANSMIT_ACK,
-					send_neighbor_ack, c);
-		} else {
-			packet_buffer_free(&c->sq, bp);
-			bp = packet_buffer_get_first_packet_from_type(&c->sq,
-					MSG_TYPE_NEIGHBOR_ACK);
-			if (bp != NULL) {
-				ctimer_set(&c->neighbor_ack_timer,
-						FAST_TRANSMIT_ACK, send_neighbor_ack, c);
-			}
+		++c->stats.classes[ack_type].piggybacked;
+		packet_buffer_free(&c->sq, bp);
+	}
+}
+
+/* The largest RTO of the neighbors still to ack bp, init for those without
+ * an estimate, doubled for every resend. */
+static clock_time_t retransmit_timeout(struct ec *c, struct buffered_packet *bp,
+		clock_time_t init) {
+	const rimeaddr_t *i = packet_buffer_unacked_neighbors_begin(bp);
+	clock_time_t rto = RTO_MIN;
+	uint8_t backoff;
+
+	for(; i != NULL; i = packet_buffer_unacked_neighbors_next(bp)) {
+		const struct neighbor_node *nn = neighbors_find_neighbor_node(c->ns, i);
+		clock_time_t nrto = nn != NULL && neighbor_node_rto(nn) != 0 ?
+			neighbor_node_rto(nn) : init;
+		if (nrto > rto) {
+			rto = nrto;
 		}
 	}
+
+	for (backoff = packet_buffer_times_sent(bp); backoff > 1 && rto < RTO_MAX;
+			--backoff) {
+		rto <<= 1;
+	}
+	return rto < RTO_MAX ? rto : RTO_MAX;
 }
 
-static void send_multicast_unicast_ack(void* cptr) {
-	struct ec *c = (struct ec*)cptr;
+/* The send functions put the first packet of their type on air and return
+ * non zero if they did. They decide when the type is ready again. */
+static int send_neighbor_data(struct ec *c) {
 	struct buffered_packet *bp =
 		packet_buffer_get_first_packet_from_type(&c->sq,
-				MSG_TYPE_MULTICAST_UNICAST_ACK);
-	if (bp != NULL) {
-		const struct unicast_packet *p = (struct unicast_packet*)
-			packet_buffer_get_packet(bp);
-		LOG("[MC/UC ACK SEND]: ");
-		DEBUG_UNICAST_PACKET(p);
-		packetbuf_clear();
-		packetbuf_set_datalen(UNICAST_PACKET_HDR_SIZE);
-		memcpy(packetbuf_dataptr(), p, UNICAST_PACKET_HDR_SIZE);
-
-		if (abc_send(&c->broadcast_conn) == 0) {
-			LOG("ERROR: ACK packet collision.\n");
-			ctimer_set(&c->multicast_unicast_ack_timer,
-					FAST_TRANSMIT_ACK,
-					send_multicast_unicast_ack, c);
-		} else {
-			packet_buffer_free(&c->sq, bp);
-			bp = packet_buffer_get_first_packet_from_type(&c->sq,
-					MSG_TYPE_MULTICAST_UNICAST_ACK);
-			if (bp != NULL) {
-				ctimer_set(&c->multicast_unicast_ack_timer,
-						FAST_TRANSMIT_ACK,
-						send_multicast_unicast_ack, c);
+				MSG_TYPE_NEIGHBOR_DATA);
+	const struct packet *p;
+	struct buffered_packet *acks;
+
+	while (packet_buffer_times_sent(bp) >= MAX_TIMES_SENT_MESH) {
+		rimeaddr_t *neighbor = packet_buffer_unacked_neighbors_begin(bp);
+		LOG("Packet has been sent too many times without ACKs, neighbor "
+				"presumed dead. Dropping packet from further sending.\n");
+		/* TODO: implement warn. */
+		LOG("Unanswered neighbors: ");
+		for(;neighbor != NULL; neighbor = packet_buffer_unacked_neighbors_next(bp)) {
+			struct neighbor_node *nn = neighbors_find_neighbor_node(c->ns, neighbor);
+			LOG("%d.%d, ", neighbor->u8[0], neighbor->u8[1]);
+			if (nn != NULL) {
+				neighbor_node_add_tx_sample(nn, packet_buffer_times_sent(bp));
 			}
 		}
+		LOG("\n");
+
+		TRACE_PACKET(TRACE_EC_GIVE_UP, MSG_TYPE_NEIGHBOR_DATA,
+				packet_buffer_get_packet(bp));
+		++c->stats.classes[MSG_TYPE_NEIGHBOR_DATA].give_ups;
+		packet_buffer_free(&c->sq, bp);
+		bp = packet_buffer_get_first_packet_from_type(&c->sq,
+			MSG_TYPE_NEIGHBOR_DATA);
+		if (bp == NULL) {
+			return 0;
+		}
 	}
+
+	p = (struct packet*)packet_buffer_get_packet(bp);
+	TRACE_PACKET(TRACE_EC_SEND, MSG_TYPE_NEIGHBOR_DATA, p);
+
+	packetbuf_clear();
+
+	if(IS_PACKET_FLAG_SET(p, BROADCAST)){
+		if (packet_buffer_times_sent(bp) > 0) {
+			/* If the packet has been sent more than once, only the neighbors
+			 * which have not acked it are asked to. Naming them in a one byte
+			 * mask rather than a multicast address list keeps retries short.
+			 * A neighbor which got the packet but whose ACK went missing acks
+			 * it again. */
+			struct broadcast_packet *rp = (struct broadcast_packet*)
+				packetbuf_dataptr();
+			const rimeaddr_t *i = packet_buffer_unacked_neighbors_begin(bp);
+			uint8_t missing = 0;
+			ASSERT(i != NULL);
+
+			for(; i != NULL; i = packet_buffer_unacked_neighbors_next(bp)) {
+				missing |= packet_neighbor_bit(i);
+			}
+
+			packetbuf_set_datalen(BROADCAST_PACKET_HDR_SIZE+1+
+					packet_buffer_data_len(bp));
+			init_broadcast_packet(rp, MISSING, p->hdr.hops, &p->hdr.originator,
+					&p->hdr.sender, p->hdr.seqno);
+			rp->data[0] = missing;
+			memcpy(rp->data+1, p->data, packet_buffer_data_len(bp));
+		} else {
+			/* make broadcast */
+			uint8_t len = BROADCAST_PACKET_HDR_SIZE+
+				packet_buffer_data_len(bp);
+			struct broadcast_packet *broadpacket = (struct broadcast_packet*)
+				packetbuf_dataptr();
+			packetbuf_set_datalen(len);
+			memcpy(broadpacket, p, len);
+		}
+	} else {
+		ASSERT(0);
+	}
+
+	acks = piggyback_acks(c, MSG_TYPE_NEIGHBOR_ACK);
+
+	if (abc_send(&c->neighbor_conn) == 0) {
+		/* fast retransmit */
+		sched_busy(c, MSG_TYPE_NEIGHBOR_DATA, FAST_TRANSMIT);
+		return 0;
+	}
+
+	piggybacked_acks_sent(c, MSG_TYPE_NEIGHBOR_ACK, acks);
+	packet_buffer_increment_times_sent(bp);
+	sched_set(c, MSG_TYPE_NEIGHBOR_DATA,
+			retransmit_timeout(c, bp, RETRANSMIT_NEIGHBOR_DATA));
+	return 1;
 }
 
-static void send_multicast_unicast_data(void *cptr) {
-	struct ec *c = (struct ec*)cptr;
+static int send_ack(struct ec *c, struct abc_conn *conn, uint8_t type) {
+	struct buffered_packet *bp =
+		packet_buffer_get_first_packet_from_type(&c->sq, type);
+	const struct broadcast_packet *p = (struct broadcast_packet*)
+		packet_buffer_get_packet(bp);
+	TRACE_EVENT(TRACE_EC_SEND, type, 0, packet_buffer_data_len(bp)/ACK_ENTRY_SIZE);
+	packetbuf_clear();
+	packetbuf_set_datalen(BROADCAST_PACKET_HDR_SIZE+packet_buffer_data_len(bp));
+	memcpy(packetbuf_dataptr(), p, packetbuf_datalen());
+
+	if (abc_send(conn) == 0) {
+		sched_busy(c, type, FAST_TRANSMIT_ACK);
+		return 0;
+	}
+
+	packet_buffer_free(&c->sq, bp);
+	sched_set(c, type, FAST_TRANSMIT_ACK);
+	return 1;
+}
+
+static int send_neighbor_ack(struct ec *c) {
+	return send_ack(c, &c->neighbor_conn, MSG_TYPE_NEIGHBOR_ACK);
+}
+
+static int send_multicast_unicast_ack(struct ec *c) {
+	return send_ack(c, &c->broadcast_conn, MSG_TYPE_MULTICAST_UNICAST_ACK);
+}
+
+static int send_multicast_unicast_data(struct ec *c) {
 	struct buffered_packet *bp =
 		packet_buffer_get_first_packet_from_type(&c->sq,
 				MSG_TYPE_MULTICAST_UNICAST_DATA);
-	if (bp != NULL) {
-		const struct broadcast_packet *p = (struct broadcast_packet*)
-			packet_buffer_get_packet(bp);
+	const struct broadcast_packet *p = (struct broadcast_packet*)
+		packet_buffer_get_packet(bp);
 
-		uint8_t nsize = packet_buffer_num_unacked_neighbors(bp);
-		ASSERT(nsize != 0);
+	uint8_t nsize = packet_buffer_num_unacked_neighbors(bp);
+	struct buffered_packet *acks;
+	ASSERT(nsize != 0);
 
-		packetbuf_clear();
+	packetbuf_clear();
 
-		LOG("[MC/UC DATA SEND]: ");
-		DEBUG_PACKET(p);
-		LOG("Packet data: ");
-		print_packet_data(p->data, packet_buffer_data_len(bp));
+	TRACE_PACKET(TRACE_EC_SEND, MSG_TYPE_MULTICAST_UNICAST_DATA, p);
 
-		if (nsize > 1) {
-			/* make multicast */
-			struct multicast_packet *mp = (struct multicast_packet*)
-				packetbuf_dataptr();
-			rimeaddr_t *addr = (rimeaddr_t*)mp->data;
-			const rimeaddr_t *i = packet_buffer_unacked_neighbors_begin(bp);
+	if (nsize > 1) {
+		/* make multicast */
+		struct multicast_packet *mp = (struct multicast_packet*)
+			packetbuf_dataptr();
+		rimeaddr_t *addr = (rimeaddr_t*)mp->data;
+		const rimeaddr_t *i = packet_buffer_unacked_neighbors_begin(bp);
 
-			packetbuf_set_datalen(MULTICAST_PACKET_HDR_SIZE+
-					nsize*sizeof(rimeaddr_t)+
-					packet_buffer_data_len(bp));
+		packetbuf_set_datalen(MULTICAST_PACKET_HDR_SIZE+
+				nsize*sizeof(rimeaddr_t)+
+				packet_buffer_data_len(bp));
 
-			init_multicast_packet(mp, 0, p->hdr.hops,
-					&p->hdr.originator, &p->hdr.sender, p->hdr.seqno,
-					nsize);
+		init_multicast_packet(mp, 0, p->hdr.hops,
+				&p->hdr.originator, &p->hdr.sender, p->hdr.seqno,
+				nsize);
 
-			for(; i != NULL; i = packet_buffer_unacked_neighbors_next(bp)) {
-				rimeaddr_copy(addr++, i);
-			}
-			memcpy(addr, p->data, packet_buffer_data_len(bp));
-		} else {
-			/* make unicast */
-			struct unicast_packet *up = (struct unicast_packet*)
-				packetbuf_dataptr();
-			const rimeaddr_t *addr = packet_buffer_unacked_neighbors_begin(bp);
-			ASSERT(addr != NULL);
+		for(; i != NULL; i = packet_buffer_unacked_neighbors_next(bp)) {
+			rimeaddr_copy(addr++, i);
+		}
+		memcpy(addr, p->data, packet_buffer_data_len(bp));
+	} else {
+		/* make unicast */
+		struct unicast_packet *up = (struct unicast_packet*)
+			packetbuf_dataptr();
+		const rimeaddr_t *addr = packet_buffer_unacked_neighbors_begin(bp);
+		ASSERT(addr != NULL);
+
+		packetbuf_set_datalen(UNICAST_PACKET_HDR_SIZE+
+				packet_buffer_data_len(bp));
+
+		init_unicast_packet(up, 0, p->hdr.hops, &p->hdr.originator,
+				&p->hdr.sender, p->hdr.seqno, addr);
+		memcpy(up->data, p->data, packet_buffer_data_len(bp));
+	}
 
-			packetbuf_set_datalen(UNICAST_PACKET_HDR_SIZE+
-					packet_buffer_data_len(bp));
+	acks = piggyback_acks(c, MSG_TYPE_MULTICAST_UNICAST_ACK);
 
-			init_unicast_packet(up, 0, p->hdr.hops, &p->hdr.originator,
-					&p->hdr.sender, p->hdr.seqno, addr);
-			memcpy(up->data, p->data, packet_buffer_data_len(bp));
-		}
+	if (abc_send(&c->broadcast_conn) == 0) {
+		/* fast retransmit */
+		sched_busy(c, MSG_TYPE_MULTICAST_UNICAST_DATA, FAST_TRANSMIT);
+		return 0;
+	}
 
-		if (abc_send(&c->broadcast_conn) == 0) {
-			LOG("ERROR: DATA packet collision.\n");
-			/* fast retransmit */
-			ctimer_set(&c->multicast_unicast_data_timer,
-					FAST_TRANSMIT, send_multicast_unicast_data, c);
-		} else {
-			packet_buffer_increment_times_sent(bp);
-			ctimer_set(&c->multicast_unicast_data_timer,
-					RETRANSMIT_MULTICAST_UNICAST_DATA, 
-					send_multicast_unicast_data, c);
-		}
+	piggybacked_acks_sent(c, MSG_TYPE_MULTICAST_UNICAST_ACK, acks);
+	packet_buffer_increment_times_sent(bp);
+	sched_set(c, MSG_TYPE_MULTICAST_UNICAST_DATA,
+			retransmit_timeout(c, bp, RETRANSMIT_MULTICAST_UNICAST_DATA));
+	return 1;
+}
+
+static int send_broadcast(struct ec *c, struct abc_conn *conn, uint8_t type) {
+	struct buffered_packet *bp =
+		packet_buffer_get_first_packet_from_type(&c->sq, type);
+	const struct broadcast_packet *p = (struct broadcast_packet*)
+		packet_buffer_get_packet(bp);
+	struct broadcast_packet *pbuf;
+	packetbuf_clear();
+	pbuf = (struct broadcast_packet*) packetbuf_dataptr();
+
+	TRACE_PACKET(TRACE_EC_SEND, type, p);
+
+	packetbuf_set_datalen(BROADCAST_PACKET_HDR_SIZE+packet_buffer_data_len(bp));
+	memcpy(pbuf, p, BROADCAST_PACKET_HDR_SIZE);
+	memcpy(pbuf->data, p->data, packet_buffer_data_len(bp));
+
+	if (abc_send(conn) == 0) {
+		sched_busy(c, type, FAST_TRANSMIT);
+		return 0;
 	}
+
+	packet_buffer_free(&c->sq, bp);
+	sched_set(c, type, FAST_TRANSMIT);
+	return 1;
 }
 
-static void send_broadcast_data(void* cptr) {
-	struct ec *c = (struct ec*)cptr;
+static int send_broadcast_data(struct ec *c) {
+	return send_broadcast(c, &c->broadcast_conn, MSG_TYPE_BROADCAST_DATA);
+}
+
+static int send_timesynch_data(struct ec *c) {
+	return send_broadcast(c, &c->timesynch_conn, MSG_TYPE_TIMESYNCH_DATA);
+}
+
+static int send_mesh_data(struct ec *c) {
 	struct buffered_packet *bp =
 		packet_buffer_get_first_packet_from_type(&c->sq,
-				MSG_TYPE_BROADCAST_DATA);
-	if (bp != NULL) {
-		const struct broadcast_packet *p = (struct broadcast_packet*)
-			packet_buffer_get_packet(bp);
-		struct broadcast_packet *pbuf;
-		packetbuf_clear();
-		pbuf = (struct broadcast_packet*) packetbuf_dataptr();
+				MSG_TYPE_MESH_DATA);
 
-		LOG("[BROADCAST DATA SEND]: ");
-		DEBUG_PACKET(p);
+	while (packet_buffer_times_sent(bp) >= MAX_TIMES_SENT) {
+		TRACE_PACKET(TRACE_EC_GIVE_UP, MSG_TYPE_MESH_DATA,
+				packet_buffer_get_packet(bp));
+		++c->stats.classes[MSG_TYPE_MESH_DATA].give_ups;
+		packet_buffer_free(&c->sq, bp);
+		bp = packet_buffer_get_first_packet_from_type(&c->sq,
+			MSG_TYPE_MESH_DATA);
+		if (bp == NULL) {
+			return 0;
+		}
+	}
 
-		packetbuf_set_datalen(BROADCAST_PACKET_HDR_SIZE+packet_buffer_data_len(bp));
-		memcpy(pbuf, p, BROADCAST_PACKET_HDR_SIZE);
+	packetbuf_clear();
+	{
+		const struct unicast_packet *p = (struct
+				unicast_packet*)packet_buffer_get_packet(bp);
+		struct mesh_packet *pbuf = (struct mesh_packet*)
+			packetbuf_dataptr();
+
+		TRACE_EVENT(TRACE_EC_SEND, MSG_TYPE_MESH_DATA,
+				TRACE_ADDR(&p->destination), p->hdr.seqno);
+
+		packetbuf_set_datalen(MESH_PACKET_HDR_SIZE+packet_buffer_data_len(bp));
+
+		pbuf->seqno = p->hdr.seqno;
 		memcpy(pbuf->data, p->data, packet_buffer_data_len(bp));
 
-		if (abc_send(&c->broadcast_conn) == 0) {
-			LOG("ERROR: BROADCAST DATA packet collision.\n");
-			ctimer_set(&c->broadcast_data_timer,
-					FAST_TRANSMIT,
-					send_broadcast_data, c);
-		} else {
-			packet_buffer_free(&c->sq, bp);
-			bp = packet_buffer_get_first_packet_from_type(&c->sq,
-					MSG_TYPE_BROADCAST_DATA);
-			if (bp != NULL) {
-				ctimer_set(&c->broadcast_data_timer,
-						FAST_TRANSMIT, send_broadcast_data, c);
-			}
+		packet_buffer_increment_times_sent(bp);
+		if(!mesh_send(&c->meshdata_conn, &p->destination)) {
+			LOG("Mesh could not be directly sent\n");
+			sched_set(c, MSG_TYPE_MESH_DATA, MESH_TRANSMIT);
+			return 0;
 		}
 	}
+
+	/* until meshdata_sent or meshdata_timeout */
+	sched_block(c, MSG_TYPE_MESH_DATA);
+	return 1;
+}
+
+static void trickle_due(void *cptr);
+static void trickle_interval_end(void *cptr);
+
+static struct buffered_packet* trickle_head(struct ec *c) {
+	return packet_buffer_get_first_packet_from_type(&c->sq,
+			MSG_TYPE_TRICKLE_DATA);
+}
+
+/* Picks the transmission point in the second half of the interval. */
+static void trickle_start_interval(struct ec *c) {
+	clock_time_t half = c->tr.interval/2;
+	clock_time_t t = half + (half > 0 ? random_rand()%half : 0);
+	c->tr.remaining = c->tr.interval - t;
+	sched_block(c, MSG_TYPE_TRICKLE_DATA);
+	ctimer_set(&c->tr.timer, t, trickle_due, c);
+}
+
+/* Starts trickling the head of the queue. Copies of it heard while it was
+ * queued count for its first interval. */
+static void trickle_start(struct ec *c) {
+	c->tr.interval = TRICKLE_IMIN;
+	c->tr.rounds = 0;
+	trickle_start_interval(c);
 }
 
-static void send_timesynch_data(void* cptr) {
+/* Called after a packet has been buffered for trickling. */
+static void trickle_queued(struct ec *c) {
+	sched_count_depth(c, MSG_TYPE_TRICKLE_DATA);
+
+	if (packet_buffer_num_packets_of_type(&c->sq, MSG_TYPE_TRICKLE_DATA) == 1) {
+		trickle_start(c);
+	} else if (c->tr.interval > TRICKLE_IMIN) {
+		/* A new event: reset the interval so that the packets queued up
+		 * behind the current one are not held back. */
+		c->tr.interval = TRICKLE_IMIN;
+		packet_buffer_clear_copies_heard(trickle_head(c));
+		trickle_start_interval(c);
+	}
+}
+
+static void trickle_suppress(struct ec *c) {
+	TRACE_EVENT(TRACE_EC_TRICKLE_SUPPRESS,
+			packet_buffer_copies_heard(trickle_head(c)), 0, 0);
+	sched_block(c, MSG_TYPE_TRICKLE_DATA);
+	ctimer_set(&c->tr.timer, c->tr.remaining, trickle_interval_end, c);
+}
+
+/* The transmission point of the interval, hand the packet to the
+ * scheduler. */
+static void trickle_due(void *cptr) {
 	struct ec *c = (struct ec*)cptr;
-	struct buffered_packet *bp =
-		packet_buffer_get_first_packet_from_type(&c->sq,
-				MSG_TYPE_TIMESYNCH_DATA);
+	if (packet_buffer_copies_heard(trickle_head(c)) < EC_TRICKLE_K) {
+		sched_set(c, MSG_TYPE_TRICKLE_DATA, 0);
+		sched_update(c);
+	} else {
+		trickle_suppress(c);
+	}
+}
 
-	if (bp != NULL) {
-		const struct broadcast_packet *p = (struct broadcast_packet*)
-			packet_buffer_get_packet(bp);
+static int send_trickle_data(struct ec *c) {
+	struct buffered_packet *bp = trickle_head(c);
+	const struct broadcast_packet *p = (struct broadcast_packet*)
+		packet_buffer_get_packet(bp);
+	struct broadcast_packet *pbuf;
 
-		packetbuf_clear();
+	/* copies may have been heard while waiting for the radio */
+	if (packet_buffer_copies_heard(bp) >= EC_TRICKLE_K) {
+		trickle_suppress(c);
+		return 0;
+	}
 
-		LOG("[TIMESYNCH SEND]: ");
-		DEBUG_PACKET(p);
+	packetbuf_clear();
+	pbuf = (struct broadcast_packet*) packetbuf_dataptr();
 
-		packetbuf_set_datalen(BROADCAST_PACKET_HDR_SIZE);
-		memcpy(packetbuf_dataptr(), p, BROADCAST_PACKET_HDR_SIZE);
+	TRACE_PACKET(TRACE_EC_SEND, MSG_TYPE_TRICKLE_DATA, p);
 
-		if (abc_send(&c->timesynch_conn) == 0) {
-			LOG("ERROR: TIMESYNCH DATA packet collision.\n");
-			ctimer_set(&c->timesynch_data_timer,
-					FAST_TRANSMIT,
-					send_timesynch_data, c);
-		} else {
-			packet_buffer_free(&c->sq, bp);
-			bp = packet_buffer_get_first_packet_from_type(&c->sq,
-					MSG_TYPE_TIMESYNCH_DATA);
-			if (bp != NULL) {
-				ctimer_set(&c->timesynch_data_timer,
-						FAST_TRANSMIT, send_timesynch_data, c);
-			}
-		}
+	packetbuf_set_datalen(BROADCAST_PACKET_HDR_SIZE+packet_buffer_data_len(bp));
+	memcpy(pbuf, p, BROADCAST_PACKET_HDR_SIZE);
+	memcpy(pbuf->data, p->data, packet_buffer_data_len(bp));
+
+	if (abc_send(&c->broadcast_conn) == 0) {
+		sched_busy(c, MSG_TYPE_TRICKLE_DATA, FAST_TRANSMIT_ACK);
+		return 0;
 	}
+
+	packet_buffer_increment_times_sent(bp);
+	sched_block(c, MSG_TYPE_TRICKLE_DATA);
+	ctimer_set(&c->tr.timer, c->tr.remaining, trickle_interval_end, c);
+	return 1;
 }
 
-static void send_mesh_data(void* cptr) {
+static void trickle_interval_end(void *cptr) {
 	struct ec *c = (struct ec*)cptr;
-	struct buffered_packet *bp =
-		packet_buffer_get_first_packet_from_type(&c->sq,
-				MSG_TYPE_MESH_DATA);
+	struct buffered_packet *bp = trickle_head(c);
+	if (bp == NULL) {
+		return;
+	}
 
-	if (bp != NULL) {
-		while (packet_buffer_times_sent(bp) >= MAX_TIMES_SENT) {
-			LOG("Mesh packet has been sent too many times\n");
-			packet_buffer_free(&c->sq, bp);
-			bp = packet_buffer_get_first_packet_from_type(&c->sq,
-				MSG_TYPE_MESH_DATA);
-			if (bp == NULL) {
-				return;
-			}
+	if (++c->tr.rounds < EC_TRICKLE_ROUNDS) {
+		c->tr.interval = c->tr.interval*2 < TRICKLE_IMAX ?
+			c->tr.interval*2 : TRICKLE_IMAX;
+		packet_buffer_clear_copies_heard(bp);
+		trickle_start_interval(c);
+	} else {
+		packet_buffer_free(&c->sq, bp);
+		if (trickle_head(c) != NULL) {
+			trickle_start(c);
 		}
+	}
+}
 
-		packetbuf_clear();
-		{
-			const struct unicast_packet *p = (struct
-					unicast_packet*)packet_buffer_get_packet(bp);
-			struct mesh_packet *pbuf = (struct mesh_packet*)
-				packetbuf_dataptr();
+/* Counts a copy of a packet queued for trickling, heard from someone
+ * else. */
+static void trickle_heard(struct ec *c, const struct packet *p) {
+	struct buffered_packet *bp =
+		packet_buffer_find_buffered_packet_from_type(&c->sq,
+				MSG_TYPE_TRICKLE_DATA, p, originator_seqno_cmp);
+	if (bp != NULL) {
+		packet_buffer_increment_copies_heard(bp);
+	}
+}
 
-			LOG("[MESH SEND]: ");
-			LOG("Packet data: ");
-			print_packet_data(p->data, packet_buffer_data_len(bp));
+static int (* const send_fns[PACKET_BUFFER_MAX_TYPES])(struct ec *c) = {
+	send_neighbor_ack,
+	send_neighbor_data,
+	send_broadcast_data,
+	send_multicast_unicast_ack,
+	send_multicast_unicast_data,
+	send_timesynch_data,
+	send_mesh_data,
+	send_trickle_data
+};
 
-			packetbuf_set_datalen(MESH_PACKET_HDR_SIZE+packet_buffer_data_len(bp));
+static void sched_send(void *cptr) {
+	struct ec *c = (struct ec*)cptr;
+	clock_time_t now = clock_time();
+	int8_t type = sched_pick(c, now);
+
+	if (type >= 0) {
+		struct ec_class_stats *s = &c->stats.classes[type];
+		const struct buffered_packet *bp =
+			packet_buffer_get_first_packet_from_type(&c->sq, type);
+		int8_t is_first = packet_buffer_times_sent(bp) == 0;
+		clock_time_t wait = now - packet_buffer_queued_at(bp);
+
+		if (send_fns[type](c)) {
+			++s->sent;
+			if (is_first) {
+				++s->first_sends;
+				s->wait_sum += wait;
+				if (wait > s->max_wait) {
+					s->max_wait = wait;
+				}
+			} else {
+				++s->retransmits;
+			}
+			c->sched.last_tx = now;
+		}
+	}
 
-			pbuf->seqno = p->hdr.seqno;
-			memcpy(pbuf->data, p->data, packet_buffer_data_len(bp));
+	sched_update(c);
+}
 
-			packet_buffer_increment_times_sent(bp);
-			if(!mesh_send(&c->meshdata_conn, &p->destination)) {
-				//ctimer_set(&c->mesh_data_timer,
-				//		RETRANSMIT_MESH_DATA, send_mesh_data, c);
-				LOG("Mesh could not be directly sent\n");
+/* Sets the timer for the type that gets ready first. */
+static void sched_update(struct ec *c) {
+	clock_time_t now = clock_time();
+	clock_time_t delay = 0;
+	int8_t found = 0;
+	uint8_t type;
+
+	for (type = 0; type < PACKET_BUFFER_MAX_TYPES; ++type) {
+		if (packet_buffer_num_packets_of_type(&c->sq, type) > 0 &&
+				!(c->sched.blocked & (1 << type))) {
+			clock_time_t d = CLOCK_REACHED(c->sched.ready_at[type], now) ?
+				0 : c->sched.ready_at[type] - now;
+			if (!found || d < delay) {
+				delay = d;
+				found = 1;
 			}
 		}
 	}
+
+	if (!found) {
+		ctimer_stop(&c->sched.timer);
+		return;
+	}
+
+	/* leave the radio alone for SEND_GAP after our last frame */
+	if ((clock_time_t)(now - c->sched.last_tx) < SEND_GAP &&
+			SEND_GAP - (now - c->sched.last_tx) > delay) {
+		delay = SEND_GAP - (now - c->sched.last_tx);
+	}
+	ctimer_set(&c->sched.timer, delay, sched_send, c);
 }
 
 static void store_packet_for_dupe_checks(struct ec *c, const struct packet *p) {
+	dupe_cache_add(&c->dc, &p->hdr.originator, p->hdr.seqno);
+}
+
+/* Adds an ack to the last ACK packet of type, or a new one if that is
+ * full. */
+static void queue_ack(struct ec *c, uint8_t type, const rimeaddr_t *to,
+		const rimeaddr_t *originator, uint8_t seqno) {
+	struct buffered_packet *bp =
+		packet_buffer_get_first_packet_from_type(&c->sq, type);
+	struct buffered_packet *last = NULL;
+	struct ack_entry ae;
+
+	rimeaddr_copy(&ae.to, to);
+	rimeaddr_copy(&ae.originator, originator);
+	ae.seqno = seqno;
+
+	for (; bp != NULL; bp = packet_buffer_next(bp)) {
+		const struct ack_entry *i = (const struct ack_entry*)
+			packet_buffer_get_packet(bp)->data;
+		uint8_t n = packet_buffer_data_len(bp)/ACK_ENTRY_SIZE;
+		for (; n > 0; --n, ++i) {
+			if (memcmp(i, &ae, ACK_ENTRY_SIZE) == 0) {
+				LOG("Found ack in sending queue already\n");
+				return;
+			}
+		}
+		last = bp;
+	}
 
-	struct slim_packet *sp = (struct slim_packet*)queue_buffer_find(&c->dq,
-			p, slim_packet_to_packet_cmp);
+	if (last == NULL || packet_buffer_data_len(last) >=
+			EC_ACKS_PER_PACKET*ACK_ENTRY_SIZE ||
+			!packet_buffer_append_data(last, &ae, ACK_ENTRY_SIZE)) {
+		struct broadcast_packet ap;
+		init_broadcast_packet(&ap, ACK, 0, &rimeaddr_node_addr,
+				&rimeaddr_node_addr, 0);
+		is_buffered(c, type,
+				packet_buffer_broadcast_packet(&c->sq, &ap, &ae, ACK_ENTRY_SIZE, NULL,
+					type));
+		sched_queued(c, type, FAST_TRANSMIT_ACK);
+	}
+}
 
-	if (sp == NULL) {
-		 sp = (struct slim_packet*) queue_buffer_alloc_front(&c->dq);
+static void count_ack_rtt(struct ec *c, clock_time_t rtt) {
+	uint32_t bound = EC_RTT_BUCKET0;
+	uint8_t b;
+	for (b = 0; b < EC_RTT_BUCKETS-1 && rtt >= bound; ++b) {
+		bound <<= 1;
+	}
+	++c->stats.ack_rtt[b];
+}
 
-		if (sp == NULL) {
-			queue_buffer_pop_back(&c->dq, NULL);
-			sp = (struct slim_packet*)queue_buffer_alloc_front(&c->dq);
-			ASSERT(sp != NULL);
+/* Marks the data packets of data_type that acks addressed to us
+ * acknowledge as acked by sender, and counts the sends it took into the
+ * sender's ETX. Only packets sent once give RTT samples, as an ACK for a
+ * resent one could be for any of the sends. */
+static void handle_acks(struct ec *c, const rimeaddr_t *sender,
+		const struct ack_entry *acks, uint8_t num_acks, uint8_t data_type) {
+	for (; num_acks > 0; --num_acks, ++acks) {
+		struct packet ap;
+		struct buffered_packet *bp;
+
+		if (!rimeaddr_cmp(&acks->to, &rimeaddr_node_addr)) {
+			continue;
 		}
 
-		rimeaddr_copy(&sp->originator, &p->hdr.originator);
-		sp->seqno = p->hdr.seqno;
+		TRACE_EVENT(TRACE_EC_ACK, data_type, TRACE_ADDR(sender), acks->seqno);
+
+		rimeaddr_copy(&ap.hdr.originator, &acks->originator);
+		ap.hdr.seqno = acks->seqno;
+		bp = packet_buffer_find_buffered_packet_from_type(&c->sq, data_type,
+				&ap, originator_seqno_cmp);
+
+		if (bp != NULL) {
+			if (packet_buffer_neighbor_acked(bp, sender)) {
+				struct neighbor_node *nn = neighbors_find_neighbor_node(c->ns, sender);
+				if (nn != NULL) {
+					neighbor_node_add_tx_sample(nn, packet_buffer_times_sent(bp));
+				}
+				if (nn != NULL && packet_buffer_times_sent(bp) == 1) {
+					clock_time_t rtt = clock_time() - packet_buffer_sent_at(bp);
+					neighbor_node_add_rtt_sample(nn, rtt < 0xFFFF ? rtt : 0xFFFF);
+					count_ack_rtt(c, rtt);
+				}
+			}
+			if (packet_buffer_all_neighbors_acked(bp)) {
+				packet_buffer_free(&c->sq, bp);
+				/* send next packet */
+				sched_set(c, data_type, FAST_TRANSMIT);
+				sched_update(c);
+			}
+		} else {
+			LOG("Recived ack for non-sent packet\n");
+		}
 	}
 }
 
+static void rx_begin(struct ec *c, const struct packet *p, const void *data,
+		uint8_t data_len) {
+	c->rx.p = p;
+	c->rx.data = data;
+	c->rx.data_len = data_len;
+	c->rx.forwarded = NULL;
+}
+
+static void rx_end(struct ec *c) {
+	c->rx.p = NULL;
+	c->rx.forwarded = NULL;
+}
+
 static void neighbor_recv(struct abc_conn *bc) {
 	const struct packet *p = (struct packet*)packetbuf_dataptr();
 	struct ec *c = (struct ec*)((char*)bc-offsetof(struct ec, neighbor_conn));
 	const uint8_t *data = NULL;
 	uint8_t data_len = 0;
 	int8_t is_for_us = 0;
-	TRACE("[NEIGHBOR RECV] ");
-	DEBUG_PACKET(p);
+	struct neighbor_node *nn;
+	const struct ack_entry *acks;
+	uint8_t len = packetbuf_datalen();
+	uint8_t num_acks = packet_acks(p, &len, &acks);
+
+	/* strip piggybacked acks */
+	packetbuf_set_datalen(len);
+	nn = neighbors_find_neighbor_node(c->ns, &p->hdr.sender);
+	if (nn != NULL && packetbuf_attr(PACKETBUF_ATTR_LINK_QUALITY) != 0) {
+		neighbor_node_add_lqi_sample(nn,
+				packetbuf_attr(PACKETBUF_ATTR_LINK_QUALITY));
+	}
+	if (num_acks > 0 && nn != NULL) {
+		handle_acks(c, &p->hdr.sender, acks, num_acks, MSG_TYPE_NEIGHBOR_DATA);
+	}
+	if (IS_PACKET_FLAG_SET(p, ACK)) {
+		return;
+	}
 
-	
 	switch(PACKET_TYPE(p)) {
 		case BROADCAST:
-			is_for_us = 1;
 			data = p->data;
 			data_len = packetbuf_datalen() - BROADCAST_PACKET_HDR_SIZE;
+			if (IS_PACKET_FLAG_SET(p, MISSING)) {
+				/* retransmission */
+				is_for_us = (*data & packet_neighbor_bit(&rimeaddr_node_addr)) != 0;
+				++data;
+				--data_len;
+			} else {
+				is_for_us = 1;
+			}
 			break;
 		case MULTICAST:
 			{
@@ -443,8 +803,6 @@ static void neighbor_recv(struct abc_conn *bc) {
 				rimeaddr_t *to = (rimeaddr_t*)mp->data;
 				int i;
 				for (i = 0; i < mp->num_ids; ++i) {
-					LOG("Multicast to: %d.%d\n", to->u8[0],
-							to->u8[1]);
 					if (rimeaddr_cmp(to++, &rimeaddr_node_addr)) {
 						uint8_t ids_size = sizeof(rimeaddr_t)*mp->num_ids;
 						data = mp->data + ids_size;
@@ -459,8 +817,6 @@ static void neighbor_recv(struct abc_conn *bc) {
 		case UNICAST:
 			{
 				const struct unicast_packet *up = (struct unicast_packet*)p;
-				LOG("Unicast packet: ");
-				DEBUG_UNICAST_PACKET(up);
 				if (rimeaddr_cmp(&up->destination, &rimeaddr_node_addr)) {
 					is_for_us = 1;
 					data = up->data;
@@ -472,80 +828,42 @@ static void neighbor_recv(struct abc_conn *bc) {
 			ASSERT(0);
 	}
 
-	LOG("data: ");
-	print_packet_data(data, data_len);
-
-	if (is_for_us && neighbors_is_neighbor(c->ns, &p->hdr.sender)) {
-		if (IS_PACKET_FLAG_SET(p, ACK)) {
-			struct buffered_packet *bp;
-
-			LOG("[NEIGHBOR ACK RECV] ");
-			DEBUG_PACKET(p);
+	if (is_for_us && nn != NULL) {
+		/* Data packet */
+		int8_t send_ack = 1;
+		int8_t is_dupe = 0;
 
-			bp = packet_buffer_find_buffered_packet(&c->sq, p, originator_seqno_cmp);
+		if (dupe_cache_has(&c->dc, &p->hdr.originator, p->hdr.seqno)) {
+			/* dupe packet */
+			TRACE_PACKET(TRACE_EC_DUPE, p->hdr.flags, p);
+			is_dupe = 1;
+			++c->stats.dupes;
 
-			if (bp != NULL) {
-				packet_buffer_neighbor_acked(bp, &p->hdr.sender);
-				if (packet_buffer_all_neighbors_acked(bp)) {
-					LOG("Every neighbor acked packet.\n");
-					packet_buffer_free(&c->sq, bp);
-					/* send next neighbor packet */
-					ctimer_set(&c->neighbor_data_timer,
-							FAST_TRANSMIT, send_neighbor_data, c);
-				}
-			} else {
-				LOG("Recived ack for non-sent packet\n");
-			}
 		} else {
-			/* Data packet */
-			int8_t send_ack = 1;
-			int8_t is_dupe = 0;
-
-			struct slim_packet *sp = (struct slim_packet*)
-				queue_buffer_find(&c->dq, p, slim_packet_to_packet_cmp);
-			if (sp != NULL) {
-				/* dupe packet */
-				LOG("[NEIGHBOR DATA RECV DUPE] ");
-				DEBUG_PACKET(p);
-				is_dupe = 1;
+			TRACE_PACKET(TRACE_EC_RECV, p->hdr.flags, p);
+		}
 
+		if (!is_dupe) {
+			/* check if we have atleast room for three packets (one ack,
+			 * one forward request from user, one data packet from user) */
+			if(packet_buffer_has_room_for_packets(&c->sq, 3)) {
+				rx_begin(c, p, data, data_len);
+				c->cb->neighbor_recv(c, &p->hdr.originator, &p->hdr.sender,
+						p->hdr.hops, p->hdr.seqno, data, data_len);
+				rx_end(c);
+				store_packet_for_dupe_checks(c, p);
+				++c->stats.received;
 			} else {
-				LOG("[NEIGHBOR DATA RECV] ");
-				DEBUG_PACKET(p);
-			}
-
-			if (!is_dupe) {
-				/* check if we have atleast room for three packets (one ack,
-				 * one forward request from user, one data packet from user) */
-				if(packet_buffer_has_room_for_packets(&c->sq, 3)) {
-					c->cb->neighbor_recv(c, &p->hdr.originator, &p->hdr.sender,
-							p->hdr.hops, p->hdr.seqno, data, data_len);
-					store_packet_for_dupe_checks(c, p);
-				} else {
-					LOG("Packet buffer overflowing. Dropping packet\n");
-					send_ack = 0;
-				}
+				TRACE_PACKET(TRACE_EC_OVERFLOW, p->hdr.flags, p);
+				++c->stats.overflows;
+				send_ack = 0;
 			}
+		}
 
-			if (send_ack) {
-				/* Make ACK packet. */
-				struct unicast_packet ap;
-				init_unicast_packet(&ap, ACK, 0, &p->hdr.originator,
-						&rimeaddr_node_addr, p->hdr.seqno, &p->hdr.sender);
-				if (packet_buffer_find_buffered_packet(&c->sq,
-							(struct packet*)&ap, unicast_packet_cmp) == NULL) {
-					packet_buffer_unicast_packet(&c->sq, &ap, NULL, 0, NULL,
-							MSG_TYPE_NEIGHBOR_ACK);
-					ctimer_set(&c->neighbor_ack_timer,
-							FAST_TRANSMIT_ACK, send_neighbor_ack, c);
-				} else {
-					LOG("Found ack in sending queue already\n");
-				}
-			}
+		if (send_ack) {
+			queue_ack(c, MSG_TYPE_NEIGHBOR_ACK, &p->hdr.sender,
+					&p->hdr.originator, p->hdr.seqno);
 		}
-	} else {
-		LOG("NOT FOR US OR NOT A NEIGHBOR: ");
-		DEBUG_PACKET(p);
 	}
 }
 
@@ -557,9 +875,20 @@ static void broadcast_recv(struct abc_conn *bc) {
 	int8_t is_for_us = 0;
 	int8_t mc = 0;
 	int8_t uc = 0;
+	const struct ack_entry *acks;
+	uint8_t len = packetbuf_datalen();
+	uint8_t num_acks = packet_acks(p, &len, &acks);
+
 
-	TRACE("[BC/MC/UC RECV] ");
-	DEBUG_PACKET(p);
+	/* strip piggybacked acks */
+	packetbuf_set_datalen(len);
+	if (num_acks > 0) {
+		handle_acks(c, &p->hdr.sender, acks, num_acks,
+				MSG_TYPE_MULTICAST_UNICAST_DATA);
+	}
+	if (IS_PACKET_FLAG_SET(p, ACK)) {
+		return;
+	}
 
 	switch(PACKET_TYPE(p)) {
 		case BROADCAST:
@@ -573,8 +902,6 @@ static void broadcast_recv(struct abc_conn *bc) {
 				rimeaddr_t *to = (rimeaddr_t*)mp->data;
 				int i;
 				for (i = 0; i < mp->num_ids; ++i) {
-					LOG("Multicast to: %d.%d\n", to->u8[0],
-							to->u8[1]);
 					if (rimeaddr_cmp(to++, &rimeaddr_node_addr)) {
 						uint8_t ids_size = sizeof(rimeaddr_t)*mp->num_ids;
 						data = mp->data + ids_size;
@@ -590,8 +917,6 @@ static void broadcast_recv(struct abc_conn *bc) {
 		case UNICAST:
 			{
 				const struct unicast_packet *up = (struct unicast_packet*)p;
-				LOG("Unicast packet: ");
-				DEBUG_UNICAST_PACKET(up);
 				if (rimeaddr_cmp(&up->destination, &rimeaddr_node_addr)) {
 					is_for_us = 1;
 					data = up->data;
@@ -606,84 +931,50 @@ static void broadcast_recv(struct abc_conn *bc) {
 
 
 	if (is_for_us) {
-		TRACE("data: ");
-		print_packet_data(data, data_len);
-		if (IS_PACKET_FLAG_SET(p, ACK)) {
-			struct buffered_packet *bp;
-
-			LOG("[MULTICAST_UNICAST ACK RECV] ");
-			DEBUG_PACKET(p);
-
-			bp = packet_buffer_find_buffered_packet(&c->sq, p, originator_seqno_cmp);
-
-			if (bp != NULL) {
-				packet_buffer_neighbor_acked(bp, &p->hdr.sender);
-				if (packet_buffer_all_neighbors_acked(bp)) {
-					LOG("Every multicast/unicast neighbor acked packet.\n");
-					packet_buffer_free(&c->sq, bp);
-					/* send next neighbor packet */
-					ctimer_set(&c->multicast_unicast_data_timer,
-							FAST_TRANSMIT, send_multicast_unicast_data, c);
-				}
-			} else {
-				LOG("Recived ack for non-sent packet\n");
+		/* Data packet */
+		int8_t send_ack = 1;
+		int8_t is_dupe = 0;
+
+		if (dupe_cache_has(&c->dc, &p->hdr.originator, p->hdr.seqno)) {
+			/* dupe packet */
+			TRACE_PACKET(TRACE_EC_DUPE, p->hdr.flags, p);
+			is_dupe = 1;
+			++c->stats.dupes;
+			if (!mc && !uc) {
+				trickle_heard(c, p);
 			}
-		} else {
-			/* Data packet */
-			int8_t send_ack = 1;
-			int8_t is_dupe = 0;
-
-			struct slim_packet *sp = (struct slim_packet*)
-				queue_buffer_find(&c->dq, p, slim_packet_to_packet_cmp);
-			if (sp != NULL) {
-				/* dupe packet */
-				LOG("[BC/MC/UC DATA RECV DUPE] ");
-				DEBUG_PACKET(p);
-				is_dupe = 1;
 
-			} else {
-				LOG("[BC/MC/UC DATA RECV] ");
-				DEBUG_PACKET(p);
-			}
+		} else {
+			TRACE_PACKET(TRACE_EC_RECV, p->hdr.flags, p);
+		}
 
-			if (!is_dupe) {
-				/* check if we have atleast room for three packets (one ack,
-				 * one forward request from user, one data packet from user) */
-				if(packet_buffer_has_room_for_packets(&c->sq, 3)) {
-					if (mc || uc) {
-						c->cb->multicast_unicast_recv(c, &p->hdr.originator, &p->hdr.sender,
-								p->hdr.hops, p->hdr.seqno, data, data_len);
-					} else {
-						/* broadcast */
-						c->cb->broadcast_recv(c, &p->hdr.originator, &p->hdr.sender,
-								p->hdr.hops, p->hdr.seqno, data, data_len);
-					}
-					store_packet_for_dupe_checks(c, p);
+		if (!is_dupe) {
+			/* check if we have atleast room for three packets (one ack,
+			 * one forward request from user, one data packet from user) */
+			if(packet_buffer_has_room_for_packets(&c->sq, 3)) {
+				rx_begin(c, p, data, data_len);
+				if (mc || uc) {
+					c->cb->multicast_unicast_recv(c, &p->hdr.originator, &p->hdr.sender,
+							p->hdr.hops, p->hdr.seqno, data, data_len);
 				} else {
-					LOG("Packet buffer overflowing. Dropping packet\n");
-					send_ack = 0;
+					/* broadcast */
+					c->cb->broadcast_recv(c, &p->hdr.originator, &p->hdr.sender,
+							p->hdr.hops, p->hdr.seqno, data, data_len);
 				}
+				rx_end(c);
+				store_packet_for_dupe_checks(c, p);
+				++c->stats.received;
+			} else {
+				TRACE_PACKET(TRACE_EC_OVERFLOW, p->hdr.flags, p);
+				++c->stats.overflows;
+				send_ack = 0;
 			}
+		}
 
-			if (send_ack && (mc || uc)) {
-				struct unicast_packet ap;
-				init_unicast_packet(&ap, ACK, 0, &p->hdr.originator,
-						&rimeaddr_node_addr, p->hdr.seqno, &p->hdr.sender);
-				if (packet_buffer_find_buffered_packet(&c->sq,
-							(struct packet*)&ap, unicast_packet_cmp) == NULL) {
-					LOG("Making ACK\n");
-					packet_buffer_unicast_packet(&c->sq, &ap, NULL, 0, NULL,
-							MSG_TYPE_MULTICAST_UNICAST_ACK);
-					ctimer_set(&c->multicast_unicast_ack_timer,
-							FAST_TRANSMIT_ACK, send_multicast_unicast_ack, c);
-				} else {
-					LOG("Found ack in sending queue already\n");
-				}
-			}
+		if (send_ack && (mc || uc)) {
+			queue_ack(c, MSG_TYPE_MULTICAST_UNICAST_ACK, &p->hdr.sender,
+					&p->hdr.originator, p->hdr.seqno);
 		}
-	} else {
-		LOG("NOT FOR US: ");
-		DEBUG_PACKET(p);
 	}
 }
 
@@ -696,15 +987,13 @@ void ec_reliable_broadcast_ns(struct ec *c, const rimeaddr_t *originator,
 
 		init_broadcast_packet(&bp, 0, hops, originator, sender, seqno);
 
-		packet_buffer_broadcast_packet(&c->sq, &bp, data, data_len, c->ns,
-				MSG_TYPE_NEIGHBOR_DATA);
+		is_buffered(c, MSG_TYPE_NEIGHBOR_DATA,
+				packet_buffer_broadcast_packet(&c->sq, &bp, data, data_len, c->ns,
+					MSG_TYPE_NEIGHBOR_DATA));
 
 		store_packet_for_dupe_checks(c, (struct packet*)&bp);
 
-		if (ctimer_expired(&c->neighbor_data_timer)) {
-			ctimer_set(&c->neighbor_data_timer,
-					FAST_TRANSMIT, send_neighbor_data, c);
-		}
+		sched_queued(c, MSG_TYPE_NEIGHBOR_DATA, FAST_TRANSMIT);
 	}
 }
 
@@ -716,14 +1005,64 @@ void ec_broadcast(struct ec *c, const rimeaddr_t *originator,
 
 	init_broadcast_packet(&bp, 0, hops, originator, sender, seqno);
 
-	packet_buffer_broadcast_packet(&c->sq, &bp, data, data_len, c->ns,
-			MSG_TYPE_BROADCAST_DATA);
+	is_buffered(c, MSG_TYPE_BROADCAST_DATA,
+			packet_buffer_broadcast_packet(&c->sq, &bp, data, data_len, c->ns,
+				MSG_TYPE_BROADCAST_DATA));
 
 	store_packet_for_dupe_checks(c, (struct packet*)&bp);
 
-	if (ctimer_expired(&c->broadcast_data_timer)) {
-		ctimer_set(&c->broadcast_data_timer,
-				FAST_TRANSMIT, send_broadcast_data, c);
+	sched_queued(c, MSG_TYPE_BROADCAST_DATA, FAST_TRANSMIT);
+}
+
+void ec_trickle(struct ec *c, const rimeaddr_t *originator,
+		const rimeaddr_t *sender, uint8_t hops, uint8_t seqno, const void *data,
+		uint8_t data_len) {
+
+	struct broadcast_packet bp;
+
+	init_broadcast_packet(&bp, 0, hops, originator, sender, seqno);
+
+	if (!is_buffered(c, MSG_TYPE_TRICKLE_DATA,
+				packet_buffer_broadcast_packet(&c->sq, &bp, data, data_len, NULL,
+					MSG_TYPE_TRICKLE_DATA))) {
+		return;
+	}
+
+	store_packet_for_dupe_checks(c, (struct packet*)&bp);
+	trickle_queued(c);
+}
+
+void ec_forward(struct ec *c, uint8_t type) {
+	const struct neighbors *ns = NULL;
+	struct buffered_packet *b;
+	ASSERT(c->rx.p != NULL);
+	ASSERT(type == MSG_TYPE_NEIGHBOR_DATA || type == MSG_TYPE_BROADCAST_DATA ||
+			type == MSG_TYPE_TRICKLE_DATA);
+
+	if (type == MSG_TYPE_NEIGHBOR_DATA) {
+		if (neighbors_size(c->ns) == 0) {
+			return;
+		}
+		ns = c->ns;
+	}
+
+	if (c->rx.forwarded != NULL) {
+		b = packet_buffer_share(&c->sq, c->rx.forwarded, ns, type);
+	} else {
+		b = packet_buffer_forward_packet(&c->sq, c->rx.p, c->rx.data,
+				c->rx.data_len, &rimeaddr_node_addr, ns, type);
+	}
+	if (!is_buffered(c, type, b)) {
+		return;
+	}
+	c->rx.forwarded = b;
+
+	TRACE_PACKET(TRACE_EC_FORWARD, type, packet_buffer_get_packet(b));
+
+	if (type == MSG_TYPE_TRICKLE_DATA) {
+		trickle_queued(c);
+	} else {
+		sched_queued(c, type, FAST_TRANSMIT);
 	}
 }
 
@@ -735,15 +1074,13 @@ void ec_reliable_multicast(struct ec *c, const struct neighbors *receivers,
 
 	init_broadcast_packet(&bp, 0, hops, originator, sender, seqno);
 
-	packet_buffer_broadcast_packet(&c->sq, &bp, data, data_len, receivers,
-			MSG_TYPE_MULTICAST_UNICAST_DATA);
+	is_buffered(c, MSG_TYPE_MULTICAST_UNICAST_DATA,
+			packet_buffer_broadcast_packet(&c->sq, &bp, data, data_len, receivers,
+				MSG_TYPE_MULTICAST_UNICAST_DATA));
 
 	store_packet_for_dupe_checks(c, (struct packet*)&bp);
 
-	if (ctimer_expired(&c->multicast_unicast_data_timer)) {
-		ctimer_set(&c->multicast_unicast_data_timer,
-				FAST_TRANSMIT, send_multicast_unicast_data, c);
-	}
+	sched_queued(c, MSG_TYPE_MULTICAST_UNICAST_DATA, FAST_TRANSMIT);
 }
 
 void ec_reliable_unicast(struct ec *c, const rimeaddr_t *destination, const
@@ -751,22 +1088,19 @@ void ec_reliable_unicast(struct ec *c, const rimeaddr_t *destination, const
 		seqno, const void *data, uint8_t data_len) {
 
 	struct broadcast_packet bp;
-
-	struct neighbors ns;
-	neighbors_init(&ns);
-	neighbors_add(&ns, destination);
+	struct buffered_packet *b;
 
 	init_broadcast_packet(&bp, 0, hops, originator, sender, seqno);
 
-	packet_buffer_broadcast_packet(&c->sq, &bp, data, data_len, &ns,
+	b = packet_buffer_broadcast_packet(&c->sq, &bp, data, data_len, NULL,
 			MSG_TYPE_MULTICAST_UNICAST_DATA);
+	if (is_buffered(c, MSG_TYPE_MULTICAST_UNICAST_DATA, b)) {
+		packet_buffer_add_unacked_neighbor(b, destination);
+	}
 
 	store_packet_for_dupe_checks(c, (struct packet*)&bp);
 
-	if (ctimer_expired(&c->multicast_unicast_data_timer)) {
-		ctimer_set(&c->multicast_unicast_data_timer,
-				FAST_TRANSMIT, send_multicast_unicast_data, c);
-	}
+	sched_queued(c, MSG_TYPE_MULTICAST_UNICAST_DATA, FAST_TRANSMIT);
 }
 
 void ec_mesh(struct ec *c, const rimeaddr_t *destination, uint8_t seqno, 
@@ -777,13 +1111,11 @@ void ec_mesh(struct ec *c, const rimeaddr_t *destination, uint8_t seqno,
 	init_unicast_packet(&up, 0, 0, &rimeaddr_null,
 			&rimeaddr_null, seqno, destination);
 
-	packet_buffer_unicast_packet(&c->sq, &up, data, data_len, NULL,
-			MSG_TYPE_MESH_DATA);
+	is_buffered(c, MSG_TYPE_MESH_DATA,
+			packet_buffer_unicast_packet(&c->sq, &up, data, data_len, NULL,
+				MSG_TYPE_MESH_DATA));
 
-	if (ctimer_expired(&c->mesh_data_timer)) {
-		ctimer_set(&c->mesh_data_timer,
-				MESH_TRANSMIT, send_mesh_data, c);
-	}
+	sched_queued(c, MSG_TYPE_MESH_DATA, MESH_TRANSMIT);
 }
 
 static void meshdata_recv(struct mesh_conn *bc, const rimeaddr_t *from, 
@@ -793,8 +1125,7 @@ static void meshdata_recv(struct mesh_conn *bc, const rimeaddr_t *from,
 		(struct mesh_packet*)packetbuf_dataptr();
 
 	uint8_t data_len = packetbuf_datalen() - MESH_PACKET_HDR_SIZE;
-	TRACE("[MESH RECV]\n");
-	print_packet_data((uint8_t*)mp, packetbuf_datalen());
+	TRACE_EVENT(TRACE_EC_RECV, 0, TRACE_ADDR(from), mp->seqno);
 
 	c->cb->mesh(c, from, hops, mp->seqno, mp->data, data_len);
 }
@@ -807,15 +1138,15 @@ static void meshdata_sent(struct mesh_conn *bc) {
 	LOG("Mesh sent OK\n");
 	packet_buffer_free(&c->sq, bp);
 
-	ctimer_set(&c->mesh_data_timer,
-			FAST_TRANSMIT, send_mesh_data, c);
+	sched_set(c, MSG_TYPE_MESH_DATA, FAST_TRANSMIT);
+	sched_update(c);
 }
 
 static void meshdata_timeout(struct mesh_conn *bc) {
 	struct ec *c = (struct ec*)((char*)bc-offsetof(struct ec, meshdata_conn));
 	LOG("Mesh timed-out\n");
-	ctimer_set(&c->mesh_data_timer,
-			FAST_TRANSMIT, send_mesh_data, c);
+	sched_set(c, MSG_TYPE_MESH_DATA, FAST_TRANSMIT);
+	sched_update(c);
 }
 
 static void timesynch_as_leader(void *ptr) {
@@ -830,10 +1161,11 @@ static void timesynch_as_leader(void *ptr) {
 	LOG("[TIMESYNCH AS LEADER]: ");
 	DEBUG_PACKET(&bp);
 
-	packet_buffer_broadcast_packet(&c->sq, &bp, NULL, 0, NULL,
-			MSG_TYPE_TIMESYNCH_DATA);
+	is_buffered(c, MSG_TYPE_TIMESYNCH_DATA,
+			packet_buffer_broadcast_packet(&c->sq, &bp, NULL, 0, NULL,
+				MSG_TYPE_TIMESYNCH_DATA));
 
-	ctimer_set(&c->timesynch_data_timer, FAST_TRANSMIT, send_timesynch_data, c);
+	sched_queued(c, MSG_TYPE_TIMESYNCH_DATA, FAST_TRANSMIT);
 	ctimer_set(&c->ts.timer, TIMESYNCH_LEADER_UPDATE, timesynch_as_leader, c);
 	
 	c->cb->timesynch(c);
@@ -867,11 +1199,11 @@ static void timesynch_recv(struct abc_conn *bc) {
 				LOG("New leader. Forwarding timesynch packet: ");
 				DEBUG_PACKET(&bp);
 
-				packet_buffer_broadcast_packet(&c->sq, &bp, NULL, 0, NULL,
-						MSG_TYPE_TIMESYNCH_DATA);
+				is_buffered(c, MSG_TYPE_TIMESYNCH_DATA,
+						packet_buffer_broadcast_packet(&c->sq, &bp, NULL, 0, NULL,
+							MSG_TYPE_TIMESYNCH_DATA));
 
-				ctimer_set(&c->timesynch_data_timer, FAST_TRANSMIT,
-						send_timesynch_data, c);
+				sched_queued(c, MSG_TYPE_TIMESYNCH_DATA, FAST_TRANSMIT);
 				ctimer_set(&c->ts.timer, TIMESYNCH_LEADER_TIMEOUT, timesynch_as_leader, c);
 			}
 
@@ -889,10 +1221,11 @@ static void timesynch_recv(struct abc_conn *bc) {
 				LOG("Forwarding timesynch packet: ");
 				DEBUG_PACKET(&bp);
 
-				packet_buffer_broadcast_packet(&c->sq, &bp, NULL, 0, NULL,
-						MSG_TYPE_TIMESYNCH_DATA);
+				is_buffered(c, MSG_TYPE_TIMESYNCH_DATA,
+						packet_buffer_broadcast_packet(&c->sq, &bp, NULL, 0, NULL,
+							MSG_TYPE_TIMESYNCH_DATA));
 
-				ctimer_set(&c->timesynch_data_timer, FAST_TRANSMIT, send_timesynch_data, c);
+				sched_queued(c, MSG_TYPE_TIMESYNCH_DATA, FAST_TRANSMIT);
 				ctimer_set(&c->ts.timer, TIMESYNCH_LEADER_TIMEOUT, timesynch_as_leader, c);
 
 				c->cb->timesynch(c);
@@ -922,8 +1255,15 @@ void ec_open(struct ec *c, uint16_t data_channel,
 	abc_open(&c->broadcast_conn, data_channel+2, &broadcast_cb);
 	mesh_open(&c->meshdata_conn, data_channel+3, &meshdata_cb);
 
-	PACKET_BUFFER_INIT_WITH_STRUCT(c, sq, SENDING_QUEUE_LENGTH);
-	QUEUE_BUFFER_INIT_WITH_STRUCT(c, dq, SLIM_PACKET_SIZE, DUPE_QUEUE_LENGTH);
+	PACKET_BUFFER_INIT_WITH_STRUCT(c, sq, SENDING_QUEUE_LENGTH,
+			SENDING_POOL_SIZE);
+	ctimer_stop(&c->sched.timer);
+	memset(&c->sched, 0, sizeof(c->sched));
+	/* trickle packets are released by the trickle timer */
+	sched_block(c, MSG_TYPE_TRICKLE_DATA);
+	ec_stats_clear(c);
+	dupe_cache_init(&c->dc);
+	rx_end(c);
 
 	c->ts.is_on = 0;
 
@@ -932,16 +1272,22 @@ void ec_open(struct ec *c, uint16_t data_channel,
 
 void ec_close(struct ec *c) {
 	LOG("CLOSING rfnr\n");
+	ctimer_stop(&c->sched.timer);
+	ctimer_stop(&c->tr.timer);
 	abc_close(&c->neighbor_conn);
 	abc_close(&c->timesynch_conn);
 	abc_close(&c->broadcast_conn);
 	mesh_close(&c->meshdata_conn);
 }
 
-void ec_set_neighbors(struct ec *c, const struct neighbors *ns) {
+void ec_set_neighbors(struct ec *c, struct neighbors *ns) {
 	c->ns = ns;
 }
 
+void ec_stats_clear(struct ec *c) {
+	memset(&c->stats, 0, sizeof(c->stats));
+}
+
 void ec_timesynch_network(struct ec *c) {
 	ASSERT(c->ts.is_on == 1);
 	if(ctimer_expired(&c->ts.timer)) {
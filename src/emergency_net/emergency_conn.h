@@ -12,9 +12,57 @@
 
 #include "emergency_net/packet_buffer.h"
 #include "emergency_net/neighbors.h"
+#include "emergency_net/dupe_cache.h"
+
+/* Queue entries and the packets they share. A packet buffered for several
+ * types, or relayed again before it went out, takes one packet and an entry
+ * per type. */
+#define SENDING_QUEUE_LENGTH 16
+#define SENDING_POOL_SIZE 12
+
+#define EC_ACKS_PER_PACKET 4
+
+#define EC_TRICKLE_K 1
+#define EC_TRICKLE_ROUNDS 2
+
+/* Send classes, one per packet buffer type. ACKs and timesynch are sent
+ * before anything else, the data types share the radio by weight. */
+enum {
+	MSG_TYPE_NEIGHBOR_ACK = PACKET_BUFFER_TYPE_ZERO,
+	MSG_TYPE_NEIGHBOR_DATA = PACKET_BUFFER_TYPE_ZERO+1,
+	MSG_TYPE_BROADCAST_DATA = PACKET_BUFFER_TYPE_ZERO+2,
+	MSG_TYPE_MULTICAST_UNICAST_ACK = PACKET_BUFFER_TYPE_ZERO+3,
+	MSG_TYPE_MULTICAST_UNICAST_DATA = PACKET_BUFFER_TYPE_ZERO+4,
+	MSG_TYPE_TIMESYNCH_DATA = PACKET_BUFFER_TYPE_ZERO+5,
+	MSG_TYPE_MESH_DATA = PACKET_BUFFER_TYPE_ZERO+6,
+	MSG_TYPE_TRICKLE_DATA = PACKET_BUFFER_TYPE_ZERO+7
+};
+
+struct ec_class_stats {
+	uint16_t sent; /* frames handed to the radio */
+	uint16_t busy; /* sends refused because the channel was busy */
+	uint16_t piggybacked; /* packets that went out inside another type's frame */
+	uint16_t first_sends; /* packets sent for the first time */
+	uint16_t retransmits; /* sends of packets sent before */
+	uint16_t drops; /* packets not buffered, the queue was full */
+	uint16_t give_ups; /* packets dropped unacked after too many sends */
+	uint32_t wait_sum; /* clock ticks from queueing to first send */
+	clock_time_t max_wait;
+	uint8_t max_depth;
+};
 
-#define SENDING_QUEUE_LENGTH 12
-#define DUPE_QUEUE_LENGTH 24
+#define EC_RTT_BUCKETS 8
+/* Bucket 0 holds ACK round trips below this, every next one up to twice
+ * that of the one before, the last everything longer. */
+#define EC_RTT_BUCKET0 (CLOCK_SECOND/16)
+
+struct ec_stats {
+	struct ec_class_stats classes[PACKET_BUFFER_MAX_TYPES];
+	uint16_t received; /* data packets handed to the callbacks */
+	uint16_t dupes; /* data packets received again, dropped */
+	uint16_t overflows; /* data packets dropped for want of queue room */
+	uint16_t ack_rtt[EC_RTT_BUCKETS]; /* of packets acked after one send */
+};
 
 struct ec;
 typedef void (*ec_callback_data_t)(struct ec *c, 
@@ -38,19 +86,21 @@ struct ec {
 	struct abc_conn broadcast_conn;
 	struct mesh_conn meshdata_conn;
 
-	struct ctimer neighbor_ack_timer;
-	struct ctimer neighbor_data_timer;
-	struct ctimer broadcast_data_timer;
-	struct ctimer multicast_unicast_data_timer;
-	struct ctimer multicast_unicast_ack_timer;
-	struct ctimer timesynch_data_timer;
-	struct ctimer mesh_data_timer;
+	PACKET_BUFFER(sq, SENDING_QUEUE_LENGTH, SENDING_POOL_SIZE);
+
+	struct {
+		struct ctimer timer;
+		clock_time_t ready_at[PACKET_BUFFER_MAX_TYPES];
+		int8_t credit[PACKET_BUFFER_MAX_TYPES]; /* weighted round robin */
+		uint8_t blocked; /* bit per type waiting on an event, not the clock */
+		clock_time_t last_tx;
+	} sched; /* transmit scheduler, sends every type in sq */
 
-	PACKET_BUFFER(sq, SENDING_QUEUE_LENGTH);
+	struct ec_stats stats;
 
-	QUEUE_BUFFER(dq, SLIM_PACKET_SIZE, DUPE_QUEUE_LENGTH);
+	struct dupe_cache dc;
 
-	const struct neighbors *ns;
+	struct neighbors *ns;
 
 	struct {
 		struct ctimer timer;
@@ -58,6 +108,20 @@ struct ec {
 		int8_t is_on;
 	} ts; /* time synch */
 
+	struct {
+		struct ctimer timer;
+		clock_time_t interval;
+		clock_time_t remaining; /* of the interval after transmitting */
+		uint8_t rounds; /* intervals done */
+	} tr; /* trickle */
+
+	struct {
+		const struct packet *p; /* in packetbuf */
+		const void *data;
+		uint8_t data_len;
+		struct buffered_packet *forwarded; /* by ec_forward, to be shared */
+	} rx; /* the packet being handed to a data callback */
+
 	const struct ec_callbacks *cb;
 };
 
@@ -66,7 +130,7 @@ void ec_open(struct ec *c, uint16_t data_channel,
 
 void ec_close(struct ec *c);
 
-void ec_set_neighbors(struct ec *c, const struct neighbors *ns);
+void ec_set_neighbors(struct ec *c, struct neighbors *ns);
 
 /* reliable in-order broadcast to neighbors */
 void ec_reliable_broadcast_ns(struct ec *c, const rimeaddr_t *originator, 
@@ -78,6 +142,21 @@ void ec_broadcast(struct ec *c, const rimeaddr_t *originator,
 		const rimeaddr_t *sender, uint8_t hops, uint8_t seqno, const void *data,
 		uint8_t data_len);
 
+/* best effort flood to everyone, with trickle suppression. The packet is
+ * broadcast once in each of EC_TRICKLE_ROUNDS doubling intervals, except in
+ * intervals where EC_TRICKLE_K copies of it have already been heard. */
+void ec_trickle(struct ec *c, const rimeaddr_t *originator,
+		const rimeaddr_t *sender, uint8_t hops, uint8_t seqno, const void *data,
+		uint8_t data_len);
+
+/* Sends on the packet being received, from within its data callback, one hop
+ * further and with us as sender: as MSG_TYPE_NEIGHBOR_DATA (like
+ * ec_reliable_broadcast_ns), MSG_TYPE_BROADCAST_DATA (ec_broadcast) or
+ * MSG_TYPE_TRICKLE_DATA (ec_trickle). The frame is copied once, straight into
+ * the sending queue, and forwarding it again as another type shares that
+ * copy. */
+void ec_forward(struct ec *c, uint8_t type);
+
 void ec_reliable_multicast(struct ec *c, const struct neighbors *receivers, const
 		rimeaddr_t *originator, const rimeaddr_t *sender, uint8_t hops, uint8_t
 		seqno, const void *data, uint8_t data_len);
@@ -92,4 +171,33 @@ void ec_mesh(struct ec *c, const rimeaddr_t *destination,
 void ec_timesynch_on(struct ec *c);
 void ec_timesynch_off(struct ec *c);
 void ec_timesynch_network(struct ec *c);
+
+/* Packets of a MSG_TYPE_* waiting in the sending queue. */
+static
+uint8_t ec_queue_depth(const struct ec *c, uint8_t type);
+
+static
+const struct ec_class_stats* ec_class_stats(const struct ec *c, uint8_t type);
+
+static
+const struct ec_stats* ec_stats(const struct ec *c);
+
+void ec_stats_clear(struct ec *c);
+
+/************************* Inline Definitions **************************/
+
+static inline
+uint8_t ec_queue_depth(const struct ec *c, uint8_t type) {
+	return packet_buffer_num_packets_of_type(&c->sq, type);
+}
+
+static inline
+const struct ec_class_stats* ec_class_stats(const struct ec *c, uint8_t type) {
+	return &c->stats.classes[type];
+}
+
+static inline
+const struct ec_stats* ec_stats(const struct ec *c) {
+	return &c->stats;
+}
 #endif
@@ -0,0 +1,95 @@
+#include "emergency_net/metric_heap.h"
+
+#include "base/log.h"
+
+#define KEY(mh, i) ((mh)->metric[(mh)->heap[i]])
+
+static void swap(struct metric_heap *mh, uint8_t i, uint8_t j) {
+	uint8_t s = mh->heap[i];
+	mh->heap[i] = mh->heap[j];
+	mh->heap[j] = s;
+	mh->pos[mh->heap[i]] = i;
+	mh->pos[mh->heap[j]] = j;
+}
+
+static void sift_up(struct metric_heap *mh, uint8_t i) {
+	while (i > 0 && KEY(mh, (i-1)/2) > KEY(mh, i)) {
+		swap(mh, i, (i-1)/2);
+		i = (i-1)/2;
+	}
+}
+
+static void sift_down(struct metric_heap *mh, uint8_t i) {
+	for (;;) {
+		uint8_t min = i;
+		uint8_t l = 2*i+1;
+		uint8_t r = 2*i+2;
+		if (l < MAX_NEIGHBORS && KEY(mh, l) < KEY(mh, min)) {
+			min = l;
+		}
+		if (r < MAX_NEIGHBORS && KEY(mh, r) < KEY(mh, min)) {
+			min = r;
+		}
+		if (min == i) {
+			return;
+		}
+		swap(mh, i, min);
+		i = min;
+	}
+}
+
+void metric_heap_init(struct metric_heap *mh) {
+	uint8_t i;
+	for (i = 0; i < MAX_NEIGHBORS; ++i) {
+		mh->metric[i] = METRIC_T_MAX;
+		mh->heap[i] = i;
+		mh->pos[i] = i;
+	}
+}
+
+void metric_heap_set(struct metric_heap *mh, uint8_t slot, metric_t metric) {
+	metric_t old;
+	ASSERT(slot < MAX_NEIGHBORS);
+
+	old = mh->metric[slot];
+	mh->metric[slot] = metric;
+	if (metric < old) {
+		sift_up(mh, mh->pos[slot]);
+	} else if (metric > old) {
+		sift_down(mh, mh->pos[slot]);
+	}
+}
+
+uint8_t metric_heap_best(const struct metric_heap *mh, uint8_t *slots,
+		uint8_t k) {
+	/* heap positions whose parents have been taken */
+	uint8_t frontier[MAX_NEIGHBORS];
+	uint8_t num_frontier = 1;
+	uint8_t n = 0;
+
+	frontier[0] = 0;
+	while (n < k && num_frontier > 0) {
+		uint8_t min = 0;
+		uint8_t i;
+		for (i = 1; i < num_frontier; ++i) {
+			if (KEY(mh, frontier[i]) < KEY(mh, frontier[min])) {
+				min = i;
+			}
+		}
+		i = frontier[min];
+		if (KEY(mh, i) == METRIC_T_MAX) {
+			break;
+		}
+
+		slots[n++] = mh->heap[i];
+		frontier[min] = frontier[--num_frontier];
+		if (2*i+1 < MAX_NEIGHBORS) {
+			frontier[num_frontier++] = 2*i+1;
+		}
+		if (2*i+2 < MAX_NEIGHBORS) {
+			frontier[num_frontier++] = 2*i+2;
+		}
+	}
+
+	return n;
+}
@@ -0,0 +1,45 @@
+/* Keeps a metric per neighbor table slot in a binary min-heap, so the slot
+ * with the lowest metric is found in constant time and changing one slot's
+ * metric costs O(log MAX_NEIGHBORS). Every slot is always in the heap; slots
+ * that are not candidates hold METRIC_T_MAX. */
+#ifndef _METRIC_HEAP_H_
+#define _METRIC_HEAP_H_
+
+#include "emergency_net/neighbors.h"
+
+struct metric_heap {
+	metric_t metric[MAX_NEIGHBORS]; /* by slot */
+	uint8_t heap[MAX_NEIGHBORS]; /* slots, lowest metric first */
+	uint8_t pos[MAX_NEIGHBORS]; /* of every slot in heap */
+};
+
+void metric_heap_init(struct metric_heap *mh);
+
+void metric_heap_set(struct metric_heap *mh, uint8_t slot, metric_t metric);
+
+/* Fills slots with the up to k slots of the lowest metrics, lowest first, and
+ * returns how many there are. Slots holding METRIC_T_MAX are left out. Costs
+ * O(k^2), without touching the heap. */
+uint8_t metric_heap_best(const struct metric_heap *mh, uint8_t *slots,
+		uint8_t k);
+
+static
+metric_t metric_heap_metric(const struct metric_heap *mh, uint8_t slot);
+
+/* Returns the slot with the lowest metric, or -1 if every slot holds
+ * METRIC_T_MAX. */
+static
+int8_t metric_heap_min(const struct metric_heap *mh);
+
+/************************* Inline Definitions **************************/
+
+static inline
+metric_t metric_heap_metric(const struct metric_heap *mh, uint8_t slot) {
+	return mh->metric[slot];
+}
+
+static inline
+int8_t metric_heap_min(const struct metric_heap *mh) {
+	return mh->metric[mh->heap[0]] == METRIC_T_MAX ? -1 : (int8_t)mh->heap[0];
+}
+#endif
@@ -1,4 +1,5 @@
 #include "emergency_net/neighbor_node.h"
 
 
-const struct neighbor_node_best_path neighbor_node_best_path_max = {{0xFF,0xFF}, {{0,0}}, 0x00};
+const struct neighbor_node_best_path neighbor_node_best_path_max = {{0xFF,0xFF}, {{0,0}}, 0x00,
+	{{0,0}}, 0x00};
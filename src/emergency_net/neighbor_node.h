@@ -6,16 +6,33 @@
 
 #include "base/util.h"
 
+#include "string.h"
+
 typedef uint16_t metric_t;
 #define METRIC_T_MAX 0xFFFF
 
 typedef uint16_t distance_t;
 #define DISTANCE_T_MAX 0xFFFF
 
+/* ETX is fixed point with 4 fraction bits, so a perfect link is 16 and the
+ * worst representable 15.9 */
+#define ETX_ONE 16
+#define ETX_MAX 0xFF
+
+/* CC2420 LQI (correlation) of a clean frame and of one near the
+ * sensitivity limit */
+#define LQI_GOOD 105
+#define LQI_BAD 55
+
+/* Paths carry a sequence number, as in DSDV, issued by the exit they lead
+ * to. Exits advance it by two, and a node that lost its path advertises the
+ * odd number after it along with METRIC_T_MAX. */
 struct neighbor_node_best_path {
 	uint8_t metric[2]; /* to nearest exit from neighbor */
 	rimeaddr_t points_to;
 	uint8_t hops; /* to nearest exit from neighbor */
+	rimeaddr_t exit; /* the path leads to */
+	uint8_t seqno;
 };
 
 struct neighbor_node {
@@ -24,6 +41,11 @@ struct neighbor_node {
 	uint8_t distance[2]; /* to neighbor. So we dont have to calculate it every time */
 	struct neighbor_node_best_path bp;
 	uint8_t has_sent_keep_alive; /* issued when the neighbor is not responding */
+	/* ACK round trip estimate in clock ticks, 0 until the first sample */
+	uint16_t srtt; /* smoothed, times 8 */
+	uint16_t rttvar; /* mean deviation, times 4 */
+	uint8_t etx; /* from sends per ACK, 0 until the first sample */
+	uint8_t lqi; /* smoothed LQI of frames heard from it, 0 if none */
 };
 
 extern const struct neighbor_node_best_path neighbor_node_best_path_max;
@@ -50,6 +72,16 @@ int neighbor_node_points_to_us(const struct neighbor_node *nn);
 static
 uint8_t neighbor_node_hops(const struct neighbor_node *nn);
 
+static
+const rimeaddr_t* neighbor_node_exit(const struct neighbor_node *nn);
+
+static
+uint8_t neighbor_node_seqno(const struct neighbor_node *nn);
+
+/* Non zero if path seqno a is newer than b. Seqnos wrap. */
+static
+int neighbor_node_seqno_newer(uint8_t a, uint8_t b);
+
 static
 distance_t neighbor_node_distance(const struct neighbor_node *nn);
 
@@ -63,6 +95,28 @@ int neighbor_node_has_sent_keep_alive(const struct neighbor_node *nn);
 static
 void neighbor_node_set_has_sent_keep_alive(struct neighbor_node *nn, int8_t i);
 
+/* Folds an ACK round trip into the estimate, as in TCP (RFC 6298). */
+static
+void neighbor_node_add_rtt_sample(struct neighbor_node *nn, uint16_t rtt);
+
+/* srtt+4*rttvar in clock ticks, 0 if there is no estimate yet */
+static
+uint16_t neighbor_node_rto(const struct neighbor_node *nn);
+
+/* Folds in that a packet took sends transmissions to be acked, or was given
+ * up on after that many. */
+static
+void neighbor_node_add_tx_sample(struct neighbor_node *nn, uint8_t sends);
+
+static
+void neighbor_node_add_lqi_sample(struct neighbor_node *nn, uint8_t lqi);
+
+/* Expected transmissions per acked packet, in ETX_ONE units. Until ACKs
+ * have been counted it is guessed from LQI, and without that assumed
+ * perfect. */
+static
+uint8_t neighbor_node_etx(const struct neighbor_node *nn);
+
 
 /* inline definitions */
 
@@ -76,6 +130,53 @@ int neighbor_node_has_sent_keep_alive(const struct neighbor_node *nn) {
 	return nn->has_sent_keep_alive;
 }
 
+static inline
+void neighbor_node_add_rtt_sample(struct neighbor_node *nn, uint16_t rtt) {
+	/* keep srtt from overflowing and from meaning no estimate */
+	rtt = rtt > 0x1FFF ? 0x1FFF : rtt == 0 ? 1 : rtt;
+	if (nn->srtt == 0) {
+		nn->srtt = rtt << 3;
+		nn->rttvar = rtt << 1;
+	} else {
+		int16_t err = (int16_t)(rtt - (nn->srtt >> 3));
+		nn->srtt += err;
+		if (err < 0) {
+			err = -err;
+		}
+		nn->rttvar += err - (nn->rttvar >> 2);
+	}
+}
+
+static inline
+uint16_t neighbor_node_rto(const struct neighbor_node *nn) {
+	return (nn->srtt >> 3) + nn->rttvar;
+}
+
+static inline
+void neighbor_node_add_tx_sample(struct neighbor_node *nn, uint8_t sends) {
+	uint8_t etx = sends < ETX_MAX/ETX_ONE ? sends*ETX_ONE : ETX_MAX;
+	/* the window of a moving average over about four packets */
+	nn->etx = nn->etx == 0 ? etx : (uint8_t)((3*(uint16_t)nn->etx+etx)/4);
+}
+
+static inline
+void neighbor_node_add_lqi_sample(struct neighbor_node *nn, uint8_t lqi) {
+	nn->lqi = nn->lqi == 0 ? lqi : (uint8_t)((7*(uint16_t)nn->lqi+lqi)/8);
+}
+
+static inline
+uint8_t neighbor_node_etx(const struct neighbor_node *nn) {
+	if (nn->etx != 0) {
+		return nn->etx;
+	} else if (nn->lqi == 0 || nn->lqi >= LQI_GOOD) {
+		return ETX_ONE;
+	} else if (nn->lqi <= LQI_BAD) {
+		return 4*ETX_ONE;
+	}
+	/* linear from 1 at LQI_GOOD to 4 at LQI_BAD */
+	return ETX_ONE+3*ETX_ONE*(LQI_GOOD-nn->lqi)/(LQI_GOOD-LQI_BAD);
+}
+
 static inline
 const rimeaddr_t* neighbor_node_addr(const struct neighbor_node *nn) {
 	return &nn->addr;
@@ -124,6 +225,21 @@ uint8_t neighbor_node_hops(const struct neighbor_node *nn) {
 	return nn->bp.hops;
 }
 
+static inline
+const rimeaddr_t* neighbor_node_exit(const struct neighbor_node *nn) {
+	return &nn->bp.exit;
+}
+
+static inline
+uint8_t neighbor_node_seqno(const struct neighbor_node *nn) {
+	return nn->bp.seqno;
+}
+
+static inline
+int neighbor_node_seqno_newer(uint8_t a, uint8_t b) {
+	return (int8_t)(a - b) > 0;
+}
+
 static inline
 distance_t neighbor_node_distance(const struct neighbor_node *nn) {
 	uint16_t dist16;
@@ -1,60 +1,65 @@
 #include "emergency_net/neighbors.h"
 
 #include "stddef.h" /* NULL */
+#include "string.h"
 
 #include "base/log.h"
 
 void neighbors_init(struct neighbors *ns) {
-	QUEUE_BUFFER_INIT_WITH_STRUCT(ns, nbuf, sizeof(struct neighbor_node), MAX_NEIGHBORS);
-}
-
-static int neighbor_to_addr_cmp(const void *lhs, const void *rhs) {
-	struct neighbor_node *l = (struct neighbor_node*) lhs;
-	rimeaddr_t *r = (rimeaddr_t*) rhs;
-	return rimeaddr_cmp(&l->addr, r);
+	neighbors_clear(ns);
 }
 
 void neighbors_add(struct neighbors *ns, const rimeaddr_t *addr) {
-	struct neighbor_node nn;
-	memset(&nn, 0, sizeof(struct neighbor_node));
-	neighbor_node_set_addr(&nn, addr);
-	neighbor_node_set_best_path(&nn, &neighbor_node_best_path_max);
-	neighbor_node_set_has_sent_keep_alive(&nn, 1);
-
-	{
-		struct neighbor_node *ret = 
-			(struct neighbor_node*)queue_buffer_push_front(&ns->nbuf, &nn);
-		ASSERT(ret != NULL);
+	uint8_t i = neighbors_lower_bound(ns, addr);
+	struct neighbor_node *nn;
+	uint8_t slot;
+
+	if (i < ns->size && rimeaddr_cmp(&ns->nodes[ns->order[i]].addr, addr)) {
+		return;
 	}
+	if (ns->size == MAX_NEIGHBORS) {
+		LOG("Neighbor table full, dropping %d.%d\n", addr->u8[0], addr->u8[1]);
+		return;
+	}
+
+	slot = ns->order[ns->size];
+	memmove(&ns->order[i+1], &ns->order[i], ns->size-i);
+	ns->order[i] = slot;
+	++ns->size;
+
+	nn = &ns->nodes[slot];
+	memset(nn, 0, sizeof(struct neighbor_node));
+	neighbor_node_set_addr(nn, addr);
+	neighbor_node_set_best_path(nn, &neighbor_node_best_path_max);
+	neighbor_node_set_has_sent_keep_alive(nn, 1);
 }
 
 void neighbors_remove(struct neighbors *ns, const rimeaddr_t *addr) {
-	struct neighbor_node *nn = (struct neighbor_node*)
-		queue_buffer_find(&ns->nbuf, addr, neighbor_to_addr_cmp);
-	if (nn != NULL) {
-		queue_buffer_free(&ns->nbuf, nn);
+	uint8_t i = neighbors_lower_bound(ns, addr);
+	uint8_t slot;
+
+	if (i == ns->size || !rimeaddr_cmp(&ns->nodes[ns->order[i]].addr, addr)) {
+		return;
 	}
-}
 
-int neighbors_is_neighbor(const struct neighbors *ns, const rimeaddr_t *addr) {
-	return queue_buffer_find((struct queue_buffer*)&ns->nbuf, addr,
-			neighbor_to_addr_cmp) != NULL;
+	slot = ns->order[i];
+	--ns->size;
+	memmove(&ns->order[i], &ns->order[i+1], ns->size-i);
+	ns->order[ns->size] = slot;
 }
 
 /*void neighbors_warn(struct neighbors *ns, const rimeaddr_t *addr) {
-	struct neighbor_node *nn = (struct neighbor_node*)
-		queue_buffer_find(&ns->nbuf, addr, neighbor_to_addr_cmp);
+	struct neighbor_node *nn = neighbors_find_neighbor_node(ns, addr);
 	ASSERT(nn != NULL);
 	++nn->warnings;
 	LOG("Neighbor %d.%d warnings: %d\n", nn->addr.u8[0], nn->addr.u8[1], nn->warnings);
 }*/
 
-struct neighbor_node* 
-neighbors_find_neighbor_node(struct neighbors *ns, const rimeaddr_t *addr) {
-	return (struct neighbor_node*)queue_buffer_find(&ns->nbuf, addr, neighbor_to_addr_cmp);
-}
-
 void neighbors_clear(struct neighbors *ns) {
-	queue_buffer_clear(&ns->nbuf);
-	ASSERT(queue_buffer_begin(&ns->nbuf) == NULL);
+	uint8_t i;
+	for (i = 0; i < MAX_NEIGHBORS; ++i) {
+		ns->order[i] = i;
+	}
+	ns->size = 0;
+	ns->iterator = 0;
 }
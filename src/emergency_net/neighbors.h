@@ -1,3 +1,7 @@
+/* The neighbor table is a dense array of neighbor_nodes, sized at build time
+ * by MAX_NEIGHBORS, plus an index of the slots in use sorted by address.
+ * Lookups are an inline binary search over the index, and nodes never move
+ * once added, so pointers to them stay valid until they are removed. */
 #ifndef _NEIGHBORS_H_
 #define _NEIGHBORS_H_
 
@@ -6,53 +10,121 @@
 
 #include "emergency_net/neighbor_node.h"
 
-#include "base/queue_buffer.h"
-
+/* Neighbors are learned from the setup packet, which has room for 6 or 7
+ * (SETUP_MAX_NEIGHBORS in main_reg_sensor.c). Every buffered packet and the
+ * metric heap are sized by this too, so it is kept just above that. */
+#ifndef MAX_NEIGHBORS
 #define MAX_NEIGHBORS 8
+#endif
 
 struct neighbors {
-	QUEUE_BUFFER(nbuf, sizeof(struct neighbor_node), MAX_NEIGHBORS);
+	struct neighbor_node nodes[MAX_NEIGHBORS];
+	/* The first size entries index the nodes in use, by ascending address.
+	 * The rest index the free ones. */
+	uint8_t order[MAX_NEIGHBORS];
+	uint8_t size;
+	uint8_t iterator;
 };
 
 void neighbors_init(struct neighbors *ns);
 
+/* Adding a neighbor twice keeps the first one. */
 void neighbors_add(struct neighbors *ns, const rimeaddr_t *addr);
 void neighbors_remove(struct neighbors *ns, const rimeaddr_t *addr);
 
+static
 int neighbors_is_neighbor(const struct neighbors *ns, const rimeaddr_t *addr);
 
 static
 uint8_t neighbors_size(const struct neighbors *ns); 
 
+/* Iterate in ascending address order. */
 static
 const struct neighbor_node* neighbors_begin(const struct neighbors *ns);
 
 static
 const struct neighbor_node* neighbors_next(const struct neighbors *ns);
 
+static
 struct neighbor_node* 
 neighbors_find_neighbor_node(struct neighbors *ns, const rimeaddr_t *addr);
 
+/* The slot of a neighbor, which it keeps until removed, and back */
+static
+uint8_t neighbors_slot(const struct neighbors *ns, const struct neighbor_node *nn);
+
+static
+struct neighbor_node* neighbors_node_at(struct neighbors *ns, uint8_t slot);
+
+/* Returns the position in order of the first neighbor whose address is not
+ * less than addr. */
+static
+uint8_t neighbors_lower_bound(const struct neighbors *ns, const rimeaddr_t *addr);
+
 /*void neighbors_warn(struct neighbors *ns, const rimeaddr_t *addr);*/
 
 void neighbors_clear(struct neighbors *ns);
 
 /************************* Inline Definitions **************************/
 
+static inline
+uint8_t neighbors_lower_bound(const struct neighbors *ns, const rimeaddr_t *addr) {
+	uint16_t key = (uint16_t)addr->u8[0] << 8 | addr->u8[1];
+	uint8_t lo = 0;
+	uint8_t hi = ns->size;
+	while (lo < hi) {
+		uint8_t mid = (lo+hi)/2;
+		const rimeaddr_t *m = &ns->nodes[ns->order[mid]].addr;
+		if (((uint16_t)m->u8[0] << 8 | m->u8[1]) < key) {
+			lo = mid+1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+static inline
+struct neighbor_node* 
+neighbors_find_neighbor_node(struct neighbors *ns, const rimeaddr_t *addr) {
+	uint8_t i = neighbors_lower_bound(ns, addr);
+	if (i < ns->size && rimeaddr_cmp(&ns->nodes[ns->order[i]].addr, addr)) {
+		return &ns->nodes[ns->order[i]];
+	}
+	return NULL;
+}
+
+static inline
+int neighbors_is_neighbor(const struct neighbors *ns, const rimeaddr_t *addr) {
+	return neighbors_find_neighbor_node((struct neighbors*)ns, addr) != NULL;
+}
+
+static inline
+uint8_t neighbors_slot(const struct neighbors *ns, const struct neighbor_node *nn) {
+	return (uint8_t)(nn - ns->nodes);
+}
+
+static inline
+struct neighbor_node* neighbors_node_at(struct neighbors *ns, uint8_t slot) {
+	return &ns->nodes[slot];
+}
+
 static inline
 uint8_t neighbors_size(const struct neighbors *ns) {
-	return queue_buffer_size(&ns->nbuf);
+	return ns->size;
 }
 
 static inline
 const struct neighbor_node* neighbors_begin(const struct neighbors *ns) {
-	return (const struct neighbor_node*)queue_buffer_begin((struct
-				queue_buffer*)&ns->nbuf);
+	((struct neighbors*)ns)->iterator = 0;
+	return neighbors_next(ns);
 }
 
 static inline
 const struct neighbor_node* neighbors_next(const struct neighbors *ns) {
-	return (const struct neighbor_node*)queue_buffer_next((struct
-				queue_buffer*)&ns->nbuf);
+	if (ns->iterator >= ns->size) {
+		return NULL;
+	}
+	return &ns->nodes[ns->order[((struct neighbors*)ns)->iterator++]];
 }
 #endif
@@ -17,12 +17,39 @@ int unicast_packet_cmp(const void *queued_item, const void *supplied_item) {
 	return memcmp(queued_item, supplied_item, UNICAST_PACKET_HDR_SIZE) == 0;
 }
 
-int slim_packet_to_packet_cmp(const void *queued_item, const void *supplied_item) {
-	const struct slim_packet *l = (struct slim_packet*)queued_item;
-	const struct packet *r = (struct packet*)supplied_item;
+uint8_t packet_neighbor_bit(const rimeaddr_t *addr) {
+	/* Fibonacci hashing spreads the evenly strided addresses of a building
+	 * plan over the bits. */
+	uint16_t a = addr->u8[0] | (uint16_t)addr->u8[1] << 8;
+	return 1 << ((uint16_t)(a*40503u) >> 13);
+}
+
+uint8_t packet_acks(const struct packet *p, uint8_t *len,
+		const struct ack_entry **acks) {
+	uint8_t num_acks = 0;
+
+	if (IS_PACKET_FLAG_SET(p, ACK)) {
+		if (*len < BROADCAST_PACKET_HDR_SIZE) {
+			return 0;
+		}
+		num_acks = (*len - BROADCAST_PACKET_HDR_SIZE)/ACK_ENTRY_SIZE;
+		if (num_acks > MAX_ACK_ENTRIES) {
+			num_acks = MAX_ACK_ENTRIES;
+		}
+		*acks = (const struct ack_entry*)p->data;
+	} else if (IS_PACKET_FLAG_SET(p, ACKS)) {
+		if (*len < PACKET_HDR_SIZE+1) {
+			return 0;
+		}
+		num_acks = ((const uint8_t*)p)[*len-1];
+		if (1+num_acks*ACK_ENTRY_SIZE > *len-PACKET_HDR_SIZE) {
+			return 0;
+		}
+		*len -= 1+num_acks*ACK_ENTRY_SIZE;
+		*acks = (const struct ack_entry*)((const uint8_t*)p+*len);
+	}
 
-	return rimeaddr_cmp(&l->originator, &r->hdr.originator) && 
-		l->seqno == r->hdr.seqno;
+	return num_acks;
 }
 
 void init_packet(struct packet *p, uint8_t flags,
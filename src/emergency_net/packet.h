@@ -14,7 +14,9 @@
 #define MULTICAST_PACKET_HDR_SIZE (sizeof(struct multicast_packet)-sizeof(uint8_t))
 #define UNICAST_PACKET_HDR_SIZE (sizeof(struct unicast_packet)-sizeof(uint8_t))
 #define MESH_PACKET_HDR_SIZE (sizeof(struct mesh_packet)-sizeof(uint8_t))
-#define SLIM_PACKET_SIZE (sizeof(struct slim_packet))
+#define ACK_ENTRY_SIZE (sizeof(struct ack_entry))
+/* that fit in an ACK packet */
+#define MAX_ACK_ENTRIES ((MAX_PACKET_SIZE-BROADCAST_PACKET_HDR_SIZE)/ACK_ENTRY_SIZE)
 
 #define DEBUG_PACKET(p) LOG("type:%x, hops: %d, o:%d.%d, s:%d.%d, seqno:%d\n", \
 			(p)->hdr.flags, (p)->hdr.hops,  \
@@ -28,8 +30,10 @@
 			(p)->hdr.seqno)
 
 enum packet_flags {
-	ACK = 0x80,
+	ACK = 0x80, /* data is a list of ack_entry */
 	TIMESYNCH = 0x40,
+	ACKS = 0x08, /* ack_entry list and its length trail the data */
+	MISSING = 0x04, /* data starts with a mask of neighbors yet to ack */
 
 	BROADCAST = 0x30,
 	UNICAST = 0x20,
@@ -66,16 +70,18 @@ struct unicast_packet {
 	uint8_t data[1];
 };
 
-/* used in mesh_conn */
-struct mesh_packet {
+/* Acknowledges originator's seqno, received from the neighbor to. Several
+ * are sent in one ACK packet or piggybacked on a data packet. */
+struct ack_entry {
+	rimeaddr_t to;
+	rimeaddr_t originator;
 	uint8_t seqno;
-	uint8_t data[1];
 };
 
-/*used for long term storing for dupe checking */
-struct slim_packet {
-	rimeaddr_t originator;
+/* used in mesh_conn */
+struct mesh_packet {
 	uint8_t seqno;
+	uint8_t data[1];
 };
 
 void init_packet(struct packet *p, uint8_t flags,
@@ -99,5 +105,13 @@ int originator_seqno_cmp(const void *queued_item, const void *supplied_item);
 
 int unicast_packet_cmp(const void *queued_item, const void *supplied_item);
 
-int slim_packet_to_packet_cmp(const void *queued_item, const void *supplied_item);
+/* Returns the bit standing for addr in a MISSING mask. Neighbors may share
+ * a bit, which only costs them a redundant ACK. */
+uint8_t packet_neighbor_bit(const rimeaddr_t *addr);
+
+/* Returns the number of ack entries the len bytes long packet p carries and
+ * points *acks at the first. For a packet with piggybacked acks, *len is
+ * shortened to exclude them. */
+uint8_t packet_acks(const struct packet *p, uint8_t *len,
+		const struct ack_entry **acks);
 #endif
@@ -18,11 +18,86 @@ void add_buffered_packet_tail(struct buffered_packet **head,
 	}
 }
 
+/* A new packet in the pool, with no references yet. */
+static struct pooled_packet*
+allocate_pooled_packet(struct packet_buffer *pb, uint8_t hdr_size,
+		const void *hdr, const void *data, uint8_t data_len) {
+	struct pooled_packet *pp =
+		(struct pooled_packet*)queue_buffer_alloc_front(pb->pool);
+	ASSERT(hdr_size+data_len < MAX_PACKET_SIZE);
+	if (pp != NULL) {
+		pp->refs = 0;
+		pp->data_len = data_len;
+		memcpy(&pp->p, hdr, hdr_size);
+		memcpy((uint8_t*)&pp->p+hdr_size, data, data_len);
+	}
+	return pp;
+}
+
+static void release_pooled_packet(struct packet_buffer *pb,
+		struct pooled_packet *pp) {
+	ASSERT(pp->refs > 0);
+	if (--pp->refs == 0) {
+		queue_buffer_free(pb->pool, pp);
+	}
+}
+
+/* A buffered broadcast packet with the same header and data */
+static struct pooled_packet*
+find_pooled_packet(struct packet_buffer *pb, const struct broadcast_packet *bp,
+		const void *data, uint8_t data_len) {
+	struct pooled_packet *pp;
+	for (pp = (struct pooled_packet*)queue_buffer_begin(pb->pool); pp != NULL;
+			pp = (struct pooled_packet*)queue_buffer_next(pb->pool)) {
+		if (pp->data_len == data_len &&
+				memcmp(&pp->p, bp, BROADCAST_PACKET_HDR_SIZE) == 0 &&
+				memcmp(pp->p.data, data, data_len) == 0) {
+			return pp;
+		}
+	}
+	return NULL;
+}
+
+static inline 
+void copy_neighbors(struct buffered_packet *bp, const struct neighbors *ns) {
+	const struct neighbor_node *nn;
+	bp->num_unacked_ns = 0;
+	if (ns == NULL) {
+		return;
+	}
+	for(nn = neighbors_begin(ns); nn != NULL; nn = neighbors_next(ns)) {
+		rimeaddr_copy(&bp->unacked_ns[bp->num_unacked_ns++],
+				neighbor_node_addr(nn));
+	}
+}
+
 static struct buffered_packet* 
-allocate_buffered_packet(struct packet_buffer *pb, int prio) {
-	struct buffered_packet *s = (struct
-			buffered_packet*)queue_buffer_alloc_front(pb->buffer);
+allocate_buffered_packet(struct packet_buffer *pb, struct pooled_packet *pp,
+		const struct neighbors *ns, int prio) {
+	struct buffered_packet *s;
+	if (pp == NULL) {
+		LOG("WARNING: Queue FULL. Dropping packet\n");
+		return NULL;
+	}
+
+	s = (struct buffered_packet*)queue_buffer_alloc_front(pb->buffer);
+	if (s == NULL) {
+		/* a new packet goes back to the pool */
+		if (pp->refs == 0) {
+			queue_buffer_free(pb->pool, pp);
+		}
+		LOG("WARNING: Queue FULL. Dropping packet\n");
+		return NULL;
+	}
+
 	add_buffered_packet_tail(&pb->prio_heads[prio], s);
+	++pb->num_packets[prio];
+	s->queued_at = clock_time();
+	s->times_sent = 0;
+	s->copies_heard = 0;
+	copy_neighbors(s, ns);
+	s->pp = pp;
+	++pp->refs;
 	return s;
 }
 
@@ -30,87 +105,57 @@ void packet_buffer_init(struct packet_buffer *pb) {
 	int i;
 	for (i = 0; i < PACKET_BUFFER_MAX_TYPES; ++i) {
 		pb->prio_heads[i] = NULL;
+		pb->num_packets[i] = 0;
 	}
 }
 
-static inline 
-void copy_neighbors(struct buffered_packet *bp, const struct neighbors *ns) {
-	const struct neighbor_node *nn = neighbors_begin(ns);
-	for(; nn != NULL; nn = neighbors_next(ns)) {
-		queue_buffer_push_front(&bp->unacked_ns, neighbor_node_addr(nn));
-	}
-}
-
-
 struct buffered_packet*
 packet_buffer_packet(struct packet_buffer *pb, const struct packet *p, 
 		const void *data, uint8_t data_len, const struct neighbors *ns, 
 		int prio) {
-	struct buffered_packet *s = allocate_buffered_packet(pb, prio);
-
-	if (s != NULL) {
-		if (ns != NULL) {
-			QUEUE_BUFFER_INIT_WITH_STRUCT(s, unacked_ns, sizeof(rimeaddr_t), neighbors_size(ns));
-			copy_neighbors(s, ns);
-		}
-		s->times_sent = 0;
-		s->data_len = data_len;
-		ASSERT(PACKET_HDR_SIZE+data_len < MAX_PACKET_SIZE);
-		memcpy(&s->p, p, PACKET_HDR_SIZE);
-		memcpy(s->p.data, data, data_len);
-		return s;
-	}
-
-	LOG("WARNING: Queue FULL. Dropping packet\n");
-	return NULL;
+	return allocate_buffered_packet(pb, allocate_pooled_packet(pb,
+				PACKET_HDR_SIZE, p, data, data_len), ns, prio);
 }
 
 struct buffered_packet*
 packet_buffer_broadcast_packet(struct packet_buffer *pb, 
 		const struct broadcast_packet *bp, const void *data, uint8_t data_len,
 		const struct neighbors *ns, int prio) {
-	struct buffered_packet *s = allocate_buffered_packet(pb, prio);
-
-	if (s != NULL) {
-		struct broadcast_packet *tmp = (struct broadcast_packet*)&s->p;
-		if (ns != NULL) {
-			QUEUE_BUFFER_INIT_WITH_STRUCT(s, unacked_ns, sizeof(rimeaddr_t), neighbors_size(ns));
-			copy_neighbors(s, ns);
-		}
-		s->times_sent = 0;
-		s->data_len = data_len;
-		ASSERT(BROADCAST_PACKET_HDR_SIZE+data_len < MAX_PACKET_SIZE);
-		memcpy(tmp, bp, BROADCAST_PACKET_HDR_SIZE);
-		memcpy(tmp->data, data, data_len);
-		return s;
-	} 
-
-	LOG("WARNING: Queue FULL. Dropping packet\n");
-	return NULL;
+	struct pooled_packet *pp = find_pooled_packet(pb, bp, data, data_len);
+	if (pp == NULL) {
+		pp = allocate_pooled_packet(pb, BROADCAST_PACKET_HDR_SIZE, bp, data,
+				data_len);
+	}
+	return allocate_buffered_packet(pb, pp, ns, prio);
 }
 
 struct buffered_packet*
 packet_buffer_unicast_packet(struct packet_buffer *pb, 
 		const struct unicast_packet *up, const void *data, uint8_t data_len,
 		const struct neighbors *ns,int prio) {
-	struct buffered_packet *s = allocate_buffered_packet(pb, prio);
+	return allocate_buffered_packet(pb, allocate_pooled_packet(pb,
+				UNICAST_PACKET_HDR_SIZE, up, data, data_len), ns, prio);
+}
 
-	if (s != NULL) {
-		struct unicast_packet *tmp = (struct unicast_packet*)&s->p;
-		if (ns != NULL) {
-			QUEUE_BUFFER_INIT_WITH_STRUCT(s, unacked_ns, sizeof(rimeaddr_t), neighbors_size(ns));
-			copy_neighbors(s, ns);
-		}
-		s->times_sent = 0;
-		s->data_len = data_len;
-		ASSERT(UNICAST_PACKET_HDR_SIZE+data_len < MAX_PACKET_SIZE);
-		memcpy(tmp, up, UNICAST_PACKET_HDR_SIZE);
-		memcpy(tmp->data, data, data_len);
-		return s;
-	} 
-
-	LOG("WARNING: Queue FULL. Dropping packet\n");
-	return NULL;
+struct buffered_packet*
+packet_buffer_forward_packet(struct packet_buffer *pb, const struct packet *p,
+		const void *data, uint8_t data_len, const rimeaddr_t *sender,
+		const struct neighbors *ns, int prio) {
+	struct pooled_packet *pp = allocate_pooled_packet(pb,
+			BROADCAST_PACKET_HDR_SIZE, p, data, data_len);
+	if (pp != NULL) {
+		/* only the forwarder and hops change, the rest is as received */
+		pp->p.hdr.flags = BROADCAST;
+		rimeaddr_copy(&pp->p.hdr.sender, sender);
+		++pp->p.hdr.hops;
+	}
+	return allocate_buffered_packet(pb, pp, ns, prio);
+}
+
+struct buffered_packet*
+packet_buffer_share(struct packet_buffer *pb, struct buffered_packet *bp,
+		const struct neighbors *ns, int type) {
+	return allocate_buffered_packet(pb, bp->pp, ns, type);
 }
 
 /*struct buffered_packet*
@@ -142,7 +187,7 @@ packet_buffer_find_buffered_packet(struct packet_buffer *pb, const struct packet
 	struct buffered_packet *bp;
 	for(i = 0; i < PACKET_BUFFER_MAX_TYPES; ++i) {
 		for(bp = pb->prio_heads[i]; bp != NULL; bp = bp->next) {
-			if (comparer(&bp->p, p)) {
+			if (comparer(&bp->pp->p, p)) {
 				return bp;
 			}
 		}
@@ -151,15 +196,45 @@ packet_buffer_find_buffered_packet(struct packet_buffer *pb, const struct packet
 	return NULL;
 }
 
+struct buffered_packet*
+packet_buffer_find_buffered_packet_from_type(struct packet_buffer *pb,
+		uint8_t type, const struct packet* p,
+		int (*comparer)(const void *buffered_item, const void *supplied_item)) {
+
+	struct buffered_packet *bp;
+	for(bp = pb->prio_heads[type]; bp != NULL; bp = bp->next) {
+		if (comparer(&bp->pp->p, p)) {
+			return bp;
+		}
+	}
+
+	return NULL;
+}
+
+int packet_buffer_append_data(struct buffered_packet *bp, const void *data,
+		uint8_t data_len) {
+	struct pooled_packet *pp = bp->pp;
+	if (pp->refs > 1 ||
+			PACKET_HDR_SIZE+pp->data_len+data_len >= MAX_PACKET_SIZE) {
+		return 0;
+	}
+
+	memcpy(pp->p.data+pp->data_len, data, data_len);
+	pp->data_len += data_len;
+	return 1;
+}
+
 void packet_buffer_clear_priority(struct packet_buffer *pb, int prio) {
 	struct buffered_packet *i = pb->prio_heads[prio];
 	struct buffered_packet *next;
 	for(;i != NULL; i = next) {
 		next = i->next;
+		release_pooled_packet(pb, i->pp);
 		queue_buffer_free(pb->buffer, i);
 	}
 
 	pb->prio_heads[prio] = NULL;
+	pb->num_packets[prio] = 0;
 }
 
 void packet_buffer_free(struct packet_buffer *pb, struct buffered_packet *bp) {
@@ -177,7 +252,9 @@ void packet_buffer_free(struct packet_buffer *pb, struct buffered_packet *bp) {
 				else
 					s_prev->next = s->next;
 
+				release_pooled_packet(pb, s->pp);
 				queue_buffer_free(pb->buffer, s);
+				--pb->num_packets[i];
 				return;
 			} 
 
@@ -1,40 +1,62 @@
 #ifndef _PACKET_BUFFER_H_
 #define _PACKET_BUFFER_H_
 
+#include "sys/clock.h"
+
 #include "emergency_net/packet.h"
 #include "emergency_net/neighbors.h"
 
 #include "base/queue_buffer.h"
+#include "base/log.h"
 
 /* XXX: change name to packet_send_buffer or something */
 
 #define PACKET_BUFFER_TYPE_ZERO 0
-#define PACKET_BUFFER_MAX_TYPES 7
+#define PACKET_BUFFER_MAX_TYPES 8
 
-#define BUFFERED_PACKET_HDR_SIZE (sizeof(struct buffered_packet)-sizeof(uint8_t))
+#define POOLED_PACKET_HDR_SIZE (sizeof(struct pooled_packet)-sizeof(uint8_t))
 
-#define PACKET_BUFFER(name, num_packets) \
-	QUEUE_BUFFER(name##_qbuffer, BUFFERED_PACKET_HDR_SIZE+MAX_PACKET_SIZE, num_packets); \
+/* num_packets queue entries sharing num_payloads packets */
+#define PACKET_BUFFER(name, num_packets, num_payloads) \
+	QUEUE_BUFFER(name##_qbuffer, sizeof(struct buffered_packet), num_packets); \
+	QUEUE_BUFFER(name##_pool, POOLED_PACKET_HDR_SIZE+MAX_PACKET_SIZE, num_payloads); \
 	struct packet_buffer name
 
-#define PACKET_BUFFER_INIT_WITH_STRUCT(s, name, num_packets) \
-	QUEUE_BUFFER_INIT_WITH_STRUCT((s), name##_qbuffer, BUFFERED_PACKET_HDR_SIZE+MAX_PACKET_SIZE, num_packets); \
+#define PACKET_BUFFER_INIT_WITH_STRUCT(s, name, num_packets, num_payloads) \
+	QUEUE_BUFFER_INIT_WITH_STRUCT((s), name##_qbuffer, sizeof(struct buffered_packet), num_packets); \
+	QUEUE_BUFFER_INIT_WITH_STRUCT((s), name##_pool, POOLED_PACKET_HDR_SIZE+MAX_PACKET_SIZE, num_payloads); \
 	(s)->name.buffer = &(s)->name##_qbuffer; \
+	(s)->name.pool = &(s)->name##_pool; \
 	packet_buffer_init(&(s)->name)
-	
+
+/* A packet in the pool, referenced by refs queue entries. */
+struct pooled_packet {
+	uint8_t refs;
+	uint8_t data_len;
+	struct packet p;
+};
+
+/* A queue entry. The packet is shared with the entries of the same packet in
+ * other types, everything else is the entry's own. */
 struct buffered_packet {
 	struct buffered_packet *next;
 	/* Neighbors who are still to ack the packet */
-	QUEUE_BUFFER(unacked_ns, sizeof(rimeaddr_t), MAX_NEIGHBORS);
+	rimeaddr_t unacked_ns[MAX_NEIGHBORS];
+	uint8_t num_unacked_ns;
+	uint8_t unacked_ns_iterator;
 	uint8_t times_sent; 
-	uint8_t data_len; 
+	uint8_t copies_heard; /* sent by other nodes */
+	clock_time_t queued_at;
+	clock_time_t sent_at;
 	/*void (*send_fn)(void *ptr);*/
-	struct packet p;
+	struct pooled_packet *pp;
 };
 
 struct packet_buffer {
 	struct buffered_packet *prio_heads[PACKET_BUFFER_MAX_TYPES];
-	struct queue_buffer *buffer;
+	uint8_t num_packets[PACKET_BUFFER_MAX_TYPES];
+	struct queue_buffer *buffer; /* of struct buffered_packet */
+	struct queue_buffer *pool; /* of struct pooled_packet */
 };
 
 void packet_buffer_init(struct packet_buffer *pb);
@@ -44,6 +66,8 @@ packet_buffer_packet(struct packet_buffer *pb, const struct packet *p,
 		const void *data, uint8_t data_len, const struct neighbors *ns
 		/*void (*send_fn)(void *ptr)*/, int type);
 
+/* A packet equal to one buffered already is not copied, the buffered one is
+ * shared. */
 struct buffered_packet*
 packet_buffer_broadcast_packet(struct packet_buffer *pb, 
 		const struct broadcast_packet *bp, const void *data, uint8_t data_len,
@@ -54,8 +78,25 @@ packet_buffer_unicast_packet(struct packet_buffer *pb,
 		const struct unicast_packet *up, const void *data, uint8_t data_len,
 		const struct neighbors *ns/*, void (*send_fn)(void *ptr)*/, int type);
 
+/* Buffers a received broadcast packet p as sent on by sender, one hop
+ * further. data may lie anywhere in the received frame. */
+struct buffered_packet*
+packet_buffer_forward_packet(struct packet_buffer *pb, const struct packet *p,
+		const void *data, uint8_t data_len, const rimeaddr_t *sender,
+		const struct neighbors *ns, int type);
+
+/* Buffers bp's packet as type too, without copying it. */
+struct buffered_packet*
+packet_buffer_share(struct packet_buffer *pb, struct buffered_packet *bp,
+		const struct neighbors *ns, int type);
+
+static
+void packet_buffer_add_unacked_neighbor(struct buffered_packet *bp,
+		const rimeaddr_t *addr);
+
+/* Returns 0 if addr was not among the neighbors still to ack. */
 static
-void packet_buffer_neighbor_acked(struct buffered_packet *bp, const rimeaddr_t *addr);
+int packet_buffer_neighbor_acked(struct buffered_packet *bp, const rimeaddr_t *addr);
 
 static
 int packet_buffer_num_unacked_neighbors(struct buffered_packet *bp);
@@ -75,15 +116,38 @@ uint8_t packet_buffer_times_sent(const struct buffered_packet *bp);
 static
 uint8_t packet_buffer_data_len(const struct buffered_packet *bp);
 
+/* Queue entries referencing bp's packet */
+static
+uint8_t packet_buffer_refs(const struct buffered_packet *bp);
+
+/* clock_time() when the packet was buffered */
+static
+clock_time_t packet_buffer_queued_at(const struct buffered_packet *bp);
+
+/* clock_time() when the packet was last sent */
+static
+clock_time_t packet_buffer_sent_at(const struct buffered_packet *bp);
+
 static
 struct packet* packet_buffer_get_packet(struct buffered_packet *bp);
 
 /*static
 void* packet_buffer_get_data(struct buffered_packet *bp);*/
 
+/* Counts a send made now. */
 static
 void packet_buffer_increment_times_sent(struct buffered_packet *bp);
 
+/* Copies of bp's packet heard from other nodes since the last clear */
+static
+uint8_t packet_buffer_copies_heard(const struct buffered_packet *bp);
+
+static
+void packet_buffer_increment_copies_heard(struct buffered_packet *bp);
+
+static
+void packet_buffer_clear_copies_heard(struct buffered_packet *bp);
+
 /*static
 void (*packet_buffer_send_fn(struct buffered_packet *bp)) (void*);*/
 
@@ -92,10 +156,28 @@ packet_buffer_get_packet_for_sending(struct packet_buffer *pb);*/
 struct buffered_packet*
 packet_buffer_get_first_packet_from_type(struct packet_buffer *pb, uint8_t type);
 
+static
+uint8_t packet_buffer_num_packets_of_type(const struct packet_buffer *pb,
+		uint8_t type);
+
+/* The packet of the same type after bp */
+static
+struct buffered_packet* packet_buffer_next(const struct buffered_packet *bp);
+
 struct buffered_packet*
 packet_buffer_find_buffered_packet(struct packet_buffer *pb, const struct packet* p,
 		int (*comparer)(const void *buffered_item, const void *supplied_item));
 
+struct buffered_packet*
+packet_buffer_find_buffered_packet_from_type(struct packet_buffer *pb,
+		uint8_t type, const struct packet* p,
+		int (*comparer)(const void *buffered_item, const void *supplied_item));
+
+/* Adds data to the end of bp's data. Returns 0 if it does not fit or the
+ * packet is shared. */
+int packet_buffer_append_data(struct buffered_packet *bp, const void *data,
+		uint8_t data_len);
+
 static
 int packet_buffer_has_room_for_packets(const struct packet_buffer *pb, 
 		uint8_t num_packets);
@@ -114,12 +196,38 @@ uint8_t packet_buffer_times_sent(const struct buffered_packet *bp) {
 
 static inline
 uint8_t packet_buffer_data_len(const struct buffered_packet *bp) {
-	return bp->data_len;
+	return bp->pp->data_len;
+}
+
+static inline
+uint8_t packet_buffer_refs(const struct buffered_packet *bp) {
+	return bp->pp->refs;
+}
+
+static inline
+clock_time_t packet_buffer_queued_at(const struct buffered_packet *bp) {
+	return bp->queued_at;
+}
+
+static inline
+clock_time_t packet_buffer_sent_at(const struct buffered_packet *bp) {
+	return bp->sent_at;
+}
+
+static inline
+struct buffered_packet* packet_buffer_next(const struct buffered_packet *bp) {
+	return bp->next;
+}
+
+static inline
+uint8_t packet_buffer_num_packets_of_type(const struct packet_buffer *pb,
+		uint8_t type) {
+	return pb->num_packets[type];
 }
 
 static inline
 struct packet* packet_buffer_get_packet(struct buffered_packet *bp) {
-	return &bp->p;
+	return &bp->pp->p;
 }
 
 /*static inline
@@ -130,6 +238,24 @@ void* packet_buffer_get_data(struct buffered_packet *bp) {
 static inline
 void packet_buffer_increment_times_sent(struct buffered_packet *bp) {
 	++bp->times_sent;
+	bp->sent_at = clock_time();
+}
+
+static inline
+uint8_t packet_buffer_copies_heard(const struct buffered_packet *bp) {
+	return bp->copies_heard;
+}
+
+static inline
+void packet_buffer_increment_copies_heard(struct buffered_packet *bp) {
+	if (bp->copies_heard < 0xff) {
+		++bp->copies_heard;
+	}
+}
+
+static inline
+void packet_buffer_clear_copies_heard(struct buffered_packet *bp) {
+	bp->copies_heard = 0;
 }
 
 /*static inline
@@ -140,37 +266,53 @@ void (*packet_buffer_send_fn(struct buffered_packet *bp)) (void*) {
 static inline
 int packet_buffer_has_room_for_packets(const struct packet_buffer *pb, uint8_t num_packets) {
 	return queue_buffer_size(pb->buffer)+num_packets <=
-		queue_buffer_max_size(pb->buffer);
+		queue_buffer_max_size(pb->buffer) &&
+		queue_buffer_size(pb->pool)+num_packets <=
+		queue_buffer_max_size(pb->pool);
 }
 
 static inline
-void packet_buffer_neighbor_acked(struct buffered_packet *bp, const rimeaddr_t *addr) {
-	rimeaddr_t *baddr = (rimeaddr_t*)queue_buffer_begin(&bp->unacked_ns);
-	for(; baddr != NULL; baddr = (rimeaddr_t*)queue_buffer_next(&bp->unacked_ns)) {
-		if (rimeaddr_cmp(baddr, addr)) {
-			queue_buffer_free(&bp->unacked_ns, baddr);
-			return;
+void packet_buffer_add_unacked_neighbor(struct buffered_packet *bp,
+		const rimeaddr_t *addr) {
+	ASSERT(bp->num_unacked_ns < MAX_NEIGHBORS);
+	rimeaddr_copy(&bp->unacked_ns[bp->num_unacked_ns++], addr);
+}
+
+static inline
+int packet_buffer_neighbor_acked(struct buffered_packet *bp, const rimeaddr_t *addr) {
+	uint8_t i;
+	for(i = 0; i < bp->num_unacked_ns; ++i) {
+		if (rimeaddr_cmp(&bp->unacked_ns[i], addr)) {
+			/* order does not matter, move the last one in */
+			rimeaddr_copy(&bp->unacked_ns[i],
+					&bp->unacked_ns[--bp->num_unacked_ns]);
+			return 1;
 		}
 	}
+	return 0;
 }
 
 static inline
 int packet_buffer_all_neighbors_acked(const struct buffered_packet *bp) {
-	return queue_buffer_size(&bp->unacked_ns) == 0;
+	return bp->num_unacked_ns == 0;
 }
 
 static inline
 int packet_buffer_num_unacked_neighbors(struct buffered_packet *bp) {
-	return queue_buffer_size(&bp->unacked_ns);
+	return bp->num_unacked_ns;
 }
 
 static inline
 rimeaddr_t* packet_buffer_unacked_neighbors_begin(struct buffered_packet *bp) {
-	return (rimeaddr_t*)queue_buffer_begin(&bp->unacked_ns);
+	bp->unacked_ns_iterator = 0;
+	return packet_buffer_unacked_neighbors_next(bp);
 }
 
 static inline
 rimeaddr_t* packet_buffer_unacked_neighbors_next(struct buffered_packet *bp) {
-	return (rimeaddr_t*)queue_buffer_next(&bp->unacked_ns);
+	if (bp->unacked_ns_iterator >= bp->num_unacked_ns) {
+		return NULL;
+	}
+	return &bp->unacked_ns[bp->unacked_ns_iterator++];
 }
 #endif
@@ -0,0 +1,92 @@
+#include "base/unittest.h"
+
+#include "base/hazard.h"
+
+static struct hazard h;
+
+static void test_hazard(void) {
+	int i;
+
+	hazard_init(&h);
+	ASSERT(hazard_metric(&h) == 0);
+
+	/* the first sample is taken as it is */
+	hazard_add(&h, HAZARD_LIGHT, 300);
+	ASSERT(hazard_level(&h, HAZARD_LIGHT) == 300);
+	ASSERT(hazard_rise(&h, HAZARD_LIGHT) == 0);
+	ASSERT(hazard_metric(&h) == 300);
+
+	/* a lone spike moves the level a quarter of the way */
+	hazard_add(&h, HAZARD_LIGHT, 700);
+	ASSERT(hazard_level(&h, HAZARD_LIGHT) == 400);
+	hazard_add(&h, HAZARD_LIGHT, 300);
+	ASSERT(hazard_level(&h, HAZARD_LIGHT) == 375);
+
+	/* a level that stays settles on it */
+	for (i = 0; i < 40; ++i) {
+		hazard_add(&h, HAZARD_LIGHT, 700);
+	}
+	ASSERT(hazard_level(&h, HAZARD_LIGHT) >= 699);
+	ASSERT(hazard_metric(&h) >= 699 && hazard_metric(&h) <= 700);
+
+	/* room temperature adds nothing */
+	hazard_init(&h);
+	for (i = 0; i < 100; ++i) {
+		hazard_add(&h, HAZARD_TEMP, 220);
+		hazard_add(&h, HAZARD_HUMIDITY, 450);
+	}
+	ASSERT(hazard_rise(&h, HAZARD_TEMP) == 0);
+	ASSERT(hazard_metric(&h) == 0);
+
+	/* 8 C a minute at a sample per 5 s is a rise while still cool, once it
+	 * has gone on for about a minute */
+	for (i = 0; i < 20; ++i) {
+		hazard_add(&h, HAZARD_TEMP, 220 + 7*i);
+		ASSERT(i >= 10 || hazard_metric(&h) == 0);
+	}
+	ASSERT(hazard_level(&h, HAZARD_TEMP) < HAZARD_TEMP_BASE);
+	ASSERT(hazard_rise(&h, HAZARD_TEMP) > HAZARD_TEMP_RISE);
+	ASSERT(hazard_metric(&h) > 0);
+
+	/* and humidity falling with it adds more */
+	{
+		uint16_t dry = hazard_metric(&h);
+		for (i = 0; i < 30; ++i) {
+			hazard_add(&h, HAZARD_HUMIDITY, 450 - 4*i);
+		}
+		ASSERT(hazard_rise(&h, HAZARD_HUMIDITY) < -HAZARD_HUMIDITY_FALL);
+		ASSERT(hazard_metric(&h) > dry);
+	}
+
+	/* saturates */
+	for (i = 0; i < 100; ++i) {
+		hazard_add(&h, HAZARD_TEMP, 32000);
+	}
+	ASSERT(hazard_metric(&h) == HAZARD_METRIC_MAX);
+
+	/* raw SHT11 readings; a failed one is dropped instead of being taken
+	 * for 615 C */
+	hazard_init(&h);
+	{
+		struct sampler_reading r;
+		r.source = SAMPLER_TEMP;
+		r.value = 6160; /* 22 C */
+		ASSERT(hazard_add_reading(&h, &r));
+		ASSERT(hazard_level(&h, HAZARD_TEMP) == 220);
+		r.source = SAMPLER_HUMIDITY;
+		r.value = 1200; /* 40 % */
+		ASSERT(hazard_add_reading(&h, &r));
+		ASSERT(hazard_level(&h, HAZARD_HUMIDITY) >= 400 &&
+				hazard_level(&h, HAZARD_HUMIDITY) <= 410);
+
+		r.value = SAMPLER_FAILED;
+		for (r.source = 0; r.source < SAMPLER_SOURCES; ++r.source) {
+			ASSERT(!hazard_add_reading(&h, &r));
+		}
+		ASSERT(hazard_level(&h, HAZARD_TEMP) == 220);
+		ASSERT(hazard_rise(&h, HAZARD_TEMP) == 0);
+		ASSERT(hazard_metric(&h) == 0);
+	}
+}
+
+UNITTEST("testhazard", test_hazard)
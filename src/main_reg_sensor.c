@@ -3,22 +3,27 @@
 #include "dev/leds.h"
 #include "dev/button-sensor.h"
 #include "dev/serial-line.h"
-#include "dev/light-sensor.h"
 
 #include "dev/sky-sensors.h"
 
 #include "sys/rtimer.h"
 #include "net/rime/timesynch.h"
 
+#include "stdio.h"
 #include "string.h"
 //#include "limits.h"
 
 #include "emergency_net/emergency_conn.h"
 #include "emergency_net/neighbors.h"
+#include "emergency_net/metric_heap.h"
 
 #include "base/node_properties.h"
+#include "base/hazard.h"
+#include "base/sampler.h"
 
 #include "base/util.h"
+#include "base/telemetry.h"
+#include "base/trace.h"
 #include "base/log.h"
 
 /* 0 means no simulation */
@@ -32,8 +37,35 @@
 #define MAX_NUMBER_OF_HOPS_TO_EXIT 7
 
 #define MAX_ALLOWED_METRIC 1000
-#define LIGHT_EMERGENCY_THRESHOLD 400
+#define HAZARD_EMERGENCY_THRESHOLD 400
 #define ABRUPT_METRIC_CHANGE_THRESHOLD 200
+/* Weigh the distance to a neighbor by the link's ETX */
+#define ETX_WEIGHTED_LINKS 1
+
+/* Best path updates smaller than the hysteresis are not advertised, and
+ * advertisements are at least the interval apart unless the metric changed by
+ * the forced change or more, or we lost our path. */
+#ifndef BEST_PATH_HYSTERESIS
+#define BEST_PATH_HYSTERESIS 50
+#endif
+#ifndef BEST_PATH_FORCED_CHANGE
+#define BEST_PATH_FORCED_CHANGE 400
+#endif
+#ifndef BEST_PATH_MIN_INTERVAL
+#define BEST_PATH_MIN_INTERVAL (2*CLOCK_SECOND)
+#endif
+
+/* Next best paths considered when failing over from a lost best path */
+#define ALTERNATE_PATHS 3
+
+/* Light is sampled every period, and temperature and humidity take turns
+ * every few light samples. */
+#define LIGHT_SAMPLE_PERIOD CLOCK_SECOND
+#define CLIMATE_SAMPLE_EVERY 5
+
+/* Trace events are printed a few at a time, to leave the UART to the GUI. */
+#define TRACE_DRAIN_PERIOD (CLOCK_SECOND/4)
+#define TRACE_DRAIN_BURST 4
 
 static void
 print_packet_data(const uint8_t *hdr, int len)
@@ -84,7 +116,12 @@ enum {
 	EXTRACT_REPORT_PACKET,
 	NODE_REPORT_PACKET,
 
-	RESET_SYSTEM_PACKET
+	RESET_SYSTEM_PACKET,
+
+	/* Bulk commissioning. A SETUP_PACKET sent by mesh to a node whose address
+	 * is already the one in it is taken without the usr button, and answered
+	 * by mesh with this. */
+	SETUP_ACK_PACKET
 };
 
 
@@ -103,6 +140,10 @@ struct best_path_update_packet {
 };
 
 #define SETUP_PACKET_SIZE (sizeof(struct setup_packet)-sizeof(rimeaddr_t))
+/* Neighbors that fit in a setup packet sent behind a header of hdr_size
+ * bytes. The packet buffer takes packets shorter than MAX_PACKET_SIZE. */
+#define SETUP_MAX_NEIGHBORS(hdr_size) \
+	((MAX_PACKET_SIZE-1-(hdr_size)-SETUP_PACKET_SIZE)/sizeof(rimeaddr_t))
 struct setup_packet {
 	uint8_t type;
 	rimeaddr_t new_addr;
@@ -131,14 +172,9 @@ enum blinking_sequence_state {
 	OFF_7 = 7
 };
 
-struct sensor_readings {
-	int light;
-	/*int temp;
-	int humidity;*/
-};
-
 struct node_properties {
 	struct neighbors ns;
+	struct metric_heap paths; /* metric of the path via every neighbor */
 	const struct neighbor_node *bpn; /* best path neighbor */
 
 	QUEUE_BUFFER(emergency_coords, 
@@ -162,6 +198,27 @@ struct node_properties {
 
 	uint8_t current_sensors_metric[2];
 
+	struct {
+		struct hazard h;
+		uint8_t light_samples; /* for when to sample the climate */
+	} sensing;
+
+	/* The path we last advertised, for telling which paths can not lead
+	 * back through us: a path to the same exit is only taken if its seqno is
+	 * newer, or it is as new and shorter than any we advertised with it. */
+	struct {
+		rimeaddr_t exit;
+		uint8_t seqno;
+		metric_t feasible; /* lowest metric advertised with seqno */
+	} route;
+
+	struct {
+		struct neighbor_node_best_path bp; /* last advertised */
+		clock_time_t at;
+		int8_t has_advertised;
+		struct ctimer timer; /* sends a deferred advertisement */
+	} adv;
+
 	struct ec c;
 	uint8_t seqno;
 };
@@ -202,7 +259,7 @@ send_emergency_packet() {
 	struct emergency_packet ep;
 	ep.type = EMERGENCY_PACKET;
 	coordinate_copy(&ep.source, &coordinate_node);
-	ec_broadcast(&g_np.c, &rimeaddr_node_addr,
+	ec_trickle(&g_np.c, &rimeaddr_node_addr,
 			&rimeaddr_node_addr, 0, g_np.seqno++, &ep,
 			sizeof(struct emergency_packet));
 }
@@ -212,7 +269,7 @@ send_anti_emergency_packet() {
 	struct emergency_packet ep;
 	ep.type = ANTI_EMERGENCY_PACKET;
 	coordinate_copy(&ep.source, &coordinate_node);
-	ec_broadcast(&g_np.c, &rimeaddr_node_addr,
+	ec_trickle(&g_np.c, &rimeaddr_node_addr,
 			&rimeaddr_node_addr, 0, g_np.seqno++, &ep,
 			sizeof(struct emergency_packet));
 }
@@ -293,6 +350,7 @@ void setup_parse(const struct setup_packet *sp, int is_from_flash) {
 	coordinate_set_node_coord(&sp->new_coord);
 
 	neighbors_clear(&g_np.ns);
+	metric_heap_init(&g_np.paths);
 	memset(&g_np.state, 0, sizeof(g_np.state));
 
 	uint16_to_uint8(0, g_np.current_sensors_metric);
@@ -307,6 +365,8 @@ void setup_parse(const struct setup_packet *sp, int is_from_flash) {
 		bp.metric[1] = 0;
 		rimeaddr_copy(&bp.points_to, &rimeaddr_node_addr);
 		bp.hops = -1; /* since we calculate +1 when sending path */
+		rimeaddr_copy(&bp.exit, &rimeaddr_node_addr);
+		bp.seqno = 0;
 
 		g_np.state.is_exit_node = 1;
 		neighbor_node_set_addr(&exit_node, &rimeaddr_node_addr);
@@ -359,62 +419,175 @@ void setup_parse(const struct setup_packet *sp, int is_from_flash) {
 	ec_set_neighbors(&g_np.c, &g_np.ns);
 }
 
+/* Parses a setup command from the GUI into sp, which has room for
+ * max_neighbors. Returns the size of the setup packet, or 0 if the command is
+ * malformed or has more neighbors.
+ *
+ * command:addr[0].addr[1]:coordx.coordy:is_exit_node:
+ * neighbor1[0].neighbor1[1]:
+ * neighbor2[0].neighbor2[1]:
+ * neighbor3[0].neighbor3[1] 
+ * ... 
+ * 
+ * eg:
+ * send_setup_packet:1.0:100.110:1:2.0:3.0:4.0:5.0 */
+static uint8_t
+parse_setup_command(char *command, struct setup_packet *sp,
+		uint8_t max_neighbors) {
+	const char *entry = strtok(command, ":");
+	rimeaddr_t *neighbor = sp->neighbors;
+	uint16_t coord;
+
+	sp->type = SETUP_PACKET;
+
+	/* parse addr */
+	if (entry == NULL || (entry = strtok(NULL, ".")) == NULL) {
+		return 0;
+	}
+	sp->new_addr.u8[0] = (uint8_t)atoi(entry);
+	if ((entry = strtok(NULL, ":")) == NULL) {
+		return 0;
+	}
+	sp->new_addr.u8[1] = (uint8_t)atoi(entry);
+
+	/* parse coord */
+	if ((entry = strtok(NULL, ".")) == NULL) {
+		return 0;
+	}
+	coord = (uint16_t)atoi(entry);
+	uint16_to_uint8(coord, sp->new_coord.x);
+	if ((entry = strtok(NULL, ":")) == NULL) {
+		return 0;
+	}
+	coord = (uint16_t)atoi(entry);
+	uint16_to_uint8(coord, sp->new_coord.y);
+
+	/* parse is_exit_node */
+	if ((entry = strtok(NULL, ":")) == NULL) {
+		return 0;
+	}
+	sp->is_exit_node = (int8_t)atoi(entry);
+
+	/* parse neighbors */
+	sp->num_neighbors = 0;
+	while((entry = strtok(NULL, ".")) != NULL) {
+		if (sp->num_neighbors == max_neighbors) {
+			return 0;
+		}
+		neighbor->u8[0] = (uint8_t)atoi(entry);
+		if ((entry = strtok(NULL, ":")) == NULL) {
+			return 0;
+		}
+		neighbor->u8[1] = (uint8_t)atoi(entry);
+		++neighbor;
+		++sp->num_neighbors;
+	}
+
+	if (sp->num_neighbors == 0) {
+		return 0;
+	}
+	return SETUP_PACKET_SIZE + sp->num_neighbors*sizeof(rimeaddr_t);
+}
+
+/* A setup packet sent to us by mesh during bulk commissioning. It is not
+ * burnt again if it is on the flash already, as it is sent again when our
+ * SETUP_ACK_PACKET gets lost. */
+static void
+provision_setup(const rimeaddr_t *originator, const struct setup_packet *sp,
+		uint8_t data_len) {
+	struct sensor_packet ack;
+	char buf[SETUP_PACKET_SIZE+MAX_NEIGHBORS*sizeof(rimeaddr_t)];
+
+	/* the neighbors must be all there, and only them */
+	if (data_len < SETUP_PACKET_SIZE || data_len > sizeof(buf) ||
+			sp->num_neighbors > MAX_NEIGHBORS ||
+			data_len != SETUP_PACKET_SIZE +
+			sp->num_neighbors*sizeof(rimeaddr_t)) {
+		LOG("Bad setup packet\n");
+		return;
+	}
+	if (!rimeaddr_cmp(&sp->new_addr, &rimeaddr_node_addr)) {
+		return;
+	}
+
+	if (!node_properties_restore(buf, data_len) ||
+			memcmp(buf, sp, data_len) != 0) {
+		setup_parse(sp, 0);
+		leds_blink();
+	}
+
+	ack.type = SETUP_ACK_PACKET;
+	ec_mesh(&g_np.c, originator, g_np.seqno++, &ack, sizeof(ack));
+}
+
+/* A short but lossy link costs the retransmissions it takes. */
 static inline metric_t 
-weigh_distance(distance_t distance) {
-	return distance;
+weigh_link(const struct neighbor_node *nn) {
+#if ETX_WEIGHTED_LINKS
+	uint32_t weight = (uint32_t)neighbor_node_distance(nn)*
+		neighbor_node_etx(nn)/ETX_ONE;
+	return weight < METRIC_T_MAX ? weight : METRIC_T_MAX-1;
+#else
+	return neighbor_node_distance(nn);
+#endif
 }
 
 static inline metric_t
-weigh_metrics(distance_t distance) {
+weigh_metrics(const struct neighbor_node *nn) {
 	if (g_np.state.is_burning) {
 		//if (!g_np.state.is_exit_node) {
 			metric_t sens_16;
 			uint8_to_uint16(g_np.current_sensors_metric, &sens_16);
-			return 1000+weigh_distance(distance)+sens_16;
+			return 1000+weigh_link(nn)+sens_16;
 		//} else {
 			//return METRIC_T_MAX;
 		//}
 	}
 
-	return weigh_distance(distance);
+	return weigh_link(nn);
+}
+
+
+/* A path could lead back through us if it is to the exit of the path we
+ * advertised last, but older or no shorter. Our best path neighbor is
+ * followed regardless, as it can not have picked a path through us. */
+static int
+is_feasible(const struct neighbor_node *nn) {
+	if (nn == g_np.bpn || 
+			!rimeaddr_cmp(neighbor_node_exit(nn), &g_np.route.exit) ||
+			neighbor_node_seqno_newer(neighbor_node_seqno(nn),
+				g_np.route.seqno)) {
+		return 1;
+	}
+
+	return neighbor_node_seqno(nn) == g_np.route.seqno &&
+		neighbor_node_metric(nn) < g_np.route.feasible;
 }
 
+/* Refreshes the metric of the path via nn, after its best path or link
+ * changed. Neighbors whose path is no use to us get METRIC_T_MAX. */
+static void
+update_path_via(const struct neighbor_node *nn) {
+	metric_t metric = METRIC_T_MAX;
+
+	if(!neighbor_node_points_to_us(nn) && 
+			neighbor_node_metric(nn) != METRIC_T_MAX
+			&& is_feasible(nn)
+			&& neighbor_node_hops(nn) < MAX_NUMBER_OF_HOPS_TO_EXIT) { 
+		uint32_t m = (uint32_t)weigh_link(nn) + neighbor_node_metric(nn);
+		metric = m < METRIC_T_MAX ? m : METRIC_T_MAX-1;
+	}
+
+	metric_heap_set(&g_np.paths, neighbors_slot(&g_np.ns, nn), metric);
+}
 
 static const struct neighbor_node*
 find_best_exit_path_neighbor() {
-	const struct neighbor_node *best = NULL;
-	const struct neighbor_node *i = neighbors_begin(&g_np.ns);
-	metric_t min_metric = METRIC_T_MAX;
-	metric_t metric;
+	const struct neighbor_node *best;
 
-	LOG("-----------------------\n");
 	if (!g_np.state.is_exit_node) {
-		for(;i != NULL; i = neighbors_next(&g_np.ns)) {
-			TRACE("neighbor: %d.%d, points_to: (%d.%d), coord: (%d.%d,%d.%d), distance: %d, "
-					"hops: %d, metric: %u\n",
-					neighbor_node_addr(i)->u8[0], 
-					neighbor_node_addr(i)->u8[1],
-					i->bp.points_to.u8[0],
-					i->bp.points_to.u8[1],
-					neighbor_node_coord(i)->x[0], 
-					neighbor_node_coord(i)->x[1], 
-					neighbor_node_coord(i)->y[0],
-					neighbor_node_coord(i)->y[1],
-					neighbor_node_distance(i),
-					neighbor_node_hops(i),
-					neighbor_node_metric(i));
-
-			if(!neighbor_node_points_to_us(i) && 
-					neighbor_node_metric(i) != METRIC_T_MAX
-					&& neighbor_node_hops(i) < MAX_NUMBER_OF_HOPS_TO_EXIT) { 
-				metric = weigh_distance( neighbor_node_distance(i) ) +
-					neighbor_node_metric(i);
-				if (metric < min_metric) {
-					min_metric = metric;
-					best = i;
-				}
-			}
-		}
+		int8_t slot = metric_heap_min(&g_np.paths);
+		best = slot < 0 ? &max_node : neighbors_node_at(&g_np.ns, slot);
 	} else {
 		/* extra checks for exit nodes */
 	//	uint16_t metric16;
@@ -424,22 +597,8 @@ find_best_exit_path_neighbor() {
 		//}
 	}
 
-	if (best == NULL) {
-		best = &max_node;
-	}
-
-
-	TRACE("BEST neighbor: %d.%d, points_to_us: %d, coord: (%d.%d,%d.%d), distance: %d, "
-			"metric: %d\n",
-			neighbor_node_addr(best)->u8[0], neighbor_node_addr(best)->u8[1],
-			neighbor_node_points_to_us(best),
-			neighbor_node_coord(best)->x[0], 
-			neighbor_node_coord(best)->x[1], 
-			neighbor_node_coord(best)->y[0],
-			neighbor_node_coord(best)->y[1],
-			neighbor_node_distance(best),
-			neighbor_node_metric(best));
-	LOG("-----------------------\n");
+	TRACE_EVENT(TRACE_BEST_NEIGHBOR, neighbor_node_points_to_us(best),
+			TRACE_ADDR(neighbor_node_addr(best)), neighbor_node_metric(best));
 
 	return best;
 }
@@ -447,22 +606,62 @@ find_best_exit_path_neighbor() {
 /* Transforms our best neighbor's best path to our own. */
 void best_neighbor_bp_to_our_bp(struct neighbor_node_best_path *bp) {
 	ASSERT(g_np.bpn != NULL);
+	if (g_np.bpn == &max_node) {
+		/* Poisons the path we lost, the odd seqno outranks copies of it. */
+		memcpy(bp, &neighbor_node_best_path_max,
+				sizeof(struct neighbor_node_best_path));
+		rimeaddr_copy(&bp->exit, &g_np.route.exit);
+		bp->seqno = g_np.route.seqno | 1;
+		return;
+	}
+
 	uint16_to_uint8(
 			neighbor_node_metric(g_np.bpn) +
-			weigh_metrics(neighbor_node_distance(g_np.bpn)),
+			weigh_metrics(g_np.bpn),
 			bp->metric
 			);
 
 	rimeaddr_copy(&bp->points_to, neighbor_node_addr(g_np.bpn));
 	bp->hops = neighbor_node_hops(g_np.bpn) + 1;
+	rimeaddr_copy(&bp->exit, neighbor_node_exit(g_np.bpn));
+	bp->seqno = neighbor_node_seqno(g_np.bpn);
+}
+
+/* Remembers the feasibility of the path we advertise, and so which paths
+ * neighbors offer are feasible now. */
+static void
+set_advertised_route(const struct neighbor_node_best_path *bp) {
+	const struct neighbor_node *nn;
+	metric_t metric;
+
+	uint8_to_uint16(bp->metric, &metric);
+	if (metric == METRIC_T_MAX) {
+		return;
+	}
+
+	if (!rimeaddr_cmp(&bp->exit, &g_np.route.exit) ||
+			neighbor_node_seqno_newer(bp->seqno, g_np.route.seqno)) {
+		rimeaddr_copy(&g_np.route.exit, &bp->exit);
+		g_np.route.seqno = bp->seqno;
+		g_np.route.feasible = metric;
+	} else if (metric < g_np.route.feasible) {
+		g_np.route.feasible = metric;
+	} else {
+		return;
+	}
+
+	for (nn = neighbors_begin(&g_np.ns); nn != NULL; 
+			nn = neighbors_next(&g_np.ns)) {
+		update_path_via(nn);
+	}
 }
 
 static void
-broadcast_best_path() {
+broadcast_best_path(const struct neighbor_node_best_path *bp) {
 	struct best_path_update_packet bpup;
 
 	bpup.type = BEST_PATH_UPDATE_PACKET;
-	best_neighbor_bp_to_our_bp(&bpup.bp);
+	memcpy(&bpup.bp, bp, sizeof(struct neighbor_node_best_path));
 
 	LOG("SENDING BEST_PATH_UPDATE_PACKET: metric: [%d %d], points_to: "
 			"%d.%d, hops: %d\n",
@@ -474,6 +673,67 @@ broadcast_best_path() {
 
 	ec_reliable_broadcast_ns(&g_np.c, &rimeaddr_node_addr, &rimeaddr_node_addr,
 			0, g_np.seqno++, &bpup, sizeof(struct best_path_update_packet));
+
+	set_advertised_route(bp);
+	memcpy(&g_np.adv.bp, bp, sizeof(struct neighbor_node_best_path));
+	g_np.adv.at = clock_time();
+	g_np.adv.has_advertised = 1;
+	ctimer_stop(&g_np.adv.timer);
+}
+
+static void advertise_best_path();
+
+static void
+advertise_deferred_best_path(void *ptr) {
+	if (g_np.bpn != NULL) {
+		advertise_best_path();
+	}
+}
+
+/* Broadcasts our best path if it differs enough from the one last
+ * advertised. Within BEST_PATH_MIN_INTERVAL of the last advertisement it is
+ * deferred until the interval is up, and then the latest path is sent. */
+static void
+advertise_best_path() {
+	struct neighbor_node_best_path bp;
+	metric_t metric, last;
+	uint16_t change;
+	clock_time_t since = clock_time() - g_np.adv.at;
+
+	best_neighbor_bp_to_our_bp(&bp);
+	uint8_to_uint16(bp.metric, &metric);
+	uint8_to_uint16(g_np.adv.bp.metric, &last);
+	change = metric > last ? metric - last : last - metric;
+
+	if (!g_np.adv.has_advertised || change >= BEST_PATH_FORCED_CHANGE ||
+			(g_np.bpn == &max_node && 
+			 !rimeaddr_cmp(&g_np.adv.bp.points_to, &rimeaddr_null))) {
+		broadcast_best_path(&bp);
+	} else if (change < BEST_PATH_HYSTERESIS && bp.hops == g_np.adv.bp.hops &&
+			rimeaddr_cmp(&bp.points_to, &g_np.adv.bp.points_to) &&
+			rimeaddr_cmp(&bp.exit, &g_np.adv.bp.exit) &&
+			bp.seqno == g_np.adv.bp.seqno) {
+		/* back within the hysteresis of what neighbors know */
+		ctimer_stop(&g_np.adv.timer);
+	} else if (since < BEST_PATH_MIN_INTERVAL) {
+		if (ctimer_expired(&g_np.adv.timer)) {
+			TRACE("Deferring BEST_PATH_UPDATE_PACKET\n");
+			ctimer_set(&g_np.adv.timer, BEST_PATH_MIN_INTERVAL - since,
+					advertise_deferred_best_path, NULL);
+		}
+	} else {
+		broadcast_best_path(&bp);
+	}
+}
+
+static void
+set_bpn(const struct neighbor_node *best) {
+	const struct neighbor_node *old = g_np.bpn;
+	g_np.bpn = best;
+	if (old != NULL && old != best && old != &max_node && old != &exit_node) {
+		/* it is no longer followed regardless of feasibility */
+		update_path_via(old);
+	}
 }
 
 static int
@@ -484,19 +744,65 @@ update_bpn_and_broadcast_new_path_if_changed(const struct neighbor_node *sender)
 	if (g_np.bpn == NULL || 
 			neighbor_node_metric(best) < neighbor_node_metric(g_np.bpn)) {
 		/* Neighbor now has the new best path */
-		g_np.bpn = best;
-		broadcast_best_path();
+		set_bpn(best);
+		advertise_best_path();
 		return 1;
 	} else if (sender == best || (g_np.bpn != &max_node && best == &max_node)) {
 		/* Neighbor updated its metrics. Broadcast changes. */
-		g_np.bpn = best;
-		broadcast_best_path();
+		set_bpn(best);
+		advertise_best_path();
 		return 1;
 	}
 
 	return 0;
 }
 
+static int
+is_unresponsive(const rimeaddr_t *addr) {
+	const struct neighbor_node *nn = neighbors_find_neighbor_node(&g_np.ns, addr);
+	return nn != NULL && !neighbor_node_has_sent_keep_alive(nn);
+}
+
+/* Switches straight to the best alternate path not leading through a
+ * neighbor that stopped keeping alive, before the lost neighbors are removed,
+ * so the LEDs never go without a path. Their paths must already be taken out
+ * of g_np.paths. The switch is advertised afterwards. */
+static void
+fail_over() {
+	uint8_t slots[ALTERNATE_PATHS];
+	uint8_t n = metric_heap_best(&g_np.paths, slots, ALTERNATE_PATHS);
+	const struct neighbor_node *best = &max_node;
+	uint8_t i;
+
+	for (i = 0; i < n; ++i) {
+		const struct neighbor_node *nn = neighbors_node_at(&g_np.ns, slots[i]);
+		LOG("Alternate path %d: %d.%d, metric: %u\n", i,
+				neighbor_node_addr(nn)->u8[0], neighbor_node_addr(nn)->u8[1],
+				metric_heap_metric(&g_np.paths, slots[i]));
+		if (!is_unresponsive(&nn->bp.points_to)) {
+			best = nn;
+			break;
+		}
+	}
+
+	g_np.bpn = best;
+	blinking_update();
+}
+
+/* Exits issue a newer seqno than seen, so nodes that lost their path to us
+ * can take one again. */
+static void
+renew_exit_path(uint8_t seen) {
+	struct neighbor_node_best_path bp;
+
+	memcpy(&bp, &exit_node.bp, sizeof(struct neighbor_node_best_path));
+	bp.seqno = (uint8_t)(seen + 2) & ~1;
+	neighbor_node_set_best_path(&exit_node, &bp);
+	if (g_np.bpn != NULL) {
+		advertise_best_path();
+	}
+}
+
 static void update_bpn_and_send_node_info() {
 	struct node_info_packet nip;
 	const struct neighbor_node *best =
@@ -558,6 +864,7 @@ const static struct ec_callbacks ec_cb = {ec_broadcasts_recv, ec_mc_uc_recv,
 static void reset_node_properties() {
 	memset(&g_np, 0, sizeof(struct node_properties));
 	neighbors_init(&g_np.ns);
+	metric_heap_init(&g_np.paths);
 	QUEUE_BUFFER_INIT_WITH_STRUCT(&g_np, emergency_coords, 
 			sizeof(struct coordinate), MAX_FIRE_COORDINATES);
 	ec_open(&g_np.c, EMERGENCYNET_CHANNEL, &ec_cb);
@@ -629,9 +936,7 @@ static void ec_broadcasts_recv(struct ec *c, const rimeaddr_t *originator,
 					add_coordinate_as_burning(&ep->source);
 
 					/* forward packet */
-					/* TODO: trickle this */
-					ec_broadcast(&g_np.c, originator, &rimeaddr_node_addr,
-							hops+1, seqno, data, data_len);
+					ec_forward(&g_np.c, MSG_TYPE_TRICKLE_DATA);
 
 					blinking_init();
 				}
@@ -643,8 +948,7 @@ static void ec_broadcasts_recv(struct ec *c, const rimeaddr_t *originator,
 
 					LOG("RECV ANTI EMERGENCY_PACKET: coord: [%d%d],[%d%d]\n",
 							ep->source.x[0], ep->source.x[1], ep->source.y[0], ep->source.y[1]);
-					ec_broadcast(&g_np.c, originator, &rimeaddr_node_addr,
-							hops+1, seqno, data, data_len);
+					ec_forward(&g_np.c, MSG_TYPE_TRICKLE_DATA);
 				}
 				break;
 			case SETUP_PACKET:
@@ -657,6 +961,7 @@ static void ec_broadcasts_recv(struct ec *c, const rimeaddr_t *originator,
 				break;
 			case INITIALIZE_BEST_PATHS_PACKET:
 				LOG("RECV INITIALIZE_BEST_PATHS_PACKET\n");
+				/* not ec_forward, "init" on the serial line gets here too */
 				ec_reliable_broadcast_ns(&g_np.c,
 						originator, &rimeaddr_node_addr, hops+1,
 						seqno, data, data_len);
@@ -672,8 +977,7 @@ static void ec_broadcasts_recv(struct ec *c, const rimeaddr_t *originator,
 					nrp.is_burning = g_np.state.is_burning;
 					nrp.is_exit_node = g_np.state.is_exit_node;
 
-					ec_broadcast(&g_np.c, originator, &rimeaddr_node_addr,
-							hops+1, seqno, data, data_len);
+					ec_forward(&g_np.c, MSG_TYPE_BROADCAST_DATA);
 
 					ec_mesh(&g_np.c, originator, g_np.seqno++, &nrp, sizeof(struct
 								node_report_packet));
@@ -681,9 +985,7 @@ static void ec_broadcasts_recv(struct ec *c, const rimeaddr_t *originator,
 				break;
 			case RESET_SYSTEM_PACKET:
 				LOG("RECV RESET_SYSTEM_PACKET\n");
-				ec_reliable_broadcast_ns(&g_np.c,
-						originator, &rimeaddr_node_addr, hops+1,
-						seqno, data, data_len);
+				ec_forward(&g_np.c, MSG_TYPE_NEIGHBOR_DATA);
 				reset_system_packet_handler();
 				break;
 			default:
@@ -695,16 +997,12 @@ static void ec_broadcasts_recv(struct ec *c, const rimeaddr_t *originator,
 			case EMERGENCY_PACKET:
 				{
 					//struct emergency_packet *ep = (struct emergency_packet*)p;
-					printf("@EMERGENCY_PACKET:%d.%d\n", 
-							originator->u8[0],
-							originator->u8[1]);
+					telemetry_emergency(originator, 1);
 				}
 				break;
 			case ANTI_EMERGENCY_PACKET:
 				{
-					printf("@ANTI_EMERGENCY_PACKET:%d.%d\n", 
-							originator->u8[0],
-							originator->u8[1]);
+					telemetry_emergency(originator, 0);
 				}
 				break;
 			case SETUP_PACKET:
@@ -757,6 +1055,15 @@ static void ec_neighbors_recv(struct ec *c, const rimeaddr_t *originator,
 				ASSERT(nn != NULL);
 
 				neighbor_node_set_best_path(nn, &bpup->bp);
+				update_path_via(nn);
+
+				if (g_np.state.is_exit_node && 
+						rimeaddr_cmp(&bpup->bp.exit, &rimeaddr_node_addr) &&
+						neighbor_node_seqno_newer(bpup->bp.seqno,
+							neighbor_node_seqno(&exit_node))) {
+					/* a path to us was lost, or we restarted */
+					renew_exit_path(bpup->bp.seqno);
+				}
 
 				/* The shortest path could have changed. */
 				if(update_bpn_and_broadcast_new_path_if_changed(nn)) {
@@ -766,9 +1073,7 @@ static void ec_neighbors_recv(struct ec *c, const rimeaddr_t *originator,
 			break;
 		case INITIALIZE_BEST_PATHS_PACKET:
 			LOG("RECV INITIALIZE_BEST_PATHS_PACKET\n");
-			ec_reliable_broadcast_ns(&g_np.c,
-					originator, &rimeaddr_node_addr, hops+1,
-					seqno, data, data_len);
+			ec_forward(&g_np.c, MSG_TYPE_NEIGHBOR_DATA);
 
 			initialize_best_path_packet_handler();
 			break;
@@ -803,6 +1108,7 @@ static void ec_neighbors_recv(struct ec *c, const rimeaddr_t *originator,
 				ASSERT(nn != NULL);
 				neighbor_node_set_coordinate(nn, &nip->coord);
 				neighbor_node_set_best_path(nn, &nip->bp);
+				update_path_via(nn);
 
 				if (!g_np.state.has_sent_node_info) {
 					update_bpn_and_send_node_info();
@@ -817,9 +1123,7 @@ static void ec_neighbors_recv(struct ec *c, const rimeaddr_t *originator,
 			break;
 		case RESET_SYSTEM_PACKET:
 			LOG("RECV RESET_SYSTEM_PACKET\n");
-			ec_reliable_broadcast_ns(&g_np.c,
-					originator, &rimeaddr_node_addr, hops+1,
-					seqno, data, data_len);
+			ec_forward(&g_np.c, MSG_TYPE_NEIGHBOR_DATA);
 			reset_system_packet_handler();
 			break;
 		default:
@@ -849,17 +1153,18 @@ static void ec_mesh_recv(struct ec *c, const rimeaddr_t *originator,
 				uint8_to_uint16(nrp->coord.y, &y);
 				LOG("RECV NODE_REPORT_PACKET\n");
 
-				/* GUI SHOULD PARSE THIS. */
-				printf("@NODE_REPORT_PACKET:%d.%d:%d.%d:%d:%d\n",
-						originator->u8[0],
-						originator->u8[1],
-						x,
-						y,
-						nrp->is_burning,
-						nrp->is_exit_node
-						);
+				/* batched to the GUI */
+				telemetry_node_report(originator, x, y, nrp->is_burning,
+						nrp->is_exit_node);
 			}
 			break;
+		case SETUP_PACKET:
+			provision_setup(originator, (const struct setup_packet*)p,
+					data_len);
+			break;
+		case SETUP_ACK_PACKET:
+			telemetry_setup_ack(originator);
+			break;
 		default:
 			LOG("ptype: %d\n", p->type);
 			ASSERT(0);
@@ -867,25 +1172,28 @@ static void ec_mesh_recv(struct ec *c, const rimeaddr_t *originator,
 
 }
 
-static inline
-void read_sensors(struct sensor_readings *r) {
-	SENSORS_ACTIVATE(light_sensor);
-	/* 4 times are needed to better reflect the actual value right now. */
-	clock_delay(400);
-	r->light = light_sensor.value(LIGHT_SENSOR_PHOTOSYNTHETIC);
-	/*other sensors here*/
-	SENSORS_DEACTIVATE(light_sensor);
-	//LOG("SENSORS: Light: %d\n", r->light);
-}
+/* Folds in a reading, and starts sampling the climate when it is its turn.
+ * A failed sample is dropped, so one bad SHT11 read can not raise an
+ * emergency. */
+static void
+add_sample(const struct sampler_reading *r) {
+	if (!hazard_add_reading(&g_np.sensing.h, r)) {
+		LOG("Sample of sensor %d failed\n", r->source);
+	}
 
-static inline
-metric_t sensor_readings_to_metric(const struct sensor_readings *r) {
-	return r->light;
+	if (r->source == SAMPLER_LIGHT) {
+		uint8_t turn = g_np.sensing.light_samples++ % CLIMATE_SAMPLE_EVERY;
+		if (turn == 0) {
+			sampler_start(SAMPLER_TEMP);
+		} else if (turn == CLIMATE_SAMPLE_EVERY/2) {
+			sampler_start(SAMPLER_HUMIDITY);
+		}
+	}
 }
 
 static
 int is_emergency(metric_t metric) {
-	if (metric > LIGHT_EMERGENCY_THRESHOLD) {
+	if (metric > HAZARD_EMERGENCY_THRESHOLD) {
 		return 1;
 	}
 
@@ -908,11 +1216,9 @@ int is_emergency(metric_t metric) {
 
 static
 int abrupt_metric_change_poll(metric_t *metric) {
-	struct sensor_readings r;
 	uint16_t csm;
-	read_sensors(&r);
 
-	*metric = sensor_readings_to_metric(&r);
+	*metric = hazard_metric(&g_np.sensing.h);
 	uint8_to_uint16(g_np.current_sensors_metric, &csm);
 
 	if(abs(((int16_t)*metric) - ((int16_t)csm)) > ABRUPT_METRIC_CHANGE_THRESHOLD) {
@@ -922,28 +1228,92 @@ int abrupt_metric_change_poll(metric_t *metric) {
 	return 0;
 }
 
+/* One line for the connection, then one per send class with traffic:
+ * @EC_STATS:received:dupes:overflows:rtt bucket 0,...,rtt bucket n
+ * @EC_CLASS:type:sent:busy:retransmits:drops:give_ups:piggybacked:max_depth:
+ * wait_sum:max_wait
+ * where the waits are in clock ticks from queueing to the first send. */
+static void
+print_ec_stats(void) {
+	const struct ec_stats *s = ec_stats(&g_np.c);
+	uint8_t i;
+
+	printf("@EC_STATS:%u:%u:%u:", s->received, s->dupes, s->overflows);
+	for (i = 0; i < EC_RTT_BUCKETS; ++i) {
+		printf(i == 0 ? "%u" : ",%u", s->ack_rtt[i]);
+	}
+	printf("\n");
+
+	for (i = 0; i < PACKET_BUFFER_MAX_TYPES; ++i) {
+		const struct ec_class_stats *cs = &s->classes[i];
+		if (cs->sent == 0 && cs->busy == 0 && cs->drops == 0 &&
+				cs->piggybacked == 0) {
+			continue;
+		}
+		printf("@EC_CLASS:%u:%u:%u:%u:%u:%u:%u:%u:%lu:%u\n", i, cs->sent,
+				cs->busy, cs->retransmits, cs->drops, cs->give_ups,
+				cs->piggybacked, cs->max_depth, (unsigned long)cs->wait_sum,
+				(unsigned)cs->max_wait);
+	}
+}
+
+/* Telemetry frames go out raw, next to the LOG text. */
+static void
+write_telemetry(const uint8_t *frame, uint8_t len) {
+	uint8_t i;
+	for (i = 0; i < len; ++i) {
+		putchar(frame[i]);
+	}
+}
 
 PROCESS(fire_process, "EmergencyWSN");
 AUTOSTART_PROCESSES(&fire_process);
 
 PROCESS_THREAD(fire_process, ev, data) {
 
+	static struct etimer sample_timer;
 	static struct etimer emergency_check_timer;
 	static struct etimer keepalive_send_timer;
 	static struct etimer keepalive_check_timer;
+#ifdef TEAMLK_TRACE
+	static struct etimer trace_timer;
+#endif
 	PROCESS_EXITHANDLER(ec_close(&g_np.c));
 
 	PROCESS_BEGIN();
 	reset_node_properties();
+	hazard_init(&g_np.sensing.h);
+	sampler_init();
+	telemetry_init(write_telemetry);
 
 	SENSORS_ACTIVATE(button_sensor);
+	etimer_set(&sample_timer, LIGHT_SAMPLE_PERIOD);
 	etimer_set(&emergency_check_timer, CLOCK_SECOND * 1);
 	etimer_set(&keepalive_send_timer, CLOCK_SECOND * 20);
 	etimer_set(&keepalive_check_timer, CLOCK_SECOND * 80);
+#ifdef TEAMLK_TRACE
+	etimer_set(&trace_timer, TRACE_DRAIN_PERIOD);
+#endif
 
 	while(1) {
 		PROCESS_WAIT_EVENT();
 
+#ifdef TEAMLK_TRACE
+		if (etimer_expired(&trace_timer)) {
+			trace_drain(TRACE_DRAIN_BURST);
+			etimer_set(&trace_timer, TRACE_DRAIN_PERIOD);
+		}
+#endif
+
+		if (ev == sampler_event) {
+			add_sample((const struct sampler_reading*)data);
+		}
+
+		if (etimer_expired(&sample_timer)) {
+			sampler_start(SAMPLER_LIGHT);
+			etimer_set(&sample_timer, LIGHT_SAMPLE_PERIOD);
+		}
+
 		if (ev == sensors_event) {
 			if (data == &button_sensor) {
 				leds_on(LEDS_ALL);
@@ -1063,6 +1433,10 @@ PROCESS_THREAD(fire_process, ev, data) {
 		//		ec_reliable_multicast(&g_np.c,&ns, &rimeaddr_node_addr,
 		//				&rimeaddr_node_addr, 0, g_np.seqno++, &sp, sizeof(struct
 		//					sensor_packet));
+			} else if(strcmp(data, "stats") == 0) {
+				print_ec_stats();
+			} else if(strcmp(data, "clear_stats") == 0) {
+				ec_stats_clear(&g_np.c);
 			} else if(strcmp(data, "sink") == 0) {
 				uint8_t tmp[SETUP_PACKET_SIZE+1*sizeof(rimeaddr_t)] = {0};
 				struct setup_packet *sp = (struct setup_packet*)tmp;
@@ -1082,72 +1456,15 @@ PROCESS_THREAD(fire_process, ev, data) {
 
 			} else if(strncmp(data, "send_setup_packet", 
 						sizeof("send_setup_packet")-1) == 0) {
-
-				/* send_setup_packet:addr[0].addr[1]:coordx.coordy:is_exit_node:
-				 * neighbor1[0].neighbor1[1]:
-				 * neighbor2[0].neighbor2[1]:
-				 * neighbor3[0].neighbor3[1] 
-				 * ... 
-				 * 
-				 * eg:
-				 * send_setup_packet:1.0:100.110:1:2.0:3.0:4.0:5.0
-				 *
-				 * */
+				/* for the node whose usr button has been pushed */
 				uint8_t tmp[SETUP_PACKET_SIZE+
-					MAX_NEIGHBORS*sizeof(rimeaddr_t)] = {0};
+					SETUP_MAX_NEIGHBORS(BROADCAST_PACKET_HDR_SIZE)*
+					sizeof(rimeaddr_t)] = {0};
 				struct setup_packet *sp = (struct setup_packet*)tmp;
-				const char *entry = strtok(data,":");
-
-				sp->type = SETUP_PACKET;
-
-				ASSERT(entry != NULL);
-				entry = strtok(NULL, ".");
-				ASSERT(entry != NULL);
-
-				/* parse addr */
-				sp->new_addr.u8[0] = (uint8_t)atoi(entry);
-				entry = strtok(NULL, ":");
-				ASSERT(entry != NULL);
-				sp->new_addr.u8[1] = (uint8_t)atoi(entry);
-
-				/* parse coord */
-				entry = strtok(NULL, ".");
-				ASSERT(entry != NULL);
-				{
-					uint16_t coord = (uint16_t)atoi(entry);
-					uint16_to_uint8(coord, sp->new_coord.x);
-					entry = strtok(NULL, ":");
-					ASSERT(entry != NULL);
-					coord = (uint16_t)atoi(entry);
-					uint16_to_uint8(coord, sp->new_coord.y);
-				}
-
-				/* parse is_exit_node */
-				entry = strtok(NULL, ":");
-				ASSERT(entry != NULL);
-				sp->is_exit_node = (int8_t)atoi(entry);
-
-				/* parse neighbors */
-				{
-					uint8_t num_neighbors = 0;
-					rimeaddr_t *neighbor = sp->neighbors;
-					while((entry = strtok(NULL, ".")) != NULL) {
-						neighbor->u8[0] = (uint8_t)atoi(entry);
-						entry = strtok(NULL, ":");
-						ASSERT(entry != NULL);
-						neighbor->u8[1] = (uint8_t)atoi(entry);
-						++neighbor;
-						++num_neighbors;
-					}
-
-					ASSERT(num_neighbors != 0);
-					sp->num_neighbors = num_neighbors;
-				}
+				uint8_t data_len = parse_setup_command(data, sp,
+						SETUP_MAX_NEIGHBORS(BROADCAST_PACKET_HDR_SIZE));
 
-				{
-					/* send setup_packet */
-					uint8_t data_len = SETUP_PACKET_SIZE +
-						sp->num_neighbors*sizeof(rimeaddr_t);
+				if (data_len > 0) {
 					LOG("Sending setup packet: new_addr: %d.%d, coord: (%d.%d,%d.%d), is_exit_node: %d, "
 							"num_neighbors: %d, neighbors: ", 
 							sp->new_addr.u8[0],
@@ -1170,6 +1487,24 @@ PROCESS_THREAD(fire_process, ev, data) {
 
 					ec_broadcast(&g_np.c, &rimeaddr_node_addr, &rimeaddr_node_addr,
 							0, g_np.seqno++, sp, data_len);
+				} else {
+					LOG("Bad setup packet\n");
+				}
+			} else if(strncmp(data, "provision_setup_packet",
+						sizeof("provision_setup_packet")-1) == 0) {
+				/* bulk commissioning, the node answers with a SETUP_ACK_PACKET
+				 * which is reported to the GUI */
+				uint8_t tmp[SETUP_PACKET_SIZE+
+					SETUP_MAX_NEIGHBORS(UNICAST_PACKET_HDR_SIZE)*
+					sizeof(rimeaddr_t)] = {0};
+				struct setup_packet *sp = (struct setup_packet*)tmp;
+				uint8_t data_len = parse_setup_command(data, sp,
+						SETUP_MAX_NEIGHBORS(UNICAST_PACKET_HDR_SIZE));
+
+				if (data_len > 0) {
+					ec_mesh(&g_np.c, &sp->new_addr, g_np.seqno++, sp, data_len);
+				} else {
+					LOG("Bad setup packet\n");
 				}
 			} else {
 				LOG("unkown command\n");
@@ -1195,7 +1530,7 @@ PROCESS_THREAD(fire_process, ev, data) {
 								send_emergency_packet();
 								ec_timesynch_network(&g_np.c);
 
-								broadcast_best_path();
+								advertise_best_path();
 							}
 						} else {
 							LOG("Sensed emergency, but not initialized\n");
@@ -1217,7 +1552,7 @@ PROCESS_THREAD(fire_process, ev, data) {
 							blinking_update();
 						}
 
-						broadcast_best_path();
+						advertise_best_path();
 					}
 				}
 			}
@@ -1232,6 +1567,9 @@ PROCESS_THREAD(fire_process, ev, data) {
 					ec_reliable_broadcast_ns(&g_np.c, &rimeaddr_node_addr, &rimeaddr_node_addr,
 							0, g_np.seqno++, &sp, sizeof(struct sensor_packet));
 				}
+				if (g_np.state.is_exit_node) {
+					renew_exit_path(neighbor_node_seqno(&exit_node));
+				}
 			}
 			etimer_set(&keepalive_send_timer, CLOCK_SECOND * 20);
 		}
@@ -1242,10 +1580,25 @@ PROCESS_THREAD(fire_process, ev, data) {
 			 * keep_alive_packet to neighbors (neighbors did not ack it after x
 			 * tries). */
 			if (g_np.state.is_blinking) {
-				struct neighbor_node *nn = neighbors_begin(&g_np.ns);
+				const struct neighbor_node *nn;
 				int need_broadcast_new_path = 0;
+				int failed_over = 0;
+
+				for (nn = neighbors_begin(&g_np.ns); nn != NULL; 
+						nn = neighbors_next(&g_np.ns)) {
+					if (!neighbor_node_has_sent_keep_alive(nn)) {
+						metric_heap_set(&g_np.paths, neighbors_slot(&g_np.ns, nn),
+								METRIC_T_MAX);
+						failed_over |= nn == g_np.bpn;
+					}
+				}
+				if (failed_over) {
+					fail_over();
+				}
+
+				nn = neighbors_begin(&g_np.ns);
 				LOG("-----------------------\n");
-				for (; nn != NULL; nn = neighbors_next(&g_np.ns)) {
+				while (nn != NULL) {
 					if (!neighbor_node_has_sent_keep_alive(nn)) {
 						LOG("Neighbor did not keep-alive: %d.%d, points_to: (%d.%d), coord: (%d.%d,%d.%d), distance: %d, "
 								"hops: %d, metric: %u\n",
@@ -1261,28 +1614,29 @@ PROCESS_THREAD(fire_process, ev, data) {
 								neighbor_node_hops(nn),
 								neighbor_node_metric(nn));
 						//neighbor_node_set_best_path(&max_node, &neighbor_node_best_path_max);
-						if (nn == g_np.bpn) {
-							g_np.bpn = NULL;
-						}
 						neighbors_remove(&g_np.ns, neighbor_node_addr(nn));
+						/* start over, without skipping the new first */
 						nn = neighbors_begin(&g_np.ns);
-						if (nn == NULL) {
-							break;
-						} else {
-							need_broadcast_new_path = 1; 
-						}
+						need_broadcast_new_path = nn != NULL; 
+					} else {
+						nn = neighbors_next(&g_np.ns);
 					}
 				}
 				LOG("-----------------------\n");
 
 				nn = neighbors_begin(&g_np.ns);
 				for (; nn != NULL; nn = neighbors_next(&g_np.ns)) {
-					neighbor_node_set_has_sent_keep_alive(nn, 0);
+					neighbor_node_set_has_sent_keep_alive(neighbors_node_at(&g_np.ns,
+								neighbors_slot(&g_np.ns, nn)), 0);
+					/* its link estimate has moved since the last update */
+					update_path_via(nn);
 				}
 
 				if (need_broadcast_new_path) {
 					if(update_bpn_and_broadcast_new_path_if_changed(NULL)) {
 						blinking_update();
+					} else if (failed_over) {
+						advertise_best_path();
 					}
 				}
 			}
@@ -0,0 +1,107 @@
+#include "base/unittest.h"
+
+#include "emergency_net/metric_heap.h"
+
+#include "lib/random.h"
+
+static struct metric_heap mh;
+
+/* The lowest metric by a linear scan, ties going to any slot holding it. */
+static metric_t scan_min(void) {
+	metric_t min = METRIC_T_MAX;
+	uint8_t i;
+	for (i = 0; i < MAX_NEIGHBORS; ++i) {
+		if (metric_heap_metric(&mh, i) < min) {
+			min = metric_heap_metric(&mh, i);
+		}
+	}
+	return min;
+}
+
+static void test_metric_heap(void) {
+	int i;
+
+	metric_heap_init(&mh);
+	ASSERT(metric_heap_min(&mh) == -1);
+
+	metric_heap_set(&mh, 3, 500);
+	ASSERT(metric_heap_min(&mh) == 3);
+	metric_heap_set(&mh, 5, 400);
+	ASSERT(metric_heap_min(&mh) == 5);
+	metric_heap_set(&mh, 5, 600); /* got worse */
+	ASSERT(metric_heap_min(&mh) == 3);
+	metric_heap_set(&mh, 3, METRIC_T_MAX); /* no longer a candidate */
+	ASSERT(metric_heap_min(&mh) == 5);
+	metric_heap_set(&mh, 5, METRIC_T_MAX);
+	ASSERT(metric_heap_min(&mh) == -1);
+
+	/* against a linear scan */
+	for (i = 0; i < 2000; ++i) {
+		uint8_t slot = random_rand() % MAX_NEIGHBORS;
+		metric_t metric = random_rand() % 8 == 0 ? METRIC_T_MAX :
+			random_rand() % 1000;
+		int8_t min;
+
+		metric_heap_set(&mh, slot, metric);
+		min = metric_heap_min(&mh);
+		if (scan_min() == METRIC_T_MAX) {
+			ASSERT(min == -1);
+		} else {
+			ASSERT(min >= 0 && metric_heap_metric(&mh, min) == scan_min());
+		}
+	}
+}
+
+static void test_metric_heap_best(void) {
+	uint8_t slots[MAX_NEIGHBORS];
+	int i;
+
+	metric_heap_init(&mh);
+	ASSERT(metric_heap_best(&mh, slots, 3) == 0);
+
+	metric_heap_set(&mh, 5, 300);
+	metric_heap_set(&mh, 2, 100);
+	metric_heap_set(&mh, 6, 200);
+	metric_heap_set(&mh, 4, 400);
+	ASSERT(metric_heap_best(&mh, slots, 3) == 3);
+	ASSERT(slots[0] == 2 && slots[1] == 6 && slots[2] == 5);
+	ASSERT(metric_heap_best(&mh, slots, MAX_NEIGHBORS) == 4);
+	ASSERT(slots[3] == 4);
+
+	/* against counting the slots below every returned metric */
+	for (i = 0; i < 500; ++i) {
+		uint8_t k = 1 + random_rand() % MAX_NEIGHBORS;
+		uint8_t n, j, s;
+		metric_heap_set(&mh, random_rand() % MAX_NEIGHBORS, 
+				random_rand() % 4 == 0 ? METRIC_T_MAX : random_rand() % 1000);
+
+		n = metric_heap_best(&mh, slots, k);
+		for (j = 0; j < n; ++j) {
+			uint8_t below = 0;
+			metric_t metric = metric_heap_metric(&mh, slots[j]);
+			ASSERT(metric != METRIC_T_MAX);
+			ASSERT(j == 0 || metric >= metric_heap_metric(&mh, slots[j-1]));
+			for (s = 0; s < MAX_NEIGHBORS; ++s) {
+				below += metric_heap_metric(&mh, s) < metric;
+			}
+			ASSERT(below <= j);
+		}
+		if (n < k) {
+			/* the rest are not candidates */
+			for (s = 0; s < MAX_NEIGHBORS; ++s) {
+				j = 0;
+				while (j < n && slots[j] != s) {
+					++j;
+				}
+				ASSERT(j < n || metric_heap_metric(&mh, s) == METRIC_T_MAX);
+			}
+		}
+	}
+}
+
+static void run_tests(void) {
+	test_metric_heap();
+	test_metric_heap_best();
+}
+
+UNITTEST("testmetricheap", run_tests)
@@ -0,0 +1,110 @@
+#include "base/unittest.h"
+
+#include "emergency_net/neighbors.h"
+
+static struct neighbors ns;
+
+static rimeaddr_t addr(uint8_t hi, uint8_t lo) {
+	rimeaddr_t a;
+	a.u8[0] = hi;
+	a.u8[1] = lo;
+	return a;
+}
+
+static void test_neighbors(void) {
+	rimeaddr_t a = addr(0, 5);
+	rimeaddr_t b = addr(1, 0);
+	rimeaddr_t c = addr(0, 9);
+	const struct neighbor_node *nn;
+	struct neighbor_node *pa;
+	int i;
+
+	neighbors_init(&ns);
+	ASSERT(neighbors_size(&ns) == 0);
+	ASSERT(neighbors_begin(&ns) == NULL);
+	ASSERT(!neighbors_is_neighbor(&ns, &a));
+
+	neighbors_add(&ns, &b);
+	neighbors_add(&ns, &a);
+	neighbors_add(&ns, &c);
+	neighbors_add(&ns, &a); /* twice keeps one */
+	ASSERT(neighbors_size(&ns) == 3);
+	ASSERT(neighbors_is_neighbor(&ns, &a));
+	ASSERT(neighbors_is_neighbor(&ns, &b));
+	ASSERT(neighbors_is_neighbor(&ns, &c));
+
+	/* iterates by ascending address, u8[0] most significant */
+	nn = neighbors_begin(&ns);
+	ASSERT(rimeaddr_cmp(neighbor_node_addr(nn), &a));
+	nn = neighbors_next(&ns);
+	ASSERT(rimeaddr_cmp(neighbor_node_addr(nn), &c));
+	nn = neighbors_next(&ns);
+	ASSERT(rimeaddr_cmp(neighbor_node_addr(nn), &b));
+	ASSERT(neighbors_next(&ns) == NULL);
+
+	/* nodes do not move when others come and go */
+	pa = neighbors_find_neighbor_node(&ns, &a);
+	pa->etx = 42;
+	neighbors_remove(&ns, &c);
+	ASSERT(!neighbors_is_neighbor(&ns, &c));
+	ASSERT(neighbors_find_neighbor_node(&ns, &a) == pa);
+	neighbors_add(&ns, &c);
+	ASSERT(neighbors_find_neighbor_node(&ns, &a) == pa);
+	ASSERT(pa->etx == 42);
+	ASSERT(neighbors_find_neighbor_node(&ns, &c)->etx == 0);
+
+	/* fill up, in descending order */
+	neighbors_clear(&ns);
+	for (i = MAX_NEIGHBORS; i > 0; --i) {
+		rimeaddr_t x = addr(0, (uint8_t)(2*i));
+		neighbors_add(&ns, &x);
+	}
+	ASSERT(neighbors_size(&ns) == MAX_NEIGHBORS);
+	for (i = 0; i <= 2*MAX_NEIGHBORS+1; ++i) {
+		rimeaddr_t x = addr(0, (uint8_t)i);
+		ASSERT(neighbors_is_neighbor(&ns, &x) == (i > 0 && i % 2 == 0));
+	}
+	nn = neighbors_begin(&ns);
+	for (i = 1; nn != NULL; nn = neighbors_next(&ns), ++i) {
+		ASSERT(neighbor_node_addr(nn)->u8[1] == 2*i);
+	}
+	ASSERT(i == MAX_NEIGHBORS+1);
+
+	/* a full table drops new neighbors */
+	{
+		rimeaddr_t x = addr(0, 1);
+		neighbors_add(&ns, &x);
+		ASSERT(neighbors_size(&ns) == MAX_NEIGHBORS);
+		ASSERT(!neighbors_is_neighbor(&ns, &x));
+	}
+
+	/* removing from the middle keeps the order */
+	{
+		rimeaddr_t x = addr(0, 4);
+		neighbors_remove(&ns, &x);
+		neighbors_remove(&ns, &x);
+	}
+	ASSERT(neighbors_size(&ns) == MAX_NEIGHBORS-1);
+	nn = neighbors_begin(&ns);
+	ASSERT(neighbor_node_addr(nn)->u8[1] == 2);
+	nn = neighbors_next(&ns);
+	ASSERT(neighbor_node_addr(nn)->u8[1] == 6);
+}
+
+static void test_seqnos(void) {
+	ASSERT(neighbor_node_seqno_newer(2, 0));
+	ASSERT(neighbor_node_seqno_newer(1, 0));
+	ASSERT(!neighbor_node_seqno_newer(0, 0));
+	ASSERT(!neighbor_node_seqno_newer(0, 2));
+	/* wrap */
+	ASSERT(neighbor_node_seqno_newer(0, 254));
+	ASSERT(neighbor_node_seqno_newer(1, 255));
+	ASSERT(!neighbor_node_seqno_newer(254, 0));
+}
+
+static void run_tests(void) {
+	test_neighbors();
+	test_seqnos();
+}
+
+UNITTEST("testneighbors", run_tests)
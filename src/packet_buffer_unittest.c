@@ -1,73 +1,135 @@
+#include "base/unittest.h"
 
 #include "string.h"
 
-#include "net/packet_buffer.h"
-
-#include "base/log.h"
+#include "emergency_net/packet_buffer.h"
 
+#define TYPE_RELIABLE 1
+#define TYPE_BROADCAST 2
 
 struct test_s {
 	char guard1;
 	char guard2;
-	PACKET_BUFFER(buf, 10);
+	PACKET_BUFFER(buf, 4, 2);
 	char guard3;
 	char guard4;
 };
 
-int main(void) {
-	struct test_s s;
+static struct test_s s;
+
+#ifdef UNITTEST_HOST
+clock_time_t clock_time(void) {
+	return 0;
+}
+#endif
+
+static void test_packet_buffer(void) {
+	struct broadcast_packet p;
+	struct broadcast_packet p2;
+	struct buffered_packet *a;
+	struct buffered_packet *b;
+	struct buffered_packet *c;
+
 	s.guard1 = 'a';
 	s.guard2 = 'b';
 	s.guard3 = 'c';
 	s.guard4 = 'd';
-	PACKET_BUFFER_INIT_WITH_STRUCT(&s, buf, 10);
+	PACKET_BUFFER_INIT_WITH_STRUCT(&s, buf, 4, 2);
+	ASSERT(packet_buffer_has_room_for_packets(&s.buf, 2));
 
-	ASSERT(packet_buffer_has_packet_for_sending(&s.buf) == 0);
-	ASSERT(packet_buffer_get_packet_for_sending(&s.buf) == NULL);
+	memset(&p, 0, sizeof(p));
+	p.hdr.seqno = 1;
+	a = packet_buffer_broadcast_packet(&s.buf, &p, "joha", 4, NULL,
+			TYPE_RELIABLE);
+	ASSERT(a != NULL);
+	ASSERT(packet_buffer_data_len(a) == 4);
+	ASSERT(packet_buffer_times_sent(a) == 0);
+	ASSERT(packet_buffer_refs(a) == 1);
+	ASSERT(memcmp(packet_buffer_get_packet(a), &p, BROADCAST_PACKET_HDR_SIZE) == 0);
+	ASSERT(memcmp(packet_buffer_get_packet(a)->data, "joha", 4) == 0);
+	ASSERT(packet_buffer_get_first_packet_from_type(&s.buf, TYPE_RELIABLE) == a);
 
+	/* the same packet again is not copied */
+	b = packet_buffer_broadcast_packet(&s.buf, &p, "joha", 4, NULL,
+			TYPE_BROADCAST);
+	ASSERT(b != NULL && b != a);
+	ASSERT(packet_buffer_get_packet(b) == packet_buffer_get_packet(a));
+	ASSERT(packet_buffer_refs(a) == 2);
+	ASSERT(packet_buffer_num_packets_of_type(&s.buf, TYPE_BROADCAST) == 1);
+
+	/* a shared packet can not grow */
+	ASSERT(!packet_buffer_append_data(a, "x", 1));
+
+	/* a packet with other data is */
+	c = packet_buffer_broadcast_packet(&s.buf, &p, "joH", 3, NULL,
+			TYPE_BROADCAST);
+	ASSERT(c != NULL);
+	ASSERT(packet_buffer_get_packet(c) != packet_buffer_get_packet(a));
+	ASSERT(packet_buffer_refs(c) == 1);
+	ASSERT(packet_buffer_append_data(c, "x", 1));
+	ASSERT(packet_buffer_data_len(c) == 4);
+	ASSERT(!packet_buffer_has_room_for_packets(&s.buf, 1));
+
+	/* the pool is full, sharing still works */
+	memcpy(&p2, &p, sizeof(p2));
+	p2.hdr.seqno = 2;
+	ASSERT(packet_buffer_broadcast_packet(&s.buf, &p2, "joha", 4, NULL,
+				TYPE_BROADCAST) == NULL);
+	ASSERT(packet_buffer_share(&s.buf, c, NULL, TYPE_RELIABLE) != NULL);
+	ASSERT(packet_buffer_refs(c) == 2);
+	/* and now the entries are */
+	ASSERT(packet_buffer_share(&s.buf, c, NULL, TYPE_RELIABLE) == NULL);
+	ASSERT(packet_buffer_refs(c) == 2);
+
+	/* the packet stays until its last entry is freed */
+	packet_buffer_free(&s.buf, a);
+	ASSERT(packet_buffer_refs(b) == 1);
+	ASSERT(memcmp(packet_buffer_get_packet(b)->data, "joha", 4) == 0);
+	ASSERT(!packet_buffer_has_room_for_packets(&s.buf, 1));
+	packet_buffer_free(&s.buf, b);
+	ASSERT(packet_buffer_has_room_for_packets(&s.buf, 1));
+	ASSERT(packet_buffer_broadcast_packet(&s.buf, &p2, "joha", 4, NULL,
+				TYPE_BROADCAST) != NULL);
+
+	packet_buffer_clear_priority(&s.buf, TYPE_BROADCAST);
+	ASSERT(packet_buffer_num_packets_of_type(&s.buf, TYPE_BROADCAST) == 0);
+	ASSERT(packet_buffer_refs(packet_buffer_get_first_packet_from_type(&s.buf,
+					TYPE_RELIABLE)) == 1);
+	packet_buffer_clear_priority(&s.buf, TYPE_RELIABLE);
+	ASSERT(packet_buffer_has_room_for_packets(&s.buf, 2));
+
+	/* forwarding copies the received header and data and patches it */
 	{
-		struct packet p = { {1, {{2, 3}}, {{4, 5}}, 6} };
-		struct buffered_packet *bp = packet_buffer_packet(&s.buf, &p, "joha", 4, 1);
-		struct packet *pp = packet_buffer_get_packet(bp);
-
-		ASSERT(memcmp(pp, &p, sizeof(struct packet)) == 0);
-		ASSERT(packet_buffer_data_len(bp) == 4);
-		ASSERT(packet_buffer_times_acked(bp) == 0);
-		ASSERT(packet_buffer_times_sent(bp) == 0);
-		ASSERT(memcmp("joha", packet_buffer_get_data(bp), packet_buffer_data_len(bp)) == 0);
-		ASSERT(packet_buffer_find_packet(&s.buf, &p) == bp);
-
-		ASSERT(packet_buffer_get_packet_for_sending(&s.buf) == bp);
-	}
-	{
-		struct packet p = { {3, {{4, 5}}, {{6,7}},8} };
-		struct buffered_packet *bp = packet_buffer_packet(&s.buf, &p, "joH", 3, 2);
-		struct packet *pp = packet_buffer_get_packet(bp);
-
-		ASSERT(memcmp(pp, &p, sizeof(struct packet)) == 0);
-		ASSERT(packet_buffer_data_len(bp) == 3);
-		ASSERT(packet_buffer_times_acked(bp) == 0);
-		ASSERT(packet_buffer_times_sent(bp) == 0);
-		ASSERT(memcmp("joH", packet_buffer_get_data(bp), packet_buffer_data_len(bp)) == 0);
-		ASSERT(packet_buffer_find_packet(&s.buf, &p) == bp);
-
-		ASSERT(packet_buffer_get_packet_for_sending(&s.buf) != bp);
-
-		{
-			struct packet p1 = { {1, {{2, 3}}, {{4, 5}}, 6} };
-			struct buffered_packet *bpp = packet_buffer_get_packet_for_sending(&s.buf);
-			ASSERT(packet_buffer_find_packet(&s.buf, &p1) == bpp);
-			ASSERT(memcmp("joha", packet_buffer_get_data(bpp), packet_buffer_data_len(bpp)) == 0);
-			packet_buffer_free(&s.buf, bpp);
-			ASSERT(packet_buffer_find_packet(&s.buf, &p1) == NULL);
-		}
-
-		ASSERT(packet_buffer_get_packet_for_sending(&s.buf) == bp);;
+		uint8_t frame[BROADCAST_PACKET_HDR_SIZE+5];
+		struct packet *rx = (struct packet*)frame;
+		const struct packet *fp;
+		rimeaddr_t self = { {9, 9} };
+		memcpy(rx, &p, BROADCAST_PACKET_HDR_SIZE);
+		rx->hdr.flags = BROADCAST|MISSING;
+		rx->hdr.hops = 3;
+		rx->hdr.sender.u8[0] = 7;
+		memcpy(rx->data, "mjoha", 5);
+
+		a = packet_buffer_forward_packet(&s.buf, rx, rx->data+1, 4, &self,
+				NULL, TYPE_BROADCAST);
+		ASSERT(a != NULL);
+		fp = packet_buffer_get_packet(a);
+		ASSERT(fp->hdr.flags == BROADCAST);
+		ASSERT(fp->hdr.hops == 4);
+		ASSERT(rimeaddr_cmp(&fp->hdr.sender, &self));
+		ASSERT(rimeaddr_cmp(&fp->hdr.originator, &p.hdr.originator));
+		ASSERT(fp->hdr.seqno == p.hdr.seqno);
+		ASSERT(packet_buffer_data_len(a) == 4);
+		ASSERT(memcmp(fp->data, "joha", 4) == 0);
+		/* the received frame is left alone */
+		ASSERT(rx->hdr.hops == 3 && rx->hdr.sender.u8[0] == 7);
+		packet_buffer_free(&s.buf, a);
 	}
+
 	ASSERT(s.guard1 == 'a');
 	ASSERT(s.guard2 == 'b');
 	ASSERT(s.guard3 == 'c');
 	ASSERT(s.guard4 == 'd');
-
-	return 0;
 }
+
+UNITTEST("testpacketbuffer", test_packet_buffer)
@@ -1,6 +1,5 @@
-#include "contiki.h"
-
-#include "dev/serial-line.h"
+/* The host build also runs a microbenchmark of the queue operations. */
+#include "base/unittest.h"
 
 #include "string.h"
 
@@ -8,8 +7,6 @@
 
 #include "base/queue_buffer.h"
 
-#include "base/log.h"
-
 struct t {
 	char a;
 	char b;
@@ -33,79 +30,224 @@ struct test_s {
 	char guard4;
 };
 
-PROCESS(test_process, "testqueue");
-AUTOSTART_PROCESSES(&test_process);
+static void test_queue_buffer(void) {
+	struct test_s s;
+	s.guard1 = 'A';
+	s.guard2 = 'B';
+	s.guard3 = 'C';
+	s.guard4 = 'D';
+	LOG("BEGINING TEST\n");
+
+	QUEUE_BUFFER_INIT_WITH_STRUCT(&s, qb, sizeof(struct t), 8);
+
+	ASSERT(queue_buffer_size(&s.qb) == 0);
+	ASSERT(queue_buffer_max_size(&s.qb) == 8);
+	ASSERT(queue_buffer_begin(&s.qb) == NULL);
+
+	{
+		struct t tt1 = {'a','b','c'};
+		struct t *qt1 = (struct t*)queue_buffer_push_front(&s.qb, &tt1);
+		ASSERT(memcmp(&tt1, qt1, sizeof(struct t)) == 0);
+
+		ASSERT(queue_buffer_begin(&s.qb) == qt1);
+		ASSERT(queue_buffer_next(&s.qb) == NULL);
+		ASSERT(queue_buffer_size(&s.qb) == 1);
+		ASSERT(queue_buffer_max_size(&s.qb) == 8);
+		ASSERT(queue_buffer_find(&s.qb, &tt1, cmparer) == qt1);
+
+		struct t tt2 = {'d','e','f'};
+		struct t *qt2 = (struct t*)queue_buffer_push_front(&s.qb, &tt2);
+		ASSERT(memcmp(&tt2, qt2, sizeof(struct t)) == 0);
+
+		ASSERT(queue_buffer_begin(&s.qb) == qt2);
+		ASSERT(queue_buffer_next(&s.qb) == qt1);
+		ASSERT(queue_buffer_next(&s.qb) == NULL);
+		ASSERT(queue_buffer_size(&s.qb) == 2);
+		ASSERT(queue_buffer_max_size(&s.qb) == 8);
+		ASSERT(queue_buffer_find(&s.qb, &tt1, cmparer) == qt1);
+		ASSERT(queue_buffer_find(&s.qb, &tt2, cmparer) == qt2);
 
-PROCESS_THREAD(test_process, ev, data) {
+#if 0
+		queue_buffer_free(&s.qb, qt2);
+		ASSERT(queue_buffer_begin(&s.qb) == qt1);
+		ASSERT(queue_buffer_next(&s.qb) == NULL);
+		ASSERT(queue_buffer_size(&s.qb) == 1);
+		ASSERT(queue_buffer_max_size(&s.qb) == 8);
+		ASSERT(queue_buffer_find(&s.qb, &tt1, cmparer) == qt1);
+		ASSERT(queue_buffer_find(&s.qb, &tt2, cmparer) == NULL);
+#else
+		queue_buffer_free(&s.qb, qt1);
+		ASSERT(queue_buffer_begin(&s.qb) == qt2);
+		ASSERT(queue_buffer_next(&s.qb) == NULL);
+		ASSERT(queue_buffer_size(&s.qb) == 1);
+		ASSERT(queue_buffer_max_size(&s.qb) == 8);
+		ASSERT(queue_buffer_find(&s.qb, &tt1, cmparer) == NULL);
+		ASSERT(queue_buffer_find(&s.qb, &tt2, cmparer) == qt2);
 
-	PROCESS_BEGIN();
+#endif
+	}
 
-	while(1) {
-		PROCESS_WAIT_EVENT();
-		if (ev == serial_line_event_message && data != NULL) {
-			struct test_s s;
-			s.guard1 = 'A';
-			s.guard2 = 'B';
-			s.guard3 = 'C';
-			s.guard4 = 'D';
-			LOG("BEGINING TEST\n");
+	ASSERT(s.guard1 == 'A');
+	ASSERT(s.guard2 == 'B');
+	ASSERT(s.guard3 == 'C');
+	ASSERT(s.guard4 == 'D');
+}
 
-			QUEUE_BUFFER_INIT_WITH_STRUCT(&s, qb, sizeof(struct t), 8);
+static void test_queue_buffer_back(void) {
+	QUEUE_BUFFER(qb, sizeof(struct t), 8);
+	struct t tt[8];
+	struct t out;
+	struct t *q[8];
+	int i;
+
+	queue_buffer_init(&qb, sizeof(struct t), 8, qb_buffer);
+	ASSERT(queue_buffer_front(&qb) == NULL);
+	ASSERT(queue_buffer_back(&qb) == NULL);
+
+	for (i = 0; i < 8; ++i) {
+		tt[i].a = 'a'+i;
+		tt[i].b = 'b'+i;
+		tt[i].c = 'c'+i;
+		q[i] = (struct t*)queue_buffer_push_back(&qb, &tt[i]);
+		ASSERT(q[i] != NULL);
+		ASSERT(queue_buffer_back(&qb) == q[i]);
+		ASSERT(queue_buffer_front(&qb) == q[0]);
+	}
+	ASSERT(queue_buffer_size(&qb) == 8);
+	ASSERT(queue_buffer_push_back(&qb, &tt[0]) == NULL);
+	ASSERT(queue_buffer_alloc_front(&qb) == NULL);
+
+	/* free in the middle, at the back and at the front */
+	queue_buffer_free(&qb, q[3]);
+	queue_buffer_free(&qb, q[7]);
+	queue_buffer_free(&qb, q[0]);
+	ASSERT(queue_buffer_size(&qb) == 5);
+	ASSERT(queue_buffer_front(&qb) == q[1]);
+	ASSERT(queue_buffer_back(&qb) == q[6]);
+	ASSERT(queue_buffer_find(&qb, &tt[3], cmparer) == NULL);
+	{
+		const int order[] = {1, 2, 4, 5, 6};
+		struct t *it = (struct t*)queue_buffer_begin(&qb);
+		for (i = 0; i < 5; ++i) {
+			ASSERT(it == q[order[i]]);
+			it = (struct t*)queue_buffer_next(&qb);
+		}
+		ASSERT(it == NULL);
+	}
 
-			ASSERT(queue_buffer_size(&s.qb) == 0);
-			ASSERT(queue_buffer_max_size(&s.qb) == 8);
-			ASSERT(queue_buffer_begin(&s.qb) == NULL);
+	queue_buffer_pop_back(&qb, &out);
+	ASSERT(memcmp(&out, &tt[6], sizeof(struct t)) == 0);
+	queue_buffer_pop_front(&qb, &out);
+	ASSERT(memcmp(&out, &tt[1], sizeof(struct t)) == 0);
+	ASSERT(queue_buffer_front(&qb) == q[2]);
+	ASSERT(queue_buffer_back(&qb) == q[5]);
+
+	/* dupe queue pattern: evict the oldest, add the newest in front */
+	for (i = 0; i < 20; ++i) {
+		struct t *n = (struct t*)queue_buffer_alloc_front(&qb);
+		if (n == NULL) {
+			queue_buffer_pop_back(&qb, NULL);
+			n = (struct t*)queue_buffer_alloc_front(&qb);
+		}
+		ASSERT(n != NULL);
+		ASSERT(queue_buffer_front(&qb) == n);
+	}
+	ASSERT(queue_buffer_size(&qb) == 8);
+
+	queue_buffer_clear(&qb);
+	ASSERT(queue_buffer_size(&qb) == 0);
+	ASSERT(queue_buffer_front(&qb) == NULL);
+	ASSERT(queue_buffer_back(&qb) == NULL);
+	for (i = 0; i < 8; ++i) {
+		ASSERT(queue_buffer_alloc_back(&qb) != NULL);
+	}
+	ASSERT(queue_buffer_alloc_back(&qb) == NULL);
+}
 
-			{
-				struct t tt1 = {'a','b','c'};
-				struct t *qt1 = (struct t*)queue_buffer_push_front(&s.qb, &tt1);
-				ASSERT(memcmp(&tt1, qt1, sizeof(struct t)) == 0);
+#ifdef UNITTEST_HOST
+#include <stdio.h>
+#include <time.h>
 
-				ASSERT(queue_buffer_begin(&s.qb) == qt1);
-				ASSERT(queue_buffer_next(&s.qb) == NULL);
-				ASSERT(queue_buffer_size(&s.qb) == 1);
-				ASSERT(queue_buffer_max_size(&s.qb) == 8);
-				ASSERT(queue_buffer_find(&s.qb, &tt1, cmparer) == qt1);
+#define BENCH_ROUNDS 2000
 
-				struct t tt2 = {'d','e','f'};
-				struct t *qt2 = (struct t*)queue_buffer_push_front(&s.qb, &tt2);
-				ASSERT(memcmp(&tt2, qt2, sizeof(struct t)) == 0);
+#if defined(__i386__) || defined(__x86_64__)
+#define BENCH_UNIT "cycles"
+static inline uint64_t bench_now(void) {
+	return __builtin_ia32_rdtsc();
+}
+#else
+#define BENCH_UNIT "ns"
+static inline uint64_t bench_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+#endif
 
-				ASSERT(queue_buffer_begin(&s.qb) == qt2);
-				ASSERT(queue_buffer_next(&s.qb) == qt1);
-				ASSERT(queue_buffer_next(&s.qb) == NULL);
-				ASSERT(queue_buffer_size(&s.qb) == 2);
-				ASSERT(queue_buffer_max_size(&s.qb) == 8);
-				ASSERT(queue_buffer_find(&s.qb, &tt1, cmparer) == qt1);
-				ASSERT(queue_buffer_find(&s.qb, &tt2, cmparer) == qt2);
+static uint8_t bench_buffer[255][QUEUE_BUFFER_S_HDR_SIZE+sizeof(struct t)];
+static struct t *bench_items[255];
+
+static void bench_queue_buffer(int num_items) {
+	struct queue_buffer qb;
+	struct t item = {'x','y','z'};
+	uint64_t push_back = 0;
+	uint64_t pop_back = 0;
+	uint64_t free_back = 0;
+	uint64_t dupe = 0;
+	uint64_t begin;
+	int r;
+	int i;
+
+	queue_buffer_init(&qb, sizeof(struct t), num_items, bench_buffer);
+
+	for (r = 0; r < BENCH_ROUNDS; ++r) {
+		begin = bench_now();
+		for (i = 0; i < num_items; ++i) {
+			bench_items[i] = (struct t*)queue_buffer_push_back(&qb, &item);
+		}
+		push_back += bench_now() - begin;
 
-#if 0
-				queue_buffer_free(&s.qb, qt2);
-				ASSERT(queue_buffer_begin(&s.qb) == qt1);
-				ASSERT(queue_buffer_next(&s.qb) == NULL);
-				ASSERT(queue_buffer_size(&s.qb) == 1);
-				ASSERT(queue_buffer_max_size(&s.qb) == 8);
-				ASSERT(queue_buffer_find(&s.qb, &tt1, cmparer) == qt1);
-				ASSERT(queue_buffer_find(&s.qb, &tt2, cmparer) == NULL);
-#else
-				queue_buffer_free(&s.qb, qt1);
-				ASSERT(queue_buffer_begin(&s.qb) == qt2);
-				ASSERT(queue_buffer_next(&s.qb) == NULL);
-				ASSERT(queue_buffer_size(&s.qb) == 1);
-				ASSERT(queue_buffer_max_size(&s.qb) == 8);
-				ASSERT(queue_buffer_find(&s.qb, &tt1, cmparer) == NULL);
-				ASSERT(queue_buffer_find(&s.qb, &tt2, cmparer) == qt2);
+		/* full queue: evict oldest, insert newest (store_packet_for_dupe_checks) */
+		begin = bench_now();
+		for (i = 0; i < num_items; ++i) {
+			queue_buffer_pop_back(&qb, NULL);
+			queue_buffer_alloc_front(&qb);
+		}
+		dupe += bench_now() - begin;
 
-#endif
-			}
+		begin = bench_now();
+		for (i = 0; i < num_items; ++i) {
+			queue_buffer_pop_back(&qb, NULL);
+		}
+		pop_back += bench_now() - begin;
 
-			ASSERT(s.guard1 == 'A');
-			ASSERT(s.guard2 == 'B');
-			ASSERT(s.guard3 == 'C');
-			ASSERT(s.guard4 == 'D');
-			LOG("TEST OK\n");
+		for (i = 0; i < num_items; ++i) {
+			bench_items[i] = (struct t*)queue_buffer_push_back(&qb, &item);
+		}
+		begin = bench_now();
+		for (i = num_items-1; i >= 0; --i) {
+			queue_buffer_free(&qb, bench_items[i]);
 		}
+		free_back += bench_now() - begin;
 	}
 
-	PROCESS_END();
+	printf("%3d items: push_back %5.1f, pop_back %5.1f, free %5.1f, "
+			"pop_back+alloc_front %5.1f " BENCH_UNIT "/op\n", num_items,
+			(double)push_back/BENCH_ROUNDS/num_items,
+			(double)pop_back/BENCH_ROUNDS/num_items,
+			(double)free_back/BENCH_ROUNDS/num_items,
+			(double)dupe/BENCH_ROUNDS/num_items);
 }
+#endif
+
+static void run_tests(void) {
+	test_queue_buffer();
+	test_queue_buffer_back();
+#ifdef UNITTEST_HOST
+	bench_queue_buffer(8);
+	bench_queue_buffer(24);
+	bench_queue_buffer(255);
+#endif
+}
+
+UNITTEST("testqueue", run_tests)
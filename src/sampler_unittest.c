@@ -0,0 +1,81 @@
+/* Runs on the mote (type anything on the serial line), printing a sample of
+ * every sensor, or on the host against the mock sensors:
+ *
+ * make -C src/sim check
+ *
+ * The test waits for the sampler, so it has its own process instead of
+ * UNITTEST(). */
+#include "base/unittest.h"
+
+#ifdef UNITTEST_HOST
+#include "sim/sampler_mock.h"
+#endif
+
+#include "base/sampler.h"
+
+static int is_done;
+
+PROCESS(test_process, "testsampler");
+#ifndef UNITTEST_HOST
+AUTOSTART_PROCESSES(&test_process);
+#endif
+
+PROCESS_THREAD(test_process, ev, data) {
+	static int s;
+	const struct sampler_reading *r;
+
+	PROCESS_BEGIN();
+
+#ifndef UNITTEST_HOST
+	sampler_init();
+#endif
+
+	while(!is_done) {
+#ifndef UNITTEST_HOST
+		PROCESS_WAIT_EVENT_UNTIL(ev == serial_line_event_message &&
+				data != NULL);
+#endif
+		for (s = 0; s < SAMPLER_SOURCES; ++s) {
+			ASSERT(!sampler_busy());
+			ASSERT(sampler_start(s));
+			/* one at a time */
+			ASSERT(sampler_busy());
+			ASSERT(!sampler_start(s));
+
+			PROCESS_WAIT_EVENT_UNTIL(ev == sampler_event);
+			r = (const struct sampler_reading*)data;
+			ASSERT(r->source == s);
+			ASSERT(!sampler_busy());
+			LOG("source %d: %u\n", s, r->value);
+#ifdef UNITTEST_HOST
+			ASSERT(r->value == 100+s);
+			ASSERT(sampler_mock_samples(s) == 1);
+#endif
+		}
+		LOG("TEST OK\n");
+#ifdef UNITTEST_HOST
+		is_done = 1;
+#endif
+	}
+
+	PROCESS_END();
+}
+
+#ifdef UNITTEST_HOST
+int main(void) {
+	int s;
+
+	process_init();
+	sampler_init();
+	for (s = 0; s < SAMPLER_SOURCES; ++s) {
+		sampler_mock_set(s, 100+s);
+	}
+
+	process_start(&test_process, NULL);
+	while (process_run() > 0) {
+	}
+
+	ASSERT(is_done);
+	return 0;
+}
+#endif
@@ -0,0 +1,83 @@
+/* The parts of Contiki that emergency_net depends on, reimplemented on top of
+ * the simulator: virtual clock, ctimers, abc and mesh connections. packetbuf,
+ * rimeaddr and random are linked from Contiki unchanged. */
+#include "contiki.h"
+#include "net/rime/abc.h"
+#include "net/rime/mesh.h"
+#include "net/rime/ctimer.h"
+#include "net/rime/timesynch.h"
+
+#include "sim/sim.h"
+#include "sim/radio_medium.h"
+
+/* Marks a pending ctimer. Contiki uses PROCESS_NONE for expired etimers. */
+static struct process pending;
+
+/* Every ctimer_set hands out a new stamp so that events of a timer that has
+ * since been stopped or re-set are ignored when they fire. The stamp is kept
+ * in etimer.timer.start, which nothing in emergency_net reads. */
+static uint32_t ctimer_stamp;
+
+clock_time_t clock_time(void) {
+	return (clock_time_t)(sim_now()*CLOCK_SECOND/SIM_USEC_PER_SECOND);
+}
+
+static void ctimer_fire(void *a, void *b, uint32_t stamp) {
+	struct ctimer *c = (struct ctimer*)a;
+	if (c->etimer.p == &pending && c->etimer.timer.start == stamp) {
+		c->etimer.p = PROCESS_NONE;
+		c->f(c->ptr);
+	}
+}
+
+void ctimer_set(struct ctimer *c, clock_time_t t, void (*f)(void *), void *ptr) {
+	c->f = f;
+	c->ptr = ptr;
+	c->etimer.p = &pending;
+	c->etimer.timer.start = ++ctimer_stamp;
+	c->etimer.timer.interval = t;
+	sim_schedule(sim_now()+SIM_TICKS_TO_USEC(t), sim_current_node(),
+			ctimer_fire, c, NULL, ctimer_stamp);
+}
+
+void ctimer_stop(struct ctimer *c) {
+	c->etimer.p = PROCESS_NONE;
+}
+
+int ctimer_expired(struct ctimer *c) {
+	return c->etimer.p != &pending;
+}
+
+void abc_open(struct abc_conn *c, uint16_t channel,
+		const struct abc_callbacks *callbacks) {
+	c->channel.channelno = channel;
+	c->u = callbacks;
+	radio_medium_open_abc(c);
+}
+
+void abc_close(struct abc_conn *c) {
+	radio_medium_close_abc(c);
+}
+
+int abc_send(struct abc_conn *c) {
+	return radio_medium_transmit(c->channel.channelno);
+}
+
+void mesh_open(struct mesh_conn *c, uint16_t channels,
+		const struct mesh_callbacks *callbacks) {
+	c->cb = callbacks;
+	radio_medium_open_mesh(c, channels);
+}
+
+void mesh_close(struct mesh_conn *c) {
+	radio_medium_close_mesh(c);
+}
+
+int mesh_send(struct mesh_conn *c, const rimeaddr_t *dest) {
+	return radio_medium_mesh_transmit(c, dest);
+}
+
+/* Time synchronization is not simulated; emergency_conn still keeps its
+ * authority bookkeeping in timesynch_gluer. */
+void timesynch_init(void) {
+}
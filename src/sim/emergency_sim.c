@@ -0,0 +1,514 @@
+/* Throughput benchmark for emergency_conn on the simulated radio medium.
+ *
+ * Places width*height nodes on a grid, makes every node within radio range a
+ * neighbor (up to MAX_NEIGHBORS) and lets every node originate a packet every
+ * interval. Reports delivered packets per second, ACK round-trips sniffed off
+ * the medium and sending queue occupancy.
+ *
+ * The flood modes instead let the center node originate an alarm every
+ * interval that every other node refloods, either blindly with ec_broadcast
+ * or with ec_trickle, and report coverage and frames per alarm.
+ *
+ * eg:
+ * ./emergency_sim -x 40 -y 25 -t 120 -i 2000 -l 0.05
+ * ./emergency_sim -x 30 -y 30 -r 2.5 -m tr
+ */
+#include "contiki.h"
+#include "lib/random.h"
+
+#include "emergency_net/emergency_conn.h"
+#include "emergency_net/packet.h"
+
+#include "sim/sim.h"
+#include "sim/radio_medium.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define EMERGENCY_SIM_CHANNEL 128
+#define SENT_HISTORY 8
+#define QUEUE_SAMPLE_INTERVAL (CLOCK_SECOND/10)
+#define PAYLOAD_SIZE 4
+
+enum sim_mode {
+	MODE_RELIABLE_NS, /* ec_reliable_broadcast_ns */
+	MODE_BROADCAST, /* ec_broadcast */
+	MODE_FLOOD, /* reflood with ec_broadcast */
+	MODE_TRICKLE /* reflood with ec_trickle */
+};
+
+static const char *mode_names[] = {"ns", "bc", "fl", "tr"};
+
+static const char *class_names[PACKET_BUFFER_MAX_TYPES] = {"neighbor ack",
+	"neighbor data", "broadcast", "mc/uc ack", "mc/uc data", "timesynch",
+	"mesh", "trickle"};
+
+struct sent_packet {
+	uint16_t channel;
+	rimeaddr_t originator;
+	uint8_t seqno;
+	sim_time_t at;
+};
+
+struct sim_app {
+	struct ec c;
+	struct neighbors ns;
+	struct ctimer send_timer;
+	uint8_t seqno;
+	struct sent_packet sent[SENT_HISTORY];
+	uint8_t sent_next;
+};
+
+static struct {
+	int width;
+	int height;
+	double range;
+	clock_time_t duration;
+	clock_time_t interval;
+	enum sim_mode mode;
+} opt;
+
+static struct {
+	uint64_t originated;
+	uint64_t delivered;
+	uint64_t rtt_samples;
+	sim_time_t rtt_sum;
+	sim_time_t rtt_min;
+	sim_time_t rtt_max;
+	sim_time_t flood_origin[256]; /* by seqno */
+	sim_time_t flood_latency_sum;
+	uint64_t queue_samples;
+	uint64_t queue_sum;
+	int queue_max;
+} stats;
+
+static struct ctimer queue_sample_timer;
+
+static struct sim_app* app_of(struct sim_node *n) {
+	return (struct sim_app*)n->app;
+}
+
+static int is_flood_mode(void) {
+	return opt.mode == MODE_FLOOD || opt.mode == MODE_TRICKLE;
+}
+
+static void flood(struct ec *c, const rimeaddr_t *originator, uint8_t hops,
+		uint8_t seqno, const void *data, uint8_t data_len) {
+	if (opt.mode == MODE_TRICKLE) {
+		ec_trickle(c, originator, &rimeaddr_node_addr, hops, seqno, data,
+				data_len);
+	} else {
+		ec_broadcast(c, originator, &rimeaddr_node_addr, hops, seqno, data,
+				data_len);
+	}
+}
+
+static void recv_data(struct ec *c, const rimeaddr_t *originator,
+		const rimeaddr_t *sender, uint8_t hops, uint8_t seqno,
+		const void *data, uint8_t data_len) {
+	++stats.delivered;
+	if (is_flood_mode()) {
+		stats.flood_latency_sum += sim_now() - stats.flood_origin[seqno];
+		ec_forward(c, opt.mode == MODE_TRICKLE ? MSG_TYPE_TRICKLE_DATA :
+				MSG_TYPE_BROADCAST_DATA);
+	}
+}
+
+static void recv_timesynch(struct ec *c) {
+}
+
+static void recv_mesh(struct ec *c, const rimeaddr_t *originator,
+		uint8_t hops, uint8_t seqno, const void *data, uint8_t data_len) {
+	++stats.delivered;
+}
+
+static const struct ec_callbacks ec_cb = {recv_data, recv_data, recv_data,
+	recv_timesynch, recv_mesh};
+
+static void send_packet(void *ptr) {
+	struct sim_app *a = (struct sim_app*)ptr;
+	uint8_t payload[PAYLOAD_SIZE] = {0};
+
+	if (opt.mode == MODE_RELIABLE_NS) {
+		ec_reliable_broadcast_ns(&a->c, &rimeaddr_node_addr,
+				&rimeaddr_node_addr, 0, a->seqno++, payload, sizeof(payload));
+	} else if (is_flood_mode()) {
+		stats.flood_origin[a->seqno] = sim_now();
+		flood(&a->c, &rimeaddr_node_addr, 0, a->seqno++, payload,
+				sizeof(payload));
+	} else {
+		ec_broadcast(&a->c, &rimeaddr_node_addr, &rimeaddr_node_addr, 0,
+				a->seqno++, payload, sizeof(payload));
+	}
+	++stats.originated;
+
+	ctimer_set(&a->send_timer, opt.interval, send_packet, a);
+}
+
+static void sample_queues(void *ptr) {
+	int i;
+	for (i = 0; i < radio_medium_num_nodes(); ++i) {
+		int size = queue_buffer_size(app_of(radio_medium_node(i))->c.sq.buffer);
+		stats.queue_sum += size;
+		if (size > stats.queue_max) {
+			stats.queue_max = size;
+		}
+	}
+	++stats.queue_samples;
+
+	ctimer_set(&queue_sample_timer, QUEUE_SAMPLE_INTERVAL, sample_queues, NULL);
+}
+
+static int is_acked_channel(uint16_t channel) {
+	return channel == EMERGENCY_SIM_CHANNEL || channel == EMERGENCY_SIM_CHANNEL+2;
+}
+
+/* Remembers when a data packet was first put on air. */
+static void sniff_tx(struct sim_node *n, uint16_t channel, const uint8_t *data,
+		uint8_t len) {
+	const struct packet *p = (const struct packet*)data;
+	struct sim_app *a = app_of(n);
+	int i;
+
+	if (!is_acked_channel(channel) || IS_PACKET_FLAG_SET(p, ACK) ||
+			IS_PACKET_FLAG_SET(p, TIMESYNCH)) {
+		return;
+	}
+
+	for (i = 0; i < SENT_HISTORY; ++i) {
+		if (a->sent[i].channel == channel && a->sent[i].seqno == p->hdr.seqno &&
+				rimeaddr_cmp(&a->sent[i].originator, &p->hdr.originator)) {
+			return;
+		}
+	}
+
+	a->sent[a->sent_next].channel = channel;
+	rimeaddr_copy(&a->sent[a->sent_next].originator, &p->hdr.originator);
+	a->sent[a->sent_next].seqno = p->hdr.seqno;
+	a->sent[a->sent_next].at = sim_now();
+	a->sent_next = (a->sent_next+1) % SENT_HISTORY;
+}
+
+/* Matches ACKs addressed to us, standalone or piggybacked, against the
+ * first transmission. */
+static void sniff_rx(struct sim_node *n, uint16_t channel, const uint8_t *data,
+		uint8_t len) {
+	const struct packet *p = (const struct packet*)data;
+	const struct ack_entry *acks;
+	uint8_t num_acks;
+	struct sim_app *a = app_of(n);
+
+	if (!is_acked_channel(channel)) {
+		return;
+	}
+
+	for (num_acks = packet_acks(p, &len, &acks); num_acks > 0;
+			--num_acks, ++acks) {
+		int i;
+		if (!rimeaddr_cmp(&acks->to, &n->addr)) {
+			continue;
+		}
+		for (i = 0; i < SENT_HISTORY; ++i) {
+			if (a->sent[i].channel == channel && a->sent[i].seqno == acks->seqno &&
+					rimeaddr_cmp(&a->sent[i].originator, &acks->originator)) {
+				sim_time_t rtt = sim_now() - a->sent[i].at;
+				if (stats.rtt_samples == 0 || rtt < stats.rtt_min) {
+					stats.rtt_min = rtt;
+				}
+				if (rtt > stats.rtt_max) {
+					stats.rtt_max = rtt;
+				}
+				stats.rtt_sum += rtt;
+				++stats.rtt_samples;
+				break;
+			}
+		}
+	}
+}
+
+static void setup_nodes(void) {
+	int i;
+	int num_nodes = opt.width*opt.height;
+
+	for (i = 0; i < num_nodes; ++i) {
+		rimeaddr_t addr;
+		struct sim_node *n;
+		addr.u8[0] = (uint8_t)((i+1) & 0xFF);
+		addr.u8[1] = (uint8_t)((i+1) >> 8);
+		n = radio_medium_add_node(&addr, i % opt.width, i / opt.width);
+		n->app = calloc(1, sizeof(struct sim_app));
+		if (n->app == NULL) {
+			abort();
+		}
+	}
+
+	radio_medium_connect(opt.range);
+
+	for (i = 0; i < num_nodes; ++i) {
+		struct sim_node *n = radio_medium_node(i);
+		struct sim_app *a = app_of(n);
+		int j;
+
+		sim_set_current_node(n);
+		neighbors_init(&a->ns);
+		for (j = 0; j < n->num_in_range && j < MAX_NEIGHBORS; ++j) {
+			neighbors_add(&a->ns, &n->in_range[j]->addr);
+		}
+
+		ec_open(&a->c, EMERGENCY_SIM_CHANNEL, &ec_cb);
+		ec_set_neighbors(&a->c, &a->ns);
+
+		/* random phase so that nodes do not start in lockstep */
+		if (!is_flood_mode() || i == num_nodes/2 + opt.width/2) {
+			ctimer_set(&a->send_timer, random_rand() % opt.interval, send_packet,
+					a);
+		}
+	}
+
+	sim_set_current_node(NULL);
+	ctimer_set(&queue_sample_timer, QUEUE_SAMPLE_INTERVAL, sample_queues, NULL);
+}
+
+/* Averages the links' ETX estimates by their length relative to range. */
+static void print_etx(void) {
+	double sum[4] = {0, 0, 0, 0};
+	int num[4] = {0, 0, 0, 0};
+	int i;
+	int b;
+
+	for (i = 0; i < radio_medium_num_nodes(); ++i) {
+		struct sim_node *n = radio_medium_node(i);
+		struct sim_app *a = app_of(n);
+		const struct neighbor_node *nn = neighbors_begin(&a->ns);
+		for (; nn != NULL; nn = neighbors_next(&a->ns)) {
+			struct sim_node *to = radio_medium_find_node(neighbor_node_addr(nn));
+			double d = hypot(to->x - n->x, to->y - n->y)/opt.range;
+			b = d <= 0.25 ? 0 : d <= 0.5 ? 1 : d <= 0.75 ? 2 : 3;
+			sum[b] += (double)neighbor_node_etx(nn)/ETX_ONE;
+			++num[b];
+		}
+	}
+
+	printf("etx: by distance/range:");
+	for (b = 0; b < 4; ++b) {
+		if (num[b] > 0) {
+			printf(" <=%.2f: %.2f (%d links)", (b+1)/4.0, sum[b]/num[b], num[b]);
+		}
+	}
+	printf("\n");
+}
+
+/* Sums the emergency_conn counters of all nodes, per class. */
+static void print_class_stats(void) {
+	uint64_t received = 0;
+	uint64_t dupes = 0;
+	uint64_t overflows = 0;
+	uint64_t rtt[EC_RTT_BUCKETS] = {0};
+	uint64_t rtt_samples = 0;
+	int type;
+	int i;
+
+	for (i = 0; i < radio_medium_num_nodes(); ++i) {
+		const struct ec_stats *s = ec_stats(&app_of(radio_medium_node(i))->c);
+		int b;
+		received += s->received;
+		dupes += s->dupes;
+		overflows += s->overflows;
+		for (b = 0; b < EC_RTT_BUCKETS; ++b) {
+			rtt[b] += s->ack_rtt[b];
+			rtt_samples += s->ack_rtt[b];
+		}
+	}
+	printf("rx: received: %llu, dupes: %llu, overflows: %llu\n",
+			(unsigned long long)received, (unsigned long long)dupes,
+			(unsigned long long)overflows);
+	if (rtt_samples > 0) {
+		printf("ack rtt histogram:");
+		for (i = 0; i < EC_RTT_BUCKETS; ++i) {
+			if (i < EC_RTT_BUCKETS-1) {
+				printf(" <%.0f ms: %.1f%%,",
+						1000.0*((uint32_t)EC_RTT_BUCKET0 << i)/CLOCK_SECOND,
+						100.0*rtt[i]/rtt_samples);
+			} else {
+				printf(" longer: %.1f%%\n", 100.0*rtt[i]/rtt_samples);
+			}
+		}
+	}
+
+	for (type = 0; type < PACKET_BUFFER_MAX_TYPES; ++type) {
+		uint64_t sent = 0;
+		uint64_t busy = 0;
+		uint64_t piggybacked = 0;
+		uint64_t first_sends = 0;
+		uint64_t retransmits = 0;
+		uint64_t drops = 0;
+		uint64_t give_ups = 0;
+		uint64_t wait_sum = 0;
+		clock_time_t max_wait = 0;
+		int max_depth = 0;
+		for (i = 0; i < radio_medium_num_nodes(); ++i) {
+			const struct ec_class_stats *s =
+				ec_class_stats(&app_of(radio_medium_node(i))->c, type);
+			sent += s->sent;
+			busy += s->busy;
+			piggybacked += s->piggybacked;
+			first_sends += s->first_sends;
+			retransmits += s->retransmits;
+			drops += s->drops;
+			give_ups += s->give_ups;
+			wait_sum += s->wait_sum;
+			if (s->max_wait > max_wait) {
+				max_wait = s->max_wait;
+			}
+			if (s->max_depth > max_depth) {
+				max_depth = s->max_depth;
+			}
+		}
+		if (sent == 0 && busy == 0 && piggybacked == 0 && drops == 0) {
+			continue;
+		}
+		printf("class %s: sent: %llu, busy: %llu, piggybacked: %llu, "
+				"retx: %llu, drops: %llu, give ups: %llu, "
+				"wait: mean: %.1f ms, max: %.1f ms, depth: max: %d\n",
+				class_names[type], (unsigned long long)sent,
+				(unsigned long long)busy, (unsigned long long)piggybacked,
+				(unsigned long long)retransmits, (unsigned long long)drops,
+				(unsigned long long)give_ups,
+				first_sends > 0 ? 1000.0*wait_sum/first_sends/CLOCK_SECOND : 0,
+				1000.0*max_wait/CLOCK_SECOND, max_depth);
+	}
+}
+
+static double wall_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-x width] [-y height] [-r range] "
+			"[-t seconds] [-i interval_ms] [-m ns|bc|fl|tr] [-l loss] "
+			"[-e edge_loss] [-d latency_us] [-b bitrate] [-c 0|1] [-s seed]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	struct radio_medium_config cfg;
+	const struct radio_medium_stats *ms;
+	unsigned short seed = 1;
+	double seconds = 60;
+	double begin;
+	double wall;
+	uint64_t events;
+	int ch;
+
+	opt.width = 10;
+	opt.height = 10;
+	opt.range = 1.0;
+	opt.interval = 5*CLOCK_SECOND;
+	opt.mode = MODE_RELIABLE_NS;
+
+	cfg.loss = 0;
+	cfg.edge_loss = 0;
+	cfg.latency = 500;
+	cfg.bitrate = 250000;
+	cfg.frame_overhead = 17;
+	cfg.collisions = 1;
+	cfg.mesh_timeout = 20*SIM_USEC_PER_SECOND;
+
+	while ((ch = getopt(argc, argv, "x:y:r:t:i:m:l:e:d:b:c:s:")) != -1) {
+		switch (ch) {
+			case 'x': opt.width = atoi(optarg); break;
+			case 'y': opt.height = atoi(optarg); break;
+			case 'r': opt.range = atof(optarg); break;
+			case 't': seconds = atof(optarg); break;
+			case 'i': opt.interval = atoi(optarg)*CLOCK_SECOND/1000; break;
+			case 'm':
+				if (strcmp(optarg, "ns") == 0) {
+					opt.mode = MODE_RELIABLE_NS;
+				} else if (strcmp(optarg, "bc") == 0) {
+					opt.mode = MODE_BROADCAST;
+				} else if (strcmp(optarg, "fl") == 0) {
+					opt.mode = MODE_FLOOD;
+				} else if (strcmp(optarg, "tr") == 0) {
+					opt.mode = MODE_TRICKLE;
+				} else {
+					usage(argv[0]);
+				}
+				break;
+			case 'l': cfg.loss = atof(optarg); break;
+			case 'e': cfg.edge_loss = atof(optarg); break;
+			case 'd': cfg.latency = atoi(optarg); break;
+			case 'b': cfg.bitrate = atoi(optarg); break;
+			case 'c': cfg.collisions = atoi(optarg); break;
+			case 's': seed = (unsigned short)atoi(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+
+	if (opt.width <= 0 || opt.height <= 0 || opt.width*opt.height > 0xFFFE ||
+			opt.interval == 0 || cfg.bitrate == 0) {
+		usage(argv[0]);
+	}
+	opt.duration = (clock_time_t)(seconds*CLOCK_SECOND);
+
+	random_init(seed);
+	sim_init();
+	radio_medium_init(&cfg, opt.width*opt.height);
+	radio_medium_set_hooks(sniff_tx, sniff_rx);
+	setup_nodes();
+
+	begin = wall_seconds();
+	events = sim_run(SIM_TICKS_TO_USEC(opt.duration));
+	wall = wall_seconds() - begin;
+	ms = radio_medium_stats();
+
+	printf("nodes: %d, range: %.2f, mode: %s, duration: %.1f s\n",
+			radio_medium_num_nodes(), opt.range, mode_names[opt.mode], seconds);
+	printf("originated: %llu, delivered: %llu, delivered/s: %.1f\n",
+			(unsigned long long)stats.originated,
+			(unsigned long long)stats.delivered, stats.delivered/seconds);
+	printf("frames: %llu, bytes: %llu, busy: %llu, receptions: %llu, "
+			"collisions: %llu, losses: %llu, mesh: %llu/%llu\n",
+			(unsigned long long)ms->frames_sent,
+			(unsigned long long)ms->bytes_sent,
+			(unsigned long long)ms->busy_refusals,
+			(unsigned long long)ms->receptions,
+			(unsigned long long)ms->collisions,
+			(unsigned long long)ms->losses,
+			(unsigned long long)ms->mesh_sent,
+			(unsigned long long)(ms->mesh_sent+ms->mesh_lost));
+	if (is_flood_mode() && stats.originated > 0) {
+		printf("flood: coverage: %.1f%%, frames/alarm: %.1f, "
+				"latency: mean: %.1f ms\n",
+				100.0*stats.delivered/stats.originated/
+				(radio_medium_num_nodes()-1),
+				(double)ms->frames_sent/stats.originated,
+				stats.delivered > 0 ?
+				stats.flood_latency_sum/1000.0/stats.delivered : 0);
+	}
+	if (stats.rtt_samples > 0) {
+		printf("ack rtt: samples: %llu, mean: %.1f ms, min: %.1f ms, "
+				"max: %.1f ms\n",
+				(unsigned long long)stats.rtt_samples,
+				stats.rtt_sum/1000.0/stats.rtt_samples,
+				stats.rtt_min/1000.0, stats.rtt_max/1000.0);
+	} else {
+		printf("ack rtt: no samples\n");
+	}
+	if (stats.queue_samples > 0) {
+		printf("queue: mean: %.2f, max: %d of %d\n",
+				(double)stats.queue_sum/stats.queue_samples/
+				radio_medium_num_nodes(), stats.queue_max, SENDING_QUEUE_LENGTH);
+	}
+	print_class_stats();
+	print_etx();
+	printf("wall: %.2f s, events: %llu, events/s: %.0f\n", wall,
+			(unsigned long long)events, wall > 0 ? events/wall : 0);
+
+	return 0;
+}
@@ -0,0 +1,395 @@
+#include "sim/radio_medium.h"
+
+#include "net/rime/packetbuf.h"
+#include "lib/random.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct radio_medium_frame {
+	struct sim_node *sender;
+	uint16_t channel;
+	uint8_t len;
+	uint16_t refs;
+	uint8_t data[RADIO_MEDIUM_MAX_FRAME_SIZE];
+};
+
+struct radio_medium_rx {
+	struct radio_medium_frame *f;
+	struct sim_node *to;
+	int8_t collided;
+};
+
+static struct {
+	struct radio_medium_config cfg;
+	struct radio_medium_stats stats;
+	struct sim_node *nodes;
+	int num_nodes;
+	int max_nodes;
+	double range;
+	radio_medium_hook_t tx_hook;
+	radio_medium_hook_t rx_hook;
+} m;
+
+static void* xmalloc(size_t size) {
+	void *p = malloc(size);
+	if (p == NULL) {
+		abort();
+	}
+	return p;
+}
+
+static int chance(double p) {
+	return p > 0 && random_rand() < p*((double)0xFFFF+1);
+}
+
+static sim_time_t airtime(uint8_t len) {
+	return ((sim_time_t)(len+m.cfg.frame_overhead))*8*SIM_USEC_PER_SECOND/
+		m.cfg.bitrate;
+}
+
+static struct radio_medium_frame* frame_from_packetbuf(struct sim_node *sender,
+		uint16_t channel) {
+	struct radio_medium_frame *f =
+		(struct radio_medium_frame*)xmalloc(sizeof(struct radio_medium_frame));
+	f->sender = sender;
+	f->channel = channel;
+	f->len = packetbuf_datalen() < RADIO_MEDIUM_MAX_FRAME_SIZE ?
+		packetbuf_datalen() : RADIO_MEDIUM_MAX_FRAME_SIZE;
+	f->refs = 0;
+	memcpy(f->data, packetbuf_dataptr(), f->len);
+	return f;
+}
+
+static void frame_release(struct radio_medium_frame *f) {
+	if (--f->refs == 0) {
+		free(f);
+	}
+}
+
+static void frame_to_packetbuf(const struct radio_medium_frame *f) {
+	packetbuf_clear();
+	packetbuf_copyfrom(f->data, f->len);
+}
+
+void radio_medium_init(const struct radio_medium_config *cfg, int max_nodes) {
+	memcpy(&m.cfg, cfg, sizeof(struct radio_medium_config));
+	memset(&m.stats, 0, sizeof(struct radio_medium_stats));
+	m.nodes = (struct sim_node*)calloc(max_nodes, sizeof(struct sim_node));
+	if (m.nodes == NULL) {
+		abort();
+	}
+	m.num_nodes = 0;
+	m.max_nodes = max_nodes;
+	m.range = 0;
+	m.tx_hook = NULL;
+	m.rx_hook = NULL;
+}
+
+struct sim_node* radio_medium_add_node(const rimeaddr_t *addr, double x,
+		double y) {
+	struct sim_node *n;
+	if (m.num_nodes == m.max_nodes) {
+		return NULL;
+	}
+
+	n = &m.nodes[m.num_nodes++];
+	rimeaddr_copy(&n->addr, addr);
+	n->x = x;
+	n->y = y;
+	return n;
+}
+
+static double node_distance(const struct sim_node *a, const struct sim_node *b) {
+	double dx = a->x - b->x;
+	double dy = a->y - b->y;
+	return sqrt(dx*dx + dy*dy);
+}
+
+void radio_medium_connect(double range) {
+	int i;
+	int j;
+	m.range = range;
+
+	for (i = 0; i < m.num_nodes; ++i) {
+		struct sim_node *a = &m.nodes[i];
+		free(a->in_range);
+		a->in_range = NULL;
+		a->num_in_range = 0;
+		for (j = 0; j < m.num_nodes; ++j) {
+			if (i != j && node_distance(a, &m.nodes[j]) <= range) {
+				a->in_range = (struct sim_node**)realloc(a->in_range,
+						(a->num_in_range+1)*sizeof(struct sim_node*));
+				if (a->in_range == NULL) {
+					abort();
+				}
+				a->in_range[a->num_in_range++] = &m.nodes[j];
+			}
+		}
+	}
+}
+
+struct sim_node* radio_medium_find_node(const rimeaddr_t *addr) {
+	int i;
+	for (i = 0; i < m.num_nodes; ++i) {
+		if (rimeaddr_cmp(&m.nodes[i].addr, addr)) {
+			return &m.nodes[i];
+		}
+	}
+
+	return NULL;
+}
+
+int radio_medium_num_nodes(void) {
+	return m.num_nodes;
+}
+
+struct sim_node* radio_medium_node(int i) {
+	return &m.nodes[i];
+}
+
+const rimeaddr_t* sim_node_addr(const struct sim_node *node) {
+	return &node->addr;
+}
+
+void radio_medium_set_hooks(radio_medium_hook_t tx, radio_medium_hook_t rx) {
+	m.tx_hook = tx;
+	m.rx_hook = rx;
+}
+
+const struct radio_medium_stats* radio_medium_stats(void) {
+	return &m.stats;
+}
+
+void radio_medium_open_abc(struct abc_conn *c) {
+	struct sim_node *n = sim_current_node();
+	int i;
+	for (i = 0; i < RADIO_MEDIUM_MAX_CONNS; ++i) {
+		if (n->abc[i] == NULL) {
+			n->abc[i] = c;
+			return;
+		}
+	}
+
+	abort();
+}
+
+void radio_medium_close_abc(struct abc_conn *c) {
+	struct sim_node *n = sim_current_node();
+	int i;
+	for (i = 0; i < RADIO_MEDIUM_MAX_CONNS; ++i) {
+		if (n->abc[i] == c) {
+			n->abc[i] = NULL;
+		}
+	}
+}
+
+static struct abc_conn* find_abc(struct sim_node *n, uint16_t channel) {
+	int i;
+	for (i = 0; i < RADIO_MEDIUM_MAX_CONNS; ++i) {
+		if (n->abc[i] != NULL && n->abc[i]->channel.channelno == channel) {
+			return n->abc[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void rx_start(void *a, void *b, uint32_t stamp);
+static void rx_end(void *a, void *b, uint32_t stamp);
+
+int radio_medium_transmit(uint16_t channel) {
+	struct sim_node *n = sim_current_node();
+	struct radio_medium_frame *f;
+	sim_time_t now = sim_now();
+	sim_time_t at;
+	int i;
+
+	if (n->tx_until > now || (m.cfg.collisions && n->rx_active > 0)) {
+		++m.stats.busy_refusals;
+		return 0;
+	}
+
+	f = frame_from_packetbuf(n, channel);
+	n->tx_until = now + airtime(f->len);
+	++m.stats.frames_sent;
+	m.stats.bytes_sent += f->len;
+
+	if (m.tx_hook != NULL) {
+		m.tx_hook(n, channel, f->data, f->len);
+	}
+
+	at = now + m.cfg.latency;
+	f->refs = n->num_in_range+1;
+	for (i = 0; i < n->num_in_range; ++i) {
+		struct radio_medium_rx *rx =
+			(struct radio_medium_rx*)xmalloc(sizeof(struct radio_medium_rx));
+		rx->f = f;
+		rx->to = n->in_range[i];
+		rx->collided = 0;
+		sim_schedule(at, rx->to, rx_start, rx, NULL, 0);
+	}
+	frame_release(f);
+
+	return 1;
+}
+
+static void rx_start(void *a, void *b, uint32_t stamp) {
+	struct radio_medium_rx *rx = (struct radio_medium_rx*)a;
+	struct sim_node *n = rx->to;
+
+	++m.stats.receptions;
+	++n->rx_active;
+	if (n->rx_active == 1) {
+		n->rx_cur = rx;
+	} else if (m.cfg.collisions) {
+		/* Any reception still on air that is not yet collided is rx_cur, see
+		 * rx_end. */
+		rx->collided = 1;
+		if (n->rx_cur != NULL) {
+			n->rx_cur->collided = 1;
+		}
+	}
+
+	sim_schedule(sim_now()+airtime(rx->f->len), n, rx_end, rx, NULL, 0);
+}
+
+static void rx_end(void *a, void *b, uint32_t stamp) {
+	struct radio_medium_rx *rx = (struct radio_medium_rx*)a;
+	struct sim_node *n = rx->to;
+	struct abc_conn *c;
+	double d = node_distance(rx->f->sender, n)/m.range;
+
+	--n->rx_active;
+	if (n->rx_cur == rx) {
+		n->rx_cur = NULL;
+	}
+
+	if (rx->collided || (m.cfg.collisions && n->tx_until > sim_now() -
+				airtime(rx->f->len))) {
+		/* collided, or we were transmitting ourselves (half duplex) */
+		++m.stats.collisions;
+	} else if (chance(m.cfg.loss+m.cfg.edge_loss*d*d)) {
+		++m.stats.losses;
+	} else if ((c = find_abc(n, rx->f->channel)) != NULL) {
+		++m.stats.delivered;
+		frame_to_packetbuf(rx->f);
+		packetbuf_set_attr(PACKETBUF_ATTR_LINK_QUALITY,
+				(packetbuf_attr_t)(110-55*d));
+		if (m.rx_hook != NULL) {
+			m.rx_hook(n, rx->f->channel, rx->f->data, rx->f->len);
+		}
+		c->u->recv(c);
+	}
+
+	frame_release(rx->f);
+	free(rx);
+}
+
+void radio_medium_open_mesh(struct mesh_conn *c, uint16_t channel) {
+	struct sim_node *n = sim_current_node();
+	int i;
+	for (i = 0; i < RADIO_MEDIUM_MAX_CONNS; ++i) {
+		if (n->mesh[i].c == NULL) {
+			n->mesh[i].c = c;
+			n->mesh[i].channel = channel;
+			return;
+		}
+	}
+
+	abort();
+}
+
+void radio_medium_close_mesh(struct mesh_conn *c) {
+	struct sim_node *n = sim_current_node();
+	int i;
+	for (i = 0; i < RADIO_MEDIUM_MAX_CONNS; ++i) {
+		if (n->mesh[i].c == c) {
+			n->mesh[i].c = NULL;
+		}
+	}
+}
+
+static struct mesh_conn* find_mesh(struct sim_node *n, uint16_t channel) {
+	int i;
+	for (i = 0; i < RADIO_MEDIUM_MAX_CONNS; ++i) {
+		if (n->mesh[i].c != NULL && n->mesh[i].channel == channel) {
+			return n->mesh[i].c;
+		}
+	}
+
+	return NULL;
+}
+
+static uint16_t mesh_channel(struct sim_node *n, const struct mesh_conn *c) {
+	int i;
+	for (i = 0; i < RADIO_MEDIUM_MAX_CONNS; ++i) {
+		if (n->mesh[i].c == c) {
+			return n->mesh[i].channel;
+		}
+	}
+
+	abort();
+}
+
+static void mesh_deliver(void *a, void *b, uint32_t hops) {
+	struct radio_medium_frame *f = (struct radio_medium_frame*)a;
+	struct sim_node *to = (struct sim_node*)b;
+	struct mesh_conn *c = find_mesh(to, f->channel);
+
+	if (c != NULL) {
+		frame_to_packetbuf(f);
+		c->cb->recv(c, &f->sender->addr, hops);
+	}
+	frame_release(f);
+}
+
+static void mesh_sent(void *a, void *b, uint32_t stamp) {
+	struct mesh_conn *c = (struct mesh_conn*)a;
+	c->cb->sent(c);
+}
+
+static void mesh_timedout(void *a, void *b, uint32_t stamp) {
+	struct mesh_conn *c = (struct mesh_conn*)a;
+	c->cb->timedout(c);
+}
+
+int radio_medium_mesh_transmit(struct mesh_conn *c, const rimeaddr_t *dest) {
+	struct sim_node *n = sim_current_node();
+	struct sim_node *to = radio_medium_find_node(dest);
+	struct radio_medium_frame *f = frame_from_packetbuf(n, mesh_channel(n, c));
+	sim_time_t hop_time = m.cfg.latency + airtime(f->len);
+	uint32_t hops = 1;
+	int lost = (to == NULL);
+
+	if (to != NULL && m.range > 0) {
+		hops = (uint32_t)ceil(node_distance(n, to)/m.range);
+		if (hops == 0) {
+			hops = 1;
+		}
+	}
+
+	if (!lost) {
+		uint32_t i;
+		for (i = 0; i < hops; ++i) {
+			if (chance(m.cfg.loss)) {
+				lost = 1;
+				break;
+			}
+		}
+	}
+
+	if (lost) {
+		++m.stats.mesh_lost;
+		free(f);
+		sim_schedule(sim_now()+m.cfg.mesh_timeout, n, mesh_timedout, c, NULL, 0);
+	} else {
+		++m.stats.mesh_sent;
+		f->refs = 1;
+		sim_schedule(sim_now()+hops*hop_time, to, mesh_deliver, f, to, hops);
+		sim_schedule(sim_now()+hops*hop_time, n, mesh_sent, c, NULL, 0);
+	}
+
+	return 1;
+}
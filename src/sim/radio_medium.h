@@ -0,0 +1,102 @@
+/* Simulated broadcast medium. Frames sent on a node reach every node within
+ * radio range after a fixed latency plus the frame's airtime. Receptions that
+ * overlap in time at a receiver collide, and every reception can additionally
+ * be dropped with a configurable probability, which may grow towards the edge
+ * of range. Delivered frames carry a CC2420 like LQI that falls with
+ * distance. */
+#ifndef _RADIO_MEDIUM_H_
+#define _RADIO_MEDIUM_H_
+
+#include "net/rime/rimeaddr.h"
+#include "net/rime/abc.h"
+#include "net/rime/mesh.h"
+
+#include "sim/sim.h"
+
+#define RADIO_MEDIUM_MAX_CONNS 4
+#define RADIO_MEDIUM_MAX_FRAME_SIZE 128
+
+struct radio_medium_config {
+	double loss; /* probability in [0,1] that a reception is dropped */
+	double edge_loss; /* added to loss at (distance/range)^2 */
+	sim_time_t latency; /* propagation and processing delay per hop */
+	uint32_t bitrate; /* bits per second */
+	uint8_t frame_overhead; /* PHY/MAC header bytes added to every frame */
+	int8_t collisions; /* 0 disables the collision model */
+	sim_time_t mesh_timeout; /* until a lost mesh packet is reported */
+};
+
+struct radio_medium_stats {
+	uint64_t frames_sent;
+	uint64_t bytes_sent; /* payload, without frame_overhead */
+	uint64_t busy_refusals; /* abc_send called while the channel was busy */
+	uint64_t receptions;
+	uint64_t collisions;
+	uint64_t losses;
+	uint64_t delivered;
+	uint64_t mesh_sent;
+	uint64_t mesh_lost;
+};
+
+struct radio_medium_rx;
+
+struct sim_node {
+	rimeaddr_t addr;
+	double x;
+	double y;
+
+	/* radio state */
+	sim_time_t tx_until;
+	uint8_t rx_active;
+	struct radio_medium_rx *rx_cur;
+
+	struct sim_node **in_range;
+	uint16_t num_in_range;
+
+	struct abc_conn *abc[RADIO_MEDIUM_MAX_CONNS];
+	struct {
+		uint16_t channel;
+		struct mesh_conn *c;
+	} mesh[RADIO_MEDIUM_MAX_CONNS];
+
+	void *app;
+};
+
+/* Called for every frame put on air and every frame delivered to a
+ * connection. Used by the benchmark to sniff round-trip times. */
+typedef void (*radio_medium_hook_t)(struct sim_node *node, uint16_t channel,
+		const uint8_t *data, uint8_t len);
+
+void radio_medium_init(const struct radio_medium_config *cfg, int max_nodes);
+
+struct sim_node* radio_medium_add_node(const rimeaddr_t *addr, double x,
+		double y);
+
+/* Links every pair of nodes within range of each other. Call once all nodes
+ * have been added. */
+void radio_medium_connect(double range);
+
+struct sim_node* radio_medium_find_node(const rimeaddr_t *addr);
+
+int radio_medium_num_nodes(void);
+struct sim_node* radio_medium_node(int i);
+
+void radio_medium_set_hooks(radio_medium_hook_t tx, radio_medium_hook_t rx);
+
+const struct radio_medium_stats* radio_medium_stats(void);
+
+/* Backends of the Contiki rime shim. All act on sim_current_node(). */
+void radio_medium_open_abc(struct abc_conn *c);
+void radio_medium_close_abc(struct abc_conn *c);
+
+/* Puts packetbuf on air. Returns 0 if the channel is busy (the node is
+ * transmitting or hears another transmission), 1 otherwise. */
+int radio_medium_transmit(uint16_t channel);
+
+void radio_medium_open_mesh(struct mesh_conn *c, uint16_t channel);
+void radio_medium_close_mesh(struct mesh_conn *c);
+
+/* Delivers packetbuf to dest over an idealized multi-hop route. */
+int radio_medium_mesh_transmit(struct mesh_conn *c, const rimeaddr_t *dest);
+
+#endif
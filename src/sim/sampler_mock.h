@@ -0,0 +1,13 @@
+/* Host stand-in for the sampler's sensors, for tests. */
+#ifndef _SAMPLER_MOCK_H_
+#define _SAMPLER_MOCK_H_
+
+#include "base/sampler.h"
+
+/* Every later sample of source reads value. */
+void sampler_mock_set(enum sampler_source source, uint16_t value);
+
+/* Samples taken of source since the start. */
+unsigned sampler_mock_samples(enum sampler_source source);
+
+#endif
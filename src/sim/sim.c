@@ -0,0 +1,133 @@
+#include "sim/sim.h"
+
+#include <stdlib.h>
+
+struct sim_event {
+	sim_time_t at;
+	uint64_t order;
+	struct sim_node *node;
+	sim_event_fn_t fn;
+	void *a;
+	void *b;
+	uint32_t stamp;
+};
+
+static struct {
+	struct sim_event *heap;
+	size_t size;
+	size_t capacity;
+	uint64_t order;
+	sim_time_t now;
+	struct sim_node *current;
+} s;
+
+static inline
+int event_before(const struct sim_event *l, const struct sim_event *r) {
+	return l->at < r->at || (l->at == r->at && l->order < r->order);
+}
+
+static void heap_swap(size_t i, size_t j) {
+	struct sim_event tmp = s.heap[i];
+	s.heap[i] = s.heap[j];
+	s.heap[j] = tmp;
+}
+
+static void heap_up(size_t i) {
+	while (i > 0) {
+		size_t parent = (i-1)/2;
+		if (!event_before(&s.heap[i], &s.heap[parent])) {
+			break;
+		}
+		heap_swap(i, parent);
+		i = parent;
+	}
+}
+
+static void heap_down(size_t i) {
+	for (;;) {
+		size_t l = 2*i+1;
+		size_t r = l+1;
+		size_t min = i;
+		if (l < s.size && event_before(&s.heap[l], &s.heap[min])) {
+			min = l;
+		}
+		if (r < s.size && event_before(&s.heap[r], &s.heap[min])) {
+			min = r;
+		}
+		if (min == i) {
+			break;
+		}
+		heap_swap(i, min);
+		i = min;
+	}
+}
+
+void sim_init(void) {
+	free(s.heap);
+	s.heap = NULL;
+	s.size = 0;
+	s.capacity = 0;
+	s.order = 0;
+	s.now = 0;
+	s.current = NULL;
+}
+
+void sim_schedule(sim_time_t at, struct sim_node *node, sim_event_fn_t fn,
+		void *a, void *b, uint32_t stamp) {
+	struct sim_event *e;
+
+	if (s.size == s.capacity) {
+		s.capacity = s.capacity ? 2*s.capacity : 1024;
+		s.heap = (struct sim_event*)realloc(s.heap,
+				s.capacity*sizeof(struct sim_event));
+		if (s.heap == NULL) {
+			abort();
+		}
+	}
+
+	e = &s.heap[s.size];
+	e->at = at < s.now ? s.now : at;
+	e->order = s.order++;
+	e->node = node;
+	e->fn = fn;
+	e->a = a;
+	e->b = b;
+	e->stamp = stamp;
+	heap_up(s.size++);
+}
+
+uint64_t sim_run(sim_time_t until) {
+	uint64_t n = 0;
+
+	while (s.size > 0 && s.heap[0].at <= until) {
+		struct sim_event e = s.heap[0];
+		s.heap[0] = s.heap[--s.size];
+		heap_down(0);
+
+		s.now = e.at;
+		sim_set_current_node(e.node);
+		e.fn(e.a, e.b, e.stamp);
+		++n;
+	}
+
+	if (s.now < until) {
+		s.now = until;
+	}
+
+	return n;
+}
+
+sim_time_t sim_now(void) {
+	return s.now;
+}
+
+void sim_set_current_node(struct sim_node *node) {
+	s.current = node;
+	if (node != NULL) {
+		rimeaddr_copy(&rimeaddr_node_addr, sim_node_addr(node));
+	}
+}
+
+struct sim_node* sim_current_node(void) {
+	return s.current;
+}
@@ -0,0 +1,42 @@
+/* Discrete event core of the host simulation. Every virtual node runs the
+ * unmodified emergency_net code; the simulator switches rimeaddr_node_addr to
+ * the node an event belongs to before calling into it. */
+#ifndef _SIM_H_
+#define _SIM_H_
+
+#include "contiki-conf.h"
+#include "net/rime/rimeaddr.h"
+
+#include <stdint.h>
+
+typedef uint64_t sim_time_t; /* microseconds */
+
+#define SIM_USEC_PER_SECOND 1000000ULL
+#define SIM_TICKS_TO_USEC(t) (((sim_time_t)(t))*SIM_USEC_PER_SECOND/CLOCK_SECOND)
+
+struct sim_node;
+
+typedef void (*sim_event_fn_t)(void *a, void *b, uint32_t stamp);
+
+void sim_init(void);
+
+/* Schedules fn(a, b, stamp) to run at absolute time at. The current node when
+ * the event is dispatched is node (which may be NULL). Events with equal time
+ * run in the order they were scheduled. */
+void sim_schedule(sim_time_t at, struct sim_node *node, sim_event_fn_t fn,
+		void *a, void *b, uint32_t stamp);
+
+/* Runs events until the queue is empty or time passes until. Returns the
+ * number of events dispatched. */
+uint64_t sim_run(sim_time_t until);
+
+sim_time_t sim_now(void);
+
+void sim_set_current_node(struct sim_node *node);
+struct sim_node* sim_current_node(void);
+
+/* Provided by the owner of struct sim_node (the medium), called when the
+ * simulator switches node context. */
+const rimeaddr_t* sim_node_addr(const struct sim_node *node);
+
+#endif
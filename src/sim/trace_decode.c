@@ -0,0 +1,73 @@
+/* Turns the trace lines in a mote's serial output back into text, and passes
+ * every other line through:
+ *
+ * ./trace_decode [-c ticks_per_second] < serial.log
+ *
+ * Times are in seconds from the first event. The mote's 16 bit clock wraps
+ * every 512 s at the Tmote Sky's 128 ticks per second, gaps longer than that
+ * between events are lost. */
+#include "base/trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LINE_MAX_SIZE 512
+
+static const char *formats[TRACE_EVENTS] = {
+#define TRACE_EV(id, format) format,
+#include "base/trace_events.h"
+#undef TRACE_EV
+};
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-c ticks_per_second] < serial.log\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	char line[LINE_MAX_SIZE];
+	double ticks_per_second = 128;
+	unsigned long long ticks = 0;
+	uint16_t last = 0;
+	int has_last = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "c:")) != -1) {
+		switch (opt) {
+			case 'c':
+				ticks_per_second = atof(optarg);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (ticks_per_second <= 0) {
+		usage(argv[0]);
+	}
+
+	while (fgets(line, sizeof(line), stdin) != NULL) {
+		struct trace_event e;
+		if (!trace_parse(line, &e)) {
+			fputs(line, stdout);
+			continue;
+		}
+
+		if (has_last) {
+			ticks += (uint16_t)(e.time - last);
+		}
+		last = e.time;
+		has_last = 1;
+
+		printf("%10.3f ", ticks/ticks_per_second);
+		if (e.id < TRACE_EVENTS) {
+			printf(formats[e.id], e.a, e.b >> 8, e.b & 0xFF, e.c);
+		} else {
+			printf("unknown event %u: %u %u %u", e.id, e.a, e.b, e.c);
+		}
+		printf("\n");
+	}
+
+	return 0;
+}
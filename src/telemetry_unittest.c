@@ -0,0 +1,100 @@
+#include "base/unittest.h"
+
+#include "net/rime/ctimer.h"
+#include "lib/crc16.h"
+
+#include "string.h"
+
+#include "base/telemetry.h"
+
+#ifdef UNITTEST_HOST
+/* the flush timer is checked by hand */
+static void (*timer_f)(void *);
+
+void ctimer_set(struct ctimer *c, clock_time_t t, void (*f)(void *),
+		void *ptr) {
+	timer_f = f;
+}
+
+void ctimer_stop(struct ctimer *c) {
+	timer_f = NULL;
+}
+#endif
+
+static uint8_t written[4*TELEMETRY_FRAME_SIZE];
+static uint16_t written_len;
+static uint8_t frames;
+
+static void write_frame(const uint8_t *frame, uint8_t len) {
+	ASSERT(written_len+len <= sizeof(written));
+	memcpy(written+written_len, frame, len);
+	written_len += len;
+	++frames;
+}
+
+static void check_frame(const uint8_t *frame) {
+	uint8_t len = frame[1];
+	uint16_t crc = crc16_data(frame+1, 1+len, 0);
+	ASSERT(frame[0] == TELEMETRY_SYNC);
+	ASSERT(len <= TELEMETRY_MAX_PAYLOAD);
+	ASSERT(frame[2+len] == crc >> 8);
+	ASSERT(frame[2+len+1] == (crc & 0xFF));
+}
+
+static void test_telemetry(void) {
+	rimeaddr_t a = { {1, 2} };
+	rimeaddr_t b = { {3, 4} };
+	uint8_t i;
+
+	written_len = 0;
+	frames = 0;
+	telemetry_init(write_frame);
+
+	/* nothing to write */
+	telemetry_flush();
+	ASSERT(frames == 0);
+
+	/* records wait for the flush */
+	telemetry_node_report(&a, 0x0102, 7, 1, 0);
+	telemetry_emergency(&b, 1);
+	telemetry_emergency(&a, 0);
+	telemetry_setup_ack(&b);
+	ASSERT(frames == 0);
+#ifdef UNITTEST_HOST
+	ASSERT(timer_f != NULL);
+	timer_f(NULL);
+	ASSERT(timer_f == NULL);
+#else
+	telemetry_flush();
+#endif
+	ASSERT(frames == 1);
+	ASSERT(written_len == 2+8+3+3+3+2);
+	check_frame(written);
+	{
+		const uint8_t expect[] = {
+			TELEMETRY_SYNC, 17,
+			TELEMETRY_NODE_REPORT, 1, 2, 0x01, 0x02, 0, 7, TELEMETRY_BURNING,
+			TELEMETRY_EMERGENCY, 3, 4,
+			TELEMETRY_ANTI_EMERGENCY, 1, 2,
+			TELEMETRY_SETUP_ACK, 3, 4
+		};
+		ASSERT(memcmp(written, expect, sizeof(expect)) == 0);
+	}
+
+	/* a record that does not fit starts the next frame */
+	written_len = 0;
+	frames = 0;
+	for (i = 0; i < TELEMETRY_MAX_PAYLOAD/8+1; ++i) {
+		telemetry_node_report(&b, i, i, 0, 1);
+	}
+	ASSERT(frames == 1);
+	check_frame(written);
+	ASSERT(written[1] == TELEMETRY_MAX_PAYLOAD/8*8);
+	ASSERT(written[2+7] == TELEMETRY_EXIT_NODE);
+	telemetry_flush();
+	ASSERT(frames == 2);
+	check_frame(written+2+written[1]+2);
+	ASSERT(written[2+written[1]+2+1] == 8);
+}
+
+UNITTEST("testtelemetry", test_telemetry)
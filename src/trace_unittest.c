@@ -0,0 +1,58 @@
+#include "base/unittest.h"
+
+#include "string.h"
+
+#include "net/rime/rimeaddr.h"
+
+#include "base/trace.h"
+
+#ifdef UNITTEST_HOST
+static clock_time_t now;
+
+clock_time_t clock_time(void) {
+	return now;
+}
+#endif
+
+static void test_trace(void) {
+	struct trace_event e;
+	char line[TRACE_LINE_SIZE];
+	int i;
+
+	while (trace_read(&e)) {
+	}
+
+	trace_event(TRACE_EC_SEND, 1, TRACE_ADDR(&rimeaddr_node_addr), 0xBEEF);
+	ASSERT(trace_read(&e));
+	ASSERT(e.id == TRACE_EC_SEND && e.a == 1 && e.c == 0xBEEF);
+	ASSERT(!trace_read(&e));
+
+	/* in order, and the ones that do not fit are counted */
+	for (i = 0; i < TRACE_BUFFER_SIZE+3; ++i) {
+		trace_event(TRACE_EC_BUSY, i, i, i);
+	}
+	for (i = 0; i < TRACE_BUFFER_SIZE; ++i) {
+		ASSERT(trace_read(&e));
+		ASSERT(e.id == TRACE_EC_BUSY && e.a == i);
+	}
+	ASSERT(trace_read(&e));
+	ASSERT(e.id == TRACE_LOST && e.a == 3);
+	ASSERT(!trace_read(&e));
+
+	/* lines */
+	e.id = TRACE_EC_RECV;
+	e.a = 0x30;
+	e.time = 0x1234;
+	e.b = 0x0102;
+	e.c = 0xFFFE;
+	trace_format(&e, line);
+	ASSERT(strcmp(line, "#T" "05" "30" "1234" "0102" "fffe") == 0);
+	memset(&e, 0, sizeof(e));
+	ASSERT(trace_parse(line, &e));
+	ASSERT(e.id == TRACE_EC_RECV && e.a == 0x30 && e.time == 0x1234 &&
+			e.b == 0x0102 && e.c == 0xFFFE);
+	ASSERT(!trace_parse("#T0530", &e));
+	ASSERT(!trace_parse("@EC_STATS:1:2:3:", &e));
+}
+
+UNITTEST("testtrace", test_trace)
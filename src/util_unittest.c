@@ -0,0 +1,26 @@
+#include "base/unittest.h"
+
+#include "base/util.h"
+
+static void test_time_reached(void) {
+	/* the sky's clock_time_t, promoted to int in arithmetic */
+	ASSERT(TIME_REACHED(uint16_t, 100, 100));
+	ASSERT(TIME_REACHED(uint16_t, 100, 101));
+	ASSERT(!TIME_REACHED(uint16_t, 101, 100));
+	ASSERT(!TIME_REACHED(uint16_t, 300, 100));
+	ASSERT(TIME_REACHED(uint16_t, 0xFFF0, 0x0010));
+	ASSERT(!TIME_REACHED(uint16_t, 0x0010, 0xFFF0));
+	ASSERT(TIME_REACHED(uint16_t, 0, 0x7FFE));
+	ASSERT(!TIME_REACHED(uint16_t, 0, 0x8000));
+
+	/* and the host's */
+	ASSERT(TIME_REACHED(unsigned long, 100, 101));
+	ASSERT(!TIME_REACHED(unsigned long, 101, 100));
+	ASSERT(TIME_REACHED(unsigned long, ~0UL-5, 5));
+	ASSERT(!TIME_REACHED(unsigned long, 5, ~0UL-5));
+
+	ASSERT(TIME_REACHED(clock_time_t, 7, 8));
+	ASSERT(!TIME_REACHED(clock_time_t, 8, 7));
+}
+
+UNITTEST("testutil", test_time_reached)